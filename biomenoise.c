@@ -157,6 +157,151 @@ double sampleSurfaceNoise(const SurfaceNoise *sn, int x, int y, int z)
     return clampedLerp(0.5 + 0.05*mainNoise, minNoise/512.0, maxNoise/512.0);
 }
 
+void initSurfaceNoiseColumn(SurfaceNoiseColumn *col, const SurfaceNoise *sn,
+    int x, int z)
+{
+    double xzScale = 684.412 * sn->xzScale;
+    double xzStep = xzScale / sn->xzFactor;
+    double persist = 1.0;
+    double dx, dz;
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        dx = maintainPrecision(x * xzScale * persist);
+        dz = maintainPrecision(z * xzScale * persist);
+        perlinPrepareXZ(&col->min[i], &sn->octmin.octaves[i], dx, dz);
+        perlinPrepareXZ(&col->max[i], &sn->octmax.octaves[i], dx, dz);
+
+        if (i < 8)
+        {
+            dx = maintainPrecision(x * xzStep * persist);
+            dz = maintainPrecision(z * xzStep * persist);
+            perlinPrepareXZ(&col->main[i], &sn->octmain.octaves[i], dx, dz);
+        }
+        persist *= 0.5;
+    }
+}
+
+void initSurfaceNoiseLevel(SurfaceNoiseLevel *lvl, const SurfaceNoise *sn, int y)
+{
+    double yScale = 684.412 * sn->yScale;
+    double yStep = yScale / sn->yFactor;
+    double persist = 1.0;
+    double dy, sy, ty;
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        dy = maintainPrecision(y * yScale  * persist);
+        sy = yScale * persist;
+        ty = y * sy;
+        perlinPrepareY(&lvl->min[i], &sn->octmin.octaves[i], dy, sy, ty);
+        perlinPrepareY(&lvl->max[i], &sn->octmax.octaves[i], dy, sy, ty);
+
+        if (i < 8)
+        {
+            dy = maintainPrecision(y * yStep  * persist);
+            sy = yStep * persist;
+            ty = y * sy;
+            perlinPrepareY(&lvl->main[i], &sn->octmain.octaves[i], dy, sy, ty);
+        }
+        persist *= 0.5;
+    }
+}
+
+double sampleSurfaceNoiseColumn(const SurfaceNoise *sn,
+    const SurfaceNoiseColumn *col, const SurfaceNoiseLevel *lvl)
+{
+    double minNoise = 0;
+    double maxNoise = 0;
+    double mainNoise = 0;
+    double contrib = 1.0;
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        minNoise += samplePerlinXZY(&sn->octmin.octaves[i],
+            &col->min[i], &lvl->min[i]) * contrib;
+        maxNoise += samplePerlinXZY(&sn->octmax.octaves[i],
+            &col->max[i], &lvl->max[i]) * contrib;
+        if (i < 8)
+        {
+            mainNoise += samplePerlinXZY(&sn->octmain.octaves[i],
+                &col->main[i], &lvl->main[i]) * contrib;
+        }
+        contrib *= 2.0;
+    }
+
+    return clampedLerp(0.5 + 0.05*mainNoise, minNoise/512.0, maxNoise/512.0);
+}
+
+/* The End variant of the level terms as used by sampleSurfaceNoiseBetween().
+ * (The column terms are the same as for the Overworld.)
+ */
+static void initSurfaceNoiseLevelEnd(SurfaceNoiseLevel *lvl,
+    const SurfaceNoise *sn, int y)
+{
+    double yScale = 684.412 * sn->yScale;
+    double yStep = yScale / sn->yFactor;
+    double persist = 1.0;
+    double dy, sy;
+    int i;
+
+    for (i = 0; i < 16; i++)
+    {
+        sy = yScale * persist;
+        dy = y * sy;
+        perlinPrepareY(&lvl->min[i], &sn->octmin.octaves[i], dy, sy, dy);
+        perlinPrepareY(&lvl->max[i], &sn->octmax.octaves[i], dy, sy, dy);
+
+        if (i < 8)
+        {
+            sy = yStep * persist;
+            dy = y * sy;
+            perlinPrepareY(&lvl->main[i], &sn->octmain.octaves[i], dy, sy, dy);
+        }
+        persist *= 0.5;
+    }
+}
+
+static double sampleSurfaceNoiseColumnBetween(const SurfaceNoise *sn,
+    const SurfaceNoiseColumn *col, const SurfaceNoiseLevel *lvl,
+    double noiseMin, double noiseMax)
+{
+    double vmin = 0;
+    double vmax = 0;
+    double amp = 64.0;
+    int i;
+
+    for (i = 15; i >= 0; i--)
+    {
+        vmin += samplePerlinXZY(&sn->octmin.octaves[i],
+            &col->min[i], &lvl->min[i]) * amp;
+        vmax += samplePerlinXZY(&sn->octmax.octaves[i],
+            &col->max[i], &lvl->max[i]) * amp;
+        if (vmin - amp > noiseMax && vmax - amp > noiseMax)
+            return noiseMax;
+        if (vmin + amp < noiseMin && vmax + amp < noiseMin)
+            return noiseMin;
+        amp *= 0.5;
+    }
+
+    double vmain = 0.5;
+    amp = 0.05 * 128.0;
+
+    for (i = 7; i >= 0; i--)
+    {
+        vmain += samplePerlinXZY(&sn->octmain.octaves[i],
+            &col->main[i], &lvl->main[i]) * amp;
+        if (vmain - amp > 1) return vmax;
+        if (vmain + amp < 0) return vmin;
+        amp *= 0.5;
+    }
+
+    return clampedLerp(vmain, vmin, vmax);
+}
+
 //==============================================================================
 // Nether (1.16+) and End (1.9+) Biome Generation
 //==============================================================================
@@ -560,27 +705,105 @@ float getEndHeightNoise(const EndNoise *en, int x, int z, int range)
     return ret;
 }
 
+/* Determines getEndHeightNoise(en, x+i, z+j, 0) for an area of (w x h) cells.
+ * Neighbouring cells largely share the same islands, so the island elevations
+ * are sampled only once for the whole area. Returns non-zero if the working
+ * memory could not be allocated.
+ */
+static int mapEndHeightNoise(const EndNoise *en, float *out,
+    int x, int z, int w, int h)
+{
+    enum { R = 12 };
+    int64_t hx0 = x / 2 - R;
+    int64_t hz0 = z / 2 - R;
+    int64_t hw = (x + w - 1) / 2 + R + 1 - hx0;
+    int64_t hh = (z + h - 1) / 2 + R + 1 - hz0;
+    uint16_t *elev = (uint16_t*) malloc(sizeof(*elev) * hw * hh);
+    int64_t i, j;
+    int di, dj;
+
+    if (!elev)
+        return 1;
+
+    for (j = 0; j < hh; j++)
+    {
+        for (i = 0; i < hw; i++)
+        {
+            int64_t rx = hx0 + i;
+            int64_t rz = hz0 + j;
+            uint64_t rsq = rx*rx + rz*rz;
+            uint16_t v = 0;
+            if (rsq > 4096 && sampleSimplex2D(&en->perlin, rx, rz) < -0.9f)
+            {
+                v = (unsigned int)(
+                        fabsf((float)rx) * 3439.0f + fabsf((float)rz) * 147.0f
+                    ) % 13 + 9;
+            }
+            elev[j*hw+i] = v;
+        }
+    }
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            int cx = x + i;
+            int cz = z + j;
+            int oddx = cx % 2;
+            int oddz = cz % 2;
+            int64_t hmin = 64 * (cx*(int64_t)cx + cz*(int64_t)cz);
+            const uint16_t *p_elev =
+                elev + (cz/2 - R - hz0) * hw + (cx/2 - R - hx0);
+
+            for (dj = -R; dj <= R; dj++, p_elev += hw)
+            {
+                for (di = -R; di <= R; di++)
+                {
+                    uint16_t v = p_elev[di + R];
+                    if (v)
+                    {
+                        int64_t rx = (oddx - di * 2);
+                        int64_t rz = (oddz - dj * 2);
+                        uint64_t rsq = rx*rx + rz*rz;
+                        int64_t noise = rsq * v*v;
+                        if (noise < hmin)
+                            hmin = noise;
+                    }
+                }
+            }
+
+            float ret = 100 - sqrtf((float) hmin);
+            if (ret < -100) ret = -100;
+            if (ret > 80) ret = 80;
+            out[j*w+i] = ret;
+        }
+    }
+
+    free(elev);
+    return 0;
+}
+
+// clamped (32 + 46 - y) / 64.0
+static const double end_upper_drop[] = {
+       1.0,    1.0,    1.0,    1.0,    1.0,    1.0,    1.0,    1.0, // 0-7
+       1.0,    1.0,    1.0,    1.0,    1.0,    1.0,    1.0, 63./64, // 8-15
+    62./64, 61./64, 60./64, 59./64, 58./64, 57./64, 56./64, 55./64, // 16-23
+    54./64, 53./64, 52./64, 51./64, 50./64, 49./64, 48./64, 47./64, // 24-31
+    46./64 // 32
+};
+// clamped (y - 1) / 7.0
+static const double end_lower_drop[] = {
+      0.0,  0.0, 1./7, 2./7, 3./7, 4./7, 5./7, 6./7, // 0-7
+      1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, // 8-15
+      1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, // 16-23
+      1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, // 24-31
+      1.0, // 32
+};
+
 void sampleNoiseColumnEnd(double column[],
     const SurfaceNoise *sn, const EndNoise *en, int x, int z,
     int colymin, int colymax)
 {
-    // clamped (32 + 46 - y) / 64.0
-    static const double upper_drop[] = {
-           1.0,    1.0,    1.0,    1.0,    1.0,    1.0,    1.0,    1.0, // 0-7
-           1.0,    1.0,    1.0,    1.0,    1.0,    1.0,    1.0, 63./64, // 8-15
-        62./64, 61./64, 60./64, 59./64, 58./64, 57./64, 56./64, 55./64, // 16-23
-        54./64, 53./64, 52./64, 51./64, 50./64, 49./64, 48./64, 47./64, // 24-31
-        46./64 // 32
-    };
-    // clamped (y - 1) / 7.0
-    static const double lower_drop[] = {
-          0.0,  0.0, 1./7, 2./7, 3./7, 4./7, 5./7, 6./7, // 0-7
-          1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, // 8-15
-          1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, // 16-23
-          1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, // 24-31
-          1.0, // 32
-    };
-
     int y;
     if (en->mc > MC_1_13)
     {   // add outer end rings
@@ -605,14 +828,52 @@ void sampleNoiseColumnEnd(double column[],
     double depth = getEndHeightNoise(en, x, z, 0) - 8.0f;
     for (y = colymin; y <= colymax; y++)
     {
-        if (lower_drop[y] == 0.0) {
+        if (end_lower_drop[y] == 0.0) {
             column[y - colymin] = -30;
             continue;
         }
         double noise = sampleSurfaceNoiseBetween(sn, x, y, z, -128, +128);
         double clamped = noise + depth;
-        clamped = lerp(upper_drop[y], -3000, clamped);
-        clamped = lerp(lower_drop[y], -30, clamped);
+        clamped = lerp(end_upper_drop[y], -3000, clamped);
+        clamped = lerp(end_lower_drop[y], -30, clamped);
+        column[y - colymin] = clamped;
+    }
+}
+
+/* Variant of sampleNoiseColumnEnd() with a precomputed height noise and
+ * shared surface noise levels, lvl[y - colymin].
+ */
+static void sampleNoiseColumnEndLevels(double column[],
+    const SurfaceNoise *sn, const EndNoise *en, const SurfaceNoiseLevel *lvl,
+    float height, int x, int z, int colymin, int colymax)
+{
+    int y;
+    if (en->mc > MC_1_13)
+    {   // add outer end rings
+        uint64_t rsq = (uint64_t) x * x + (uint64_t) z * z;
+        if ((int)rsq < 0)
+        {
+            for (y = colymin; y <= colymax; y++)
+                column[y - colymin] = nan("");
+            return;
+        }
+    }
+
+    SurfaceNoiseColumn col;
+    initSurfaceNoiseColumn(&col, sn, x, z);
+
+    double depth = height - 8.0f;
+    for (y = colymin; y <= colymax; y++)
+    {
+        if (end_lower_drop[y] == 0.0) {
+            column[y - colymin] = -30;
+            continue;
+        }
+        double noise = sampleSurfaceNoiseColumnBetween(sn, &col,
+            &lvl[y - colymin], -128, +128);
+        double clamped = noise + depth;
+        clamped = lerp(end_upper_drop[y], -3000, clamped);
+        clamped = lerp(end_lower_drop[y], -30, clamped);
         column[y - colymin] = clamped;
     }
 }
@@ -696,15 +957,32 @@ int mapEndSurfaceHeight(float *y, const EndNoise *en, const SurfaceNoise *sn,
     int cx = floordiv(x, cellsiz);
     int cz = floordiv(z, cellsiz);
     int cw = floordiv(x + w - 1, cellsiz) - cx + 2;
+    int ch = floordiv(z + h - 1, cellsiz) - cz + 2;
     int i, j;
 
-    double *buf = malloc(sizeof(double) * yn * cw * 2);
+    // the column heights are shared by all columns, so the level terms of the
+    // surface noise are prepared only once, as is the end height noise
+    SurfaceNoiseLevel lvl[18-2+1];
+    for (i = 0; i < yn; i++)
+        initSurfaceNoiseLevelEnd(&lvl[i], sn, y0 + i);
+
+    float *depth = (float*) malloc(sizeof(float) * cw * ch);
+    double *buf = (double*) malloc(sizeof(double) * yn * cw * 2);
+    if (!depth || !buf || mapEndHeightNoise(en, depth, cx, cz, cw, ch))
+    {
+        free(buf);
+        free(depth);
+        return 1;
+    }
     double *ncol[2];
     ncol[0] = buf;
     ncol[1] = buf + yn * cw;
 
     for (i = 0; i < cw; i++)
-        sampleNoiseColumnEnd(ncol[1]+i*yn, sn, en, cx+i, cz+0, y0, y1);
+    {
+        sampleNoiseColumnEndLevels(ncol[1]+i*yn, sn, en, lvl, depth[i],
+            cx+i, cz+0, y0, y1);
+    }
 
     for (j = 0; j < h; j++)
     {
@@ -715,8 +993,12 @@ int mapEndSurfaceHeight(float *y, const EndNoise *en, const SurfaceNoise *sn,
             double *tmp = ncol[0];
             ncol[0] = ncol[1];
             ncol[1] = tmp;
+            const float *drow = depth + (cj+1 - cz) * cw;
             for (i = 0; i < cw; i++)
-                sampleNoiseColumnEnd(ncol[1]+i*yn, sn, en, cx+i, cj+1, y0, y1);
+            {
+                sampleNoiseColumnEndLevels(ncol[1]+i*yn, sn, en, lvl, drow[i],
+                    cx+i, cj+1, y0, y1);
+            }
         }
 
         for (i = 0; i < w; i++)
@@ -733,6 +1015,7 @@ int mapEndSurfaceHeight(float *y, const EndNoise *en, const SurfaceNoise *sn,
     }
 
     free(buf);
+    free(depth);
     return 0;
 }
 
@@ -1190,6 +1473,71 @@ int sampleBiomeNoise(const BiomeNoise *bn, int64_t *np, int x, int y, int z,
     return id;
 }
 
+static int filterParaLimits(const int **lim, int n, int k, int64_t v)
+{
+    int i, m;
+    for (i = m = 0; i < n; i++)
+    {
+        if (v >= lim[i][2*k] && v <= lim[i][2*k+1])
+            lim[m++] = lim[i];
+    }
+    return m;
+}
+
+int sampleBiomeNoiseLimited(const BiomeNoise *bn, int64_t np[6],
+    int x, int y, int z, const int *const *lim, int n)
+{
+    const int *cand[256];
+    float t, h, c, e, d, w;
+    double px = x, pz = z;
+
+    if (n > 256)
+        lim = NULL;
+    if (lim)
+        memcpy(cand, lim, n * sizeof(*cand));
+
+    px += sampleDoublePerlin(&bn->climate[NP_SHIFT], x, 0, z) * 4.0;
+    pz += sampleDoublePerlin(&bn->climate[NP_SHIFT], z, x, 0) * 4.0;
+
+    // sample the parameters in order of how likely they are to rule out all
+    // of the limits, continentalness first to reject the oceans
+    c = sampleDoublePerlin(&bn->climate[NP_CONTINENTALNESS], px, 0, pz);
+    np[2] = (int64_t)(10000.0F*c);
+    if (lim && !(n = filterParaLimits(cand, n, 2, np[2])))
+        return 0;
+
+    e = sampleDoublePerlin(&bn->climate[NP_EROSION], px, 0, pz);
+    np[3] = (int64_t)(10000.0F*e);
+    if (lim && !(n = filterParaLimits(cand, n, 3, np[3])))
+        return 0;
+
+    w = sampleDoublePerlin(&bn->climate[NP_WEIRDNESS], px, 0, pz);
+    np[5] = (int64_t)(10000.0F*w);
+    if (lim && !(n = filterParaLimits(cand, n, 5, np[5])))
+        return 0;
+
+    float np_param[] = {
+        c, e, -3.0F * ( fabsf( fabsf(w) - 0.6666667F ) - 0.33333334F ), w,
+    };
+    double off = getSpline(bn->sp, np_param) + 0.015F;
+    d = 1.0 - (y * 4) / 128.0 - 83.0/160.0 + off;
+    np[4] = (int64_t)(10000.0F*d);
+    if (lim && !(n = filterParaLimits(cand, n, 4, np[4])))
+        return 0;
+
+    t = sampleDoublePerlin(&bn->climate[NP_TEMPERATURE], px, 0, pz);
+    np[0] = (int64_t)(10000.0F*t);
+    if (lim && !(n = filterParaLimits(cand, n, 0, np[0])))
+        return 0;
+
+    h = sampleDoublePerlin(&bn->climate[NP_HUMIDITY], px, 0, pz);
+    np[1] = (int64_t)(10000.0F*h);
+    if (lim && !(n = filterParaLimits(cand, n, 1, np[1])))
+        return 0;
+
+    return 1;
+}
+
 // Note: Climate noise is sampled at a 1:1 scale.
 int sampleBiomeNoiseBeta(const BiomeNoiseBeta *bnb, int64_t *np, double *nv,
     int x, int z)
@@ -1430,8 +1778,7 @@ int get_resulting_node(const uint64_t np[6], const BiomeTree *bt, int idx,
     return leaf;
 }
 
-ATTR(hot, flatten)
-int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat)
+static const BiomeTree *getBiomeTree(int mc)
 {
     static const BiomeTree btree18 = {
         btree18_steps, &btree18_param[0][0], btree18_nodes, btree18_order,
@@ -1454,19 +1801,59 @@ int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat)
         sizeof(btree21wd_nodes) / sizeof(uint64_t)
     };
 
-    const BiomeTree *bt;
-    int idx;
-
     if (mc >= MC_1_21_WD)
-        bt = &btree21wd;
+        return &btree21wd;
     else if (mc >= MC_1_20_6)
-        bt = &btree20;
+        return &btree20;
     else if (mc >= MC_1_19_4)
-        bt = &btree19;
+        return &btree19;
     else if (mc >= MC_1_19_2)
-        bt = &btree192;
+        return &btree192;
     else
-        bt = &btree18;
+        return &btree18;
+}
+
+/// Counts the leaves that are no further than ds from the noise point,
+/// stopping once more than one has been found.
+static
+int count_nodes_within(const uint64_t np[6], const BiomeTree *bt, int idx,
+    uint64_t ds, int depth)
+{
+    if (bt->steps[depth] == 0)
+        return 1;
+    uint32_t step;
+    do
+    {
+        step = bt->steps[depth];
+        depth++;
+    }
+    while (idx+step >= bt->len);
+
+    uint64_t node = bt->nodes[idx];
+    uint16_t inner = node >> 48;
+    uint32_t i, n;
+    int cnt = 0;
+
+    for (i = 0, n = bt->order; i < n; i++)
+    {
+        if (get_np_dist(np, bt, inner) <= ds)
+        {
+            cnt += count_nodes_within(np, bt, inner, ds, depth);
+            if (cnt > 1)
+                break;
+        }
+        inner += step;
+        if (inner >= bt->len)
+            break;
+    }
+    return cnt;
+}
+
+ATTR(hot, flatten)
+int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat)
+{
+    const BiomeTree *bt = getBiomeTree(mc);
+    int idx;
 
     if (dat)
     {
@@ -1483,6 +1870,17 @@ int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat)
     return (bt->nodes[idx] >> 48) & 0xFF;
 }
 
+int climateToBiomeUnique(int mc, const uint64_t np[6], uint64_t *dat)
+{
+    const BiomeTree *bt = getBiomeTree(mc);
+    int idx = get_resulting_node(np, bt, 0, 0, -1, 0);
+    if (count_nodes_within(np, bt, 0, get_np_dist(np, bt, idx), 0) > 1)
+        return -1;
+    if (dat)
+        *dat = (uint64_t) idx;
+    return (bt->nodes[idx] >> 48) & 0xFF;
+}
+
 
 void setClimateParaSeed(BiomeNoise *bn, uint64_t seed, int large, int nptype, int nmax)
 {
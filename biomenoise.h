@@ -74,6 +74,17 @@ STRUCT(SurfaceNoise)
     PerlinNoise oct[16+16+8+4+16];
 };
 
+// Horizontal and vertical noise terms for column-wise surface sampling
+STRUCT(SurfaceNoiseColumn)
+{
+    PerlinXZ min[16], max[16], main[8];
+};
+
+STRUCT(SurfaceNoiseLevel)
+{
+    PerlinY min[16], max[16], main[8];
+};
+
 STRUCT(SurfaceNoiseBeta)
 {
     OctaveNoise octmin;
@@ -169,6 +180,20 @@ double sampleSurfaceNoise(const SurfaceNoise *sn, int x, int y, int z);
 double sampleSurfaceNoiseBetween(const SurfaceNoise *sn, int x, int y, int z,
     double noiseMin, double noiseMax);
 
+/**
+ * Column-wise sampling of the (Overworld) surface noise. Most of the work in
+ * sampleSurfaceNoise() only depends on either the horizontal position or the
+ * height. These terms can be prepared once per column (x,z) and once per level
+ * y, and then shared between all samples along a column and between columns
+ * at the same height. The result of sampleSurfaceNoiseColumn() is identical
+ * to sampleSurfaceNoise(sn, x, y, z).
+ */
+void initSurfaceNoiseColumn(SurfaceNoiseColumn *col, const SurfaceNoise *sn,
+    int x, int z);
+void initSurfaceNoiseLevel(SurfaceNoiseLevel *lvl, const SurfaceNoise *sn, int y);
+double sampleSurfaceNoiseColumn(const SurfaceNoise *sn,
+    const SurfaceNoiseColumn *col, const SurfaceNoiseLevel *lvl);
+
 
 //==============================================================================
 // End (1.9+), Nether (1.16+) and Overworld (1.18+) Biome Noise Generation
@@ -246,6 +271,16 @@ void setBiomeSeed(BiomeNoise *bn, uint64_t seed, int large);
 void setBetaBiomeSeed(BiomeNoiseBeta *bnb, uint64_t seed);
 int sampleBiomeNoise(const BiomeNoise *bn, int64_t *np, int x, int y, int z,
     uint64_t *dat, uint32_t sample_flags);
+
+/**
+ * Samples the noise point of sampleBiomeNoise() at scale 1:4, but gives up
+ * early, returning 0, once the parameters sampled so far lie outside all of
+ * the 'n' parameter limits in 'lim' (min/max pairs in the order of the noise
+ * point, see getBiomeParaLimits()). Returns 1 if the noise point in 'np' was
+ * completed. A NULL 'lim' samples the full noise point.
+ */
+int sampleBiomeNoiseLimited(const BiomeNoise *bn, int64_t np[6],
+    int x, int y, int z, const int *const *lim, int n);
 int sampleBiomeNoiseBeta(const BiomeNoiseBeta *bnb, int64_t *np, double *nv,
     int x, int z);
 double approxSurfaceBeta(const BiomeNoiseBeta *bnb, const SurfaceNoiseBeta *snb,
@@ -263,6 +298,14 @@ int getOldBetaBiome(float t, float h);
  */
 int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat);
 
+/**
+ * Maps a noise point to a biome like climateToBiome(), but only if the result
+ * does not depend on the previously visited node in 'dat' (MC-241546), i.e.
+ * when the nearest node is unique. Returns -1 otherwise. On success the node
+ * is written to 'dat' (nullable), so it can continue an ordered generation.
+ */
+int climateToBiomeUnique(int mc, const uint64_t np[6], uint64_t *dat);
+
 /**
  * Initialize BiomeNoise for only a single climate parameter.
  * If nptype == NP_DEPTH, the value is sampled at y=0. Note that this value
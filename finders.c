@@ -1,5 +1,6 @@
 #include "finders.h"
 #include "biomes.h"
+#include "parallel.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -209,18 +210,9 @@ void getRegPos(Pos *p, uint64_t *s, int rx, int rz, StructureConfig sc)
     p->z = ((uint64_t)rz * sc.regionSize + nextInt(s, sc.chunkRange)) << 4;
 }
 
-int getStructurePos(int structureType, int mc, uint64_t seed, int regX, int regZ, Pos *pos)
+static int getStructurePosConf(int structureType, StructureConfig sconf,
+    int mc, uint64_t seed, int regX, int regZ, Pos *pos)
 {
-    StructureConfig sconf;
-#if STRUCT_CONFIG_OVERRIDE
-    if (!getStructureConfig_override(structureType, mc, &sconf))
-#else
-    if (!getStructureConfig(structureType, mc, &sconf))
-#endif
-    {
-        return 0;
-    }
-
     switch (structureType)
     {
     case Feature:
@@ -328,6 +320,169 @@ int getStructurePos(int structureType, int mc, uint64_t seed, int regX, int regZ
     return 0;
 }
 
+int getStructurePos(int structureType, int mc, uint64_t seed, int regX, int regZ, Pos *pos)
+{
+    StructureConfig sconf;
+#if STRUCT_CONFIG_OVERRIDE
+    if (!getStructureConfig_override(structureType, mc, &sconf))
+#else
+    if (!getStructureConfig(structureType, mc, &sconf))
+#endif
+    {
+        return 0;
+    }
+    return getStructurePosConf(structureType, sconf, mc, seed, regX, regZ, pos);
+}
+
+/// Attempt positions of a row of regions for the uniform distribution, with
+/// the region seed stepped incrementally along the row.
+static void getFeatureRow(Pos *pos, StructureConfig sc, uint64_t seed,
+    int regX, int regZ, int w)
+{
+    const uint64_t K = 0x5deece66dULL;
+    const uint64_t M = (1ULL << 48) - 1;
+    const uint64_t b = 0xb;
+    uint64_t r = sc.chunkRange;
+    uint64_t s = seed + regX*341873128712ULL + regZ*132897987541ULL + sc.salt;
+    int64_t cx = (int64_t)regX * sc.regionSize;
+    int64_t cz = (int64_t)regZ * sc.regionSize;
+    int i;
+
+    if (r & (r-1))
+    {
+        for (i = 0; i < w; i++, s += 341873128712ULL, cx += sc.regionSize)
+        {
+            uint64_t t = ((s ^ K) * K + b) & M;
+            pos[i].x = (int)(((uint64_t)cx + (int)(t >> 17) % (int)r) << 4);
+            t = (t * K + b) & M;
+            pos[i].z = (int)(((uint64_t)cz + (int)(t >> 17) % (int)r) << 4);
+        }
+    }
+    else
+    {
+        for (i = 0; i < w; i++, s += 341873128712ULL, cx += sc.regionSize)
+        {
+            uint64_t t = ((s ^ K) * K + b) & M;
+            pos[i].x = (int)(((uint64_t)cx + (int)((r * (t >> 17)) >> 31)) << 4);
+            t = (t * K + b) & M;
+            pos[i].z = (int)(((uint64_t)cz + (int)((r * (t >> 17)) >> 31)) << 4);
+        }
+    }
+}
+
+/// Attempt positions of a row of regions for the triangular distribution.
+static void getLargeStructureRow(Pos *pos, StructureConfig sc, uint64_t seed,
+    int regX, int regZ, int w)
+{
+    const uint64_t K = 0x5deece66dULL;
+    const uint64_t M = (1ULL << 48) - 1;
+    const uint64_t b = 0xb;
+    int r = sc.chunkRange;
+    uint64_t s = seed + regX*341873128712ULL + regZ*132897987541ULL + sc.salt;
+    int64_t cx = (int64_t)regX * sc.regionSize;
+    int64_t cz = (int64_t)regZ * sc.regionSize;
+    int i;
+
+    for (i = 0; i < w; i++, s += 341873128712ULL, cx += sc.regionSize)
+    {
+        uint64_t t = ((s ^ K) * K + b) & M;
+        int x = (int)(t >> 17) % r;
+        t = (t * K + b) & M;
+        x += (int)(t >> 17) % r;
+        t = (t * K + b) & M;
+        int z = (int)(t >> 17) % r;
+        t = (t * K + b) & M;
+        z += (int)(t >> 17) % r;
+        pos[i].x = (int)(((uint64_t)cx + (x >> 1)) << 4);
+        pos[i].z = (int)(((uint64_t)cz + (z >> 1)) << 4);
+    }
+}
+
+int getStructurePosGrid(int structureType, int mc, uint64_t seed,
+    int regX, int regZ, int regW, int regH, Pos *pos, char *valid)
+{
+    StructureConfig sconf;
+#if STRUCT_CONFIG_OVERRIDE
+    if (!getStructureConfig_override(structureType, mc, &sconf))
+#else
+    if (!getStructureConfig(structureType, mc, &sconf))
+#endif
+    {
+        return -1;
+    }
+
+    int i, j, n = 0;
+    for (j = 0; j < regH; j++)
+    {
+        Pos *row = pos + (size_t)j * regW;
+        char *vrow = valid ? valid + (size_t)j * regW : NULL;
+        int rz = regZ + j;
+
+        switch (structureType)
+        {
+        case Feature:
+        case Desert_Pyramid:
+        case Jungle_Pyramid:
+        case Swamp_Hut:
+        case Igloo:
+        case Village:
+        case Ocean_Ruin:
+        case Shipwreck:
+        case Ruined_Portal:
+        case Ruined_Portal_N:
+        case Ancient_City:
+        case Trail_Ruins:
+        case Trial_Chambers:
+            getFeatureRow(row, sconf, seed, regX, rz, regW);
+            if (vrow)
+                memset(vrow, 1, regW);
+            n += regW;
+            break;
+
+        case Monument:
+        case Mansion:
+            getLargeStructureRow(row, sconf, seed, regX, rz, regW);
+            if (vrow)
+                memset(vrow, 1, regW);
+            n += regW;
+            break;
+
+        case End_City:
+            getLargeStructureRow(row, sconf, seed, regX, rz, regW);
+            for (i = 0; i < regW; i++)
+            {
+                int v = (row[i].x*(int64_t)row[i].x + row[i].z*(int64_t)row[i].z)
+                    >= 1008*1008LL;
+                if (vrow) vrow[i] = v;
+                n += v;
+            }
+            break;
+
+        case Outpost:
+            getFeatureRow(row, sconf, seed, regX, rz, regW);
+            for (i = 0; i < regW; i++)
+            {
+                uint64_t s = seed;
+                setAttemptSeed(&s, row[i].x >> 4, row[i].z >> 4);
+                int v = nextInt(&s, 5) == 0;
+                if (vrow) vrow[i] = v;
+                n += v;
+            }
+            break;
+
+        default:
+            for (i = 0; i < regW; i++)
+            {
+                int v = getStructurePosConf(structureType, sconf, mc, seed,
+                    regX + i, rz, &row[i]);
+                if (vrow) vrow[i] = v;
+                n += !!v;
+            }
+        }
+    }
+    return n;
+}
+
 
 int getMineshafts(int mc, uint64_t seed, int cx0, int cz0, int cx1, int cz1,
         Pos *out, int nout)
@@ -639,6 +794,24 @@ static int id_matches(int id, uint64_t b, uint64_t m)
     return id < 128 ? !!(b & (1ULL << id)) : !!(m & (1ULL << (id-128)));
 }
 
+/// Collects the climate parameter limits of the 1.18+ biomes marked in
+/// 'valid'. Returns the number of limits, or -1 if they are not available.
+static int getValidParaLimits(const int **lim, const Generator *g,
+    const char valid[256])
+{
+    int id, n = 0;
+    if (g->mc < MC_1_18 || g->bn.nptype >= 0)
+        return -1;
+    for (id = 0; id < 256; id++)
+    {
+        if (!valid[id] || !isOverworld(g->mc, id))
+            continue;
+        if (!(lim[n++] = getBiomeParaLimits(g->mc, id)))
+            return -1;
+    }
+    return n;
+}
+
 Pos locateBiome(
     const Generator *g, int x, int y, int z, int radius,
     uint64_t validB, uint64_t validM, uint64_t *rng, int *passes)
@@ -652,25 +825,66 @@ Pos locateBiome(
         x >>= 2;
         z >>= 2;
         radius >>= 2;
-        uint64_t dat = 0;
-
-        for (j = -radius; j <= radius; j++)
+        uint64_t dat = 0, skipdat = 0;
+        int w = 2*radius + 1;
+        int k, skip = -1;
+
+        // The climate parameters of the valid biomes let us abandon the
+        // sampling of a cell once its biome cannot match anymore.
+        const int *lim[256];
+        char valid[256];
+        for (k = 0; k < 256; k++)
+            valid[k] = !(k & 64) && id_matches(k, validB, validM);
+        int nlim = getValidParaLimits(lim, g, valid);
+
+        for (k = 0; k < w*w; k++)
         {
-            for (i = -radius; i <= radius; i++)
+            i = k % w - radius;
+            j = k / w - radius;
+            // emulate order-dependent biome generation MC-241546
+            //int id = getBiomeAt(g, 4, x+i, y, z+j);
+            int64_t np[6];
+            int id;
+            if (nlim < 0)
             {
-                // emulate order-dependent biome generation MC-241546
-                //int id = getBiomeAt(g, 4, x+i, y, z+j);
-                int id = sampleBiomeNoise(&g->bn, NULL, x+i, y, z+j, &dat, 0);
-                if (!id_matches(id, validB, validM))
-                    continue;
-
-                if (found == 0 || nextInt(rng, found+1) == 0)
+                id = sampleBiomeNoise(&g->bn, NULL, x+i, y, z+j, &dat, 0);
+            }
+            else if (!sampleBiomeNoiseLimited(&g->bn, np, x+i, y, z+j, lim, nlim))
+            {
+                // no valid biome here, but the node of the last sample is now
+                // unknown until we find a cell whose mapping is independent
+                if (skip < 0)
+                {
+                    skip = k;
+                    skipdat = dat;
+                }
+                continue;
+            }
+            else if (skip < 0)
+            {
+                id = climateToBiome(g->mc, (const uint64_t*) np, &dat);
+            }
+            else if ((id = climateToBiomeUnique(g->mc, (const uint64_t*) np, &dat)) < 0)
+            {
+                // ambiguous mapping: replay the skipped cells to recover it
+                for (dat = skipdat; skip < k; skip++)
                 {
-                    out.x = (x+i) * 4;
-                    out.z = (z+j) * 4;
+                    sampleBiomeNoise(&g->bn, NULL, x + skip%w - radius, y,
+                        z + skip/w - radius, &dat, 0);
                 }
-                found++;
+                id = climateToBiome(g->mc, (const uint64_t*) np, &dat);
+            }
+            skip = -1;
+
+            if (!id_matches(id, validB, validM))
+                continue;
+
+            if (found == 0 || nextInt(rng, found+1) == 0)
+            {
+                out.x = (x+i) * 4;
+                out.z = (z+j) * 4;
             }
+            found++;
         }
     }
     else
@@ -935,6 +1149,93 @@ int nextStronghold(StrongholdIter *sh, const Generator *g)
     return (sh->mc >= MC_1_9 ? 128 : 3) - (sh->index-1);
 }
 
+STRUCT(StrongholdJobs)
+{
+    const Generator *g;
+    Pos *pos;
+    uint64_t *seeds;
+    uint64_t validB, validM;
+    volatile int next;
+    int n;
+};
+
+static void strongholdWorker(void *data, int t)
+{
+    StrongholdJobs *jobs = (StrongholdJobs*) data;
+    int i;
+    (void) t;
+
+    while ((i = parallelNext(&jobs->next)) < jobs->n)
+    {
+        Pos *p = &jobs->pos[i];
+        uint64_t lbr = jobs->seeds[i];
+        *p = locateBiome(jobs->g, p->x, 0, p->z, 112,
+            jobs->validB, jobs->validM, &lbr, NULL);
+        p->x = (p->x & ~15) + 4;
+        p->z = (p->z & ~15) + 4;
+    }
+}
+
+int getStrongholds(Pos *out, int n, const Generator *g, int threads)
+{
+    StrongholdIter sh;
+    int i, cnt;
+
+    initFirstStronghold(&sh, g->mc, g->seed);
+    cnt = g->mc >= MC_1_9 ? 128 : g->mc >= MC_B1_8 ? 3 : 0;
+    if (n > cnt)
+        n = cnt;
+    if (n <= 0)
+        return 0;
+
+    if (g->mc <= MC_1_19_2)
+    {
+        // the biome checks share one random state, so they have to run
+        // sequentially and each one determines where the next search begins
+        for (i = 0; i < n; i++)
+        {
+            nextStronghold(&sh, g);
+            out[i] = sh.pos;
+        }
+        return n;
+    }
+
+    // From 1.19.3 the approximate positions are independent of the biomes and
+    // every biome search gets its own random state, so we can collect the
+    // search parameters first and then distribute the searches over threads.
+    StrongholdJobs jobs;
+    jobs.g = g;
+    jobs.pos = out;
+    jobs.seeds = (uint64_t*) malloc(n * sizeof(*jobs.seeds));
+    jobs.validB = jobs.validM = 0;
+    jobs.next = 0;
+    jobs.n = n;
+    if (!jobs.seeds)
+        return -1;
+
+    for (i = 0; i < 64; i++)
+    {
+        if (isStrongholdBiome(g->mc, i))
+            jobs.validB |= (1ULL << i);
+        if (isStrongholdBiome(g->mc, i+128))
+            jobs.validM |= (1ULL << i);
+    }
+    for (i = 0; i < n; i++)
+    {
+        uint64_t rnds = sh.rnds;
+        setSeed(&jobs.seeds[i], nextLong(&rnds));
+        out[i] = sh.nextapprox;
+        nextStronghold(&sh, NULL);
+    }
+
+    if (threads > n)
+        threads = n;
+    runParallel(threads, strongholdWorker, &jobs);
+
+    free(jobs.seeds);
+    return n;
+}
+
 
 static
 uint64_t calcFitness(const Generator *g, int x, int z)
@@ -1810,6 +2111,124 @@ L_not_viable:
 }
 
 
+/// Gets the 1:4 scale biome sample point that isViableStructurePos() uses for
+/// a structure in the 1.18+ Overworld. Returns 1 if the biome at this point
+/// decides the viability, 2 if it is only a necessary condition (the full
+/// check still has to be done) and 0 if the structure has no such point.
+static int getViableSample(int structureType, const Generator *g, int x, int z,
+    Pos3 *sp)
+{
+    int64_t chunkX = x >> 4;
+    int64_t chunkZ = z >> 4;
+    StructureVariant sv;
+
+    switch (structureType)
+    {
+    case Trail_Ruins:
+        if (g->mc <= MC_1_19) return 0;
+        // fallthrough
+    case Desert_Pyramid:
+    case Jungle_Pyramid:
+    case Swamp_Hut:
+    case Igloo:
+    case Ocean_Ruin:
+    case Shipwreck:
+    case Treasure:
+        sp->x = chunkX * 4 + 2;
+        sp->z = chunkZ * 4 + 2;
+        sp->y = 319 >> 2;
+        return 1;
+    case Desert_Well:
+        sp->x = x >> 2;
+        sp->z = z >> 2;
+        sp->y = 319 >> 2;
+        return 1;
+    case Mansion:
+        sp->x = (chunkX * 16 + 7) >> 2;
+        sp->z = (chunkZ * 16 + 7) >> 2;
+        sp->y = 319 >> 2;
+        return 1;
+    case Monument:
+        sp->x = (chunkX * 16 + 8) >> 2;
+        sp->z = (chunkZ * 16 + 8) >> 2;
+        sp->y = 36 >> 2;
+        return 2;
+    case Ancient_City:
+        if (g->mc <= MC_1_18) return 0;
+        goto L_jigsaw;
+    case Trial_Chambers:
+        if (g->mc <= MC_1_20) return 0;
+    L_jigsaw:
+        getVariant(&sv, structureType, g->mc, g->seed, x, z, -1);
+        sp->x = (chunkX*32 + 2*sv.x + sv.sx - 1) / 2 >> 2;
+        sp->z = (chunkZ*32 + 2*sv.z + sv.sz - 1) / 2 >> 2;
+        sp->y = sv.y >> 2;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int areViableStructurePos(int structureType, Generator *g, const Pos *pos,
+    int n, uint32_t flags, char *viable)
+{
+    const int *lim[256];
+    char valid[256];
+    int i, id, nlim = -2, cnt = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        Pos3 sp;
+        int64_t np[6];
+        int mode = 0;
+
+        if (g->mc >= MC_1_18 && g->dim == DIM_OVERWORLD)
+            mode = getViableSample(structureType, g, pos[i].x, pos[i].z, &sp);
+        if (mode == 0)
+        {
+            viable[i] = !!isViableStructurePos(structureType, g,
+                pos[i].x, pos[i].z, flags);
+            cnt += viable[i];
+            continue;
+        }
+
+        if (nlim == -2)
+        {   // climate limits of the biomes that can pass the sample check
+            for (id = 0; id < 256; id++)
+            {
+                if (structureType == Monument)
+                    valid[id] = isDeepOcean(id);
+                else
+                    valid[id] = isViableFeatureBiome(g->mc, structureType, id);
+            }
+            nlim = getValidParaLimits(lim, g, valid);
+        }
+
+        if (nlim >= 0)
+        {
+            if (!sampleBiomeNoiseLimited(&g->bn, np, sp.x, sp.y, sp.z, lim, nlim))
+                id = -1;
+            else
+                id = climateToBiome(g->mc, (const uint64_t*)np, NULL);
+        }
+        else
+        {
+            id = getBiomeAt(g, 4, sp.x, sp.y, sp.z);
+        }
+
+        if (id < 0 || !valid[id])
+            viable[i] = 0;
+        else if (mode == 1)
+            viable[i] = 1;
+        else
+            viable[i] = !!isViableStructurePos(structureType, g,
+                pos[i].x, pos[i].z, flags);
+        cnt += viable[i];
+    }
+    return cnt;
+}
+
+
 int isViableStructureTerrain(int structType, Generator *g, int x, int z)
 {
     int sx, sz;
@@ -1962,47 +2381,830 @@ int isViableEndCityTerrain(const Generator *g, const SurfaceNoise *sn,
 
 
 //==============================================================================
-// Finding Properties of Structures
+// Slime Chunk Clusters
 //==============================================================================
 
+int getSlimeChunks(uint64_t seed, int chunkX, int chunkZ, int chunkW,
+        int chunkH, char *out)
+{
+    RandomLanes rl;
+    uint64_t v[RNG_LANES];
+    int r[RNG_LANES];
+    int i, j, l, cnt = 0;
 
-STRUCT(PieceEnv)
+    for (j = 0; j < chunkH; j++)
+    {
+        uint32_t z = (uint32_t) (chunkZ + j);
+        uint64_t sz = seed;
+        sz += (int32_t)(z * 0x5f24fU);
+        sz += (int32_t)(z * z) * 0x4307a7ULL;
+        char *row = out + (int64_t)j * chunkW;
+
+        for (i = 0; i < chunkW; i += RNG_LANES)
+        {
+            for (l = 0; l < RNG_LANES; l++)
+            {
+                uint32_t x = (uint32_t) (chunkX + i + l);
+                uint64_t s = sz;
+                s += (int32_t)(x * 0x5ac0dbU);
+                s += (int32_t)(x * x * 0x4c1906U);
+                v[l] = s ^ 0x3ad8025fULL;
+            }
+            setSeedLanes(&rl, v);
+            nextIntLanes(&rl, 10, r);
+            for (l = 0; l < RNG_LANES && i + l < chunkW; l++)
+            {
+                row[i+l] = (r[l] == 0);
+                cnt += row[i+l];
+            }
+        }
+    }
+    return cnt;
+}
+
+/// Orders slime spots by count, then by seed index and position.
+static int slimeSpotBetter(const SlimeSpot *a, const SlimeSpot *b)
 {
-    Piece *list;
-    int *n;
-    uint64_t *rng;
-    int *ship;
-    int y;
-    int typlast;
-    int nmax;
-    int ntyp[PIECE_COUNT];
-};
+    if (a->count != b->count) return a->count > b->count;
+    if (a->sidx != b->sidx) return a->sidx < b->sidx;
+    if (a->z != b->z) return a->z < b->z;
+    return a->x < b->x;
+}
 
-typedef int (piecefunc_t)(PieceEnv *env, Piece *current, int depth);
+/// Adds a spot to a min-heap that keeps the best 'k' spots.
+static void pushSlimeSpot(SlimeSpot *heap, int *n, int k, SlimeSpot s)
+{
+    int i, c;
+    if (*n == k)
+    {
+        if (!slimeSpotBetter(&s, &heap[0]))
+            return;
+        // replace the root and sift down
+        i = 0;
+        for (;;)
+        {
+            c = 2*i + 1;
+            if (c >= k)
+                break;
+            if (c+1 < k && slimeSpotBetter(&heap[c], &heap[c+1]))
+                c++;
+            if (!slimeSpotBetter(&s, &heap[c]))
+                break;
+            heap[i] = heap[c];
+            i = c;
+        }
+        heap[i] = s;
+        return;
+    }
+    // append and sift up
+    for (i = (*n)++; i > 0; i = c)
+    {
+        c = (i - 1) / 2;
+        if (!slimeSpotBetter(&heap[c], &s))
+            break;
+        heap[i] = heap[c];
+    }
+    heap[i] = s;
+}
 
-static piecefunc_t genTower;
-static piecefunc_t genBridge;
-static piecefunc_t genHouseTower;
-static piecefunc_t genFatTower;
+static int cmpSlimeSpot(const void *a, const void *b)
+{
+    const SlimeSpot *sa = (const SlimeSpot*) a, *sb = (const SlimeSpot*) b;
+    return slimeSpotBetter(sa, sb) ? -1 : slimeSpotBetter(sb, sa) ? 1 : 0;
+}
 
+STRUCT(SlimeJobs)
+{
+    const uint64_t *seeds;
+    int x, z, w, h;
+    int sx, sz, radius;
+    int rows; // candidate rows per job
+    int nstrips, njobs;
+    int k;
+    SlimeSpot *spots; // k spots for each thread
+    int *nspots;
+    volatile int next;
+    volatile int err;
+};
 
-int getVariant(StructureVariant *r, int structType, int mc, uint64_t seed,
-        int x, int z, int biomeID)
+static void slimeWorker(void *data, int t)
 {
-    int t;
-    char sx, sy, sz;
-    uint64_t rng = chunkGenerateRnd(seed, x >> 4, z >> 4);
+    SlimeJobs *jobs = (SlimeJobs*) data;
+    int r = jobs->radius;
+    int mx0, mx1, mz0, mz1; // margins of the bitmap around the candidates
+    int i, j, d, job;
+    SlimeSpot *heap = jobs->spots + (size_t)t * jobs->k;
+    int *n = &jobs->nspots[t];
 
-    memset(r, 0, sizeof(*r));
-    r->start = -1;
-    r->biome = -1;
-    r->y = 320;
+    if (r > 0)
+    {
+        mx0 = mz0 = mx1 = mz1 = r;
+    }
+    else
+    {
+        mx0 = mz0 = 0;
+        mx1 = jobs->sx - 1;
+        mz1 = jobs->sz - 1;
+    }
+    int bw = jobs->w + mx0 + mx1;
+    int bh = jobs->rows + mz0 + mz1;
+    char *bits = (char*) malloc((size_t)bw * bh);
+    int *psum = (int*) malloc((size_t)(bw+1) * (bh+1) * sizeof(int));
+    int *hw = (int*) malloc((2*r+1) * sizeof(int));
+    if (!bits || !psum || !hw)
+    {
+        jobs->err = 1;
+        goto L_end;
+    }
+    for (d = -r; d <= r; d++)
+        hw[d+r] = (int) floor(sqrt((double)r*r - (double)d*d));
 
-    switch (structType)
+    while ((job = parallelNext(&jobs->next)) < jobs->njobs && job >= 0)
     {
-    case Village:
-        if (mc <= MC_1_9)
-            return 0;
+        int sidx = job / jobs->nstrips;
+        int j0 = (job % jobs->nstrips) * jobs->rows;
+        int nrows = jobs->h - j0 < jobs->rows ? jobs->h - j0 : jobs->rows;
+        int ph = nrows + mz0 + mz1;
+
+        getSlimeChunks(jobs->seeds[sidx], jobs->x - mx0, jobs->z + j0 - mz0,
+            bw, ph, bits);
+
+        // summed area table: psum[j][i] counts the chunks in bits[<j][<i]
+        memset(psum, 0, (bw+1) * sizeof(int));
+        for (j = 0; j < ph; j++)
+        {
+            int *p = psum + (size_t)(j+1) * (bw+1);
+            int *q = p - (bw+1);
+            int row = 0;
+            p[0] = 0;
+            for (i = 0; i < bw; i++)
+            {
+                row += bits[(size_t)j * bw + i];
+                p[i+1] = q[i+1] + row;
+            }
+        }
+
+        for (j = 0; j < nrows; j++)
+        {
+            for (i = 0; i < jobs->w; i++)
+            {
+                SlimeSpot s;
+                int cnt = 0;
+                if (r > 0)
+                {   // chunks within the disk around (i,j)
+                    int ci = i + mx0, cj = j + mz0;
+                    for (d = -r; d <= r; d++)
+                    {
+                        const int *p0 = psum + (size_t)(cj+d) * (bw+1);
+                        const int *p1 = p0 + (bw+1);
+                        int a = ci - hw[d+r], b = ci + hw[d+r] + 1;
+                        cnt += (p1[b] - p0[b]) - (p1[a] - p0[a]);
+                    }
+                }
+                else
+                {
+                    const int *p0 = psum + (size_t)j * (bw+1);
+                    const int *p1 = psum + (size_t)(j + jobs->sz) * (bw+1);
+                    int b = i + jobs->sx;
+                    cnt = p1[b] - p0[b] - p1[i] + p0[i];
+                }
+                s.sidx = sidx;
+                s.x = jobs->x + i;
+                s.z = jobs->z + j0 + j;
+                s.count = cnt;
+                pushSlimeSpot(heap, n, jobs->k, s);
+            }
+        }
+    }
+
+L_end:
+    free(hw);
+    free(psum);
+    free(bits);
+}
+
+int findSlimeClusters(const uint64_t *seeds, int nseeds,
+        int chunkX, int chunkZ, int chunkW, int chunkH,
+        int sx, int sz, int radius, SlimeSpot *out, int k, int threads)
+{
+    SlimeJobs jobs;
+    int i, j, n;
+
+    if (k <= 0 || nseeds <= 0 || chunkW <= 0 || chunkH <= 0)
+        return 0;
+    if (radius <= 0 && (sx <= 0 || sz <= 0))
+        return 0;
+    if (threads < 1)
+        threads = 1;
+
+    int64_t bw = chunkW + (radius > 0 ? 2*(int64_t)radius : sx-1);
+    jobs.seeds = seeds;
+    jobs.x = chunkX;
+    jobs.z = chunkZ;
+    jobs.w = chunkW;
+    jobs.h = chunkH;
+    jobs.sx = sx;
+    jobs.sz = sz;
+    jobs.radius = radius;
+    // strips of rows that keep the bitmap of a job at a moderate size, but
+    // with enough jobs to balance the threads
+    int64_t rows = (1 << 20) / bw;
+    int64_t rmax = ((int64_t)chunkH * nseeds + 4*threads - 1) / (4*threads);
+    if (rows > rmax)
+        rows = rmax;
+    if (rows > chunkH)
+        rows = chunkH;
+    if (rows < 1)
+        rows = 1;
+    // the job count, and the job counter that runs past it, have to stay
+    // within int for long seed lists
+    int64_t nstrips = (chunkH + rows - 1) / rows;
+    int64_t smax = (INT_MAX / 2) / nseeds;
+    if (smax < 1)
+        smax = 1;
+    if (nstrips > smax)
+    {
+        rows = (chunkH + smax - 1) / smax;
+        nstrips = (chunkH + rows - 1) / rows;
+    }
+    jobs.rows = (int) rows;
+    jobs.nstrips = (int) nstrips;
+    jobs.njobs = (int) (nstrips * nseeds);
+    if (threads > jobs.njobs)
+        threads = jobs.njobs;
+
+    // each thread keeps a heap of its best spots
+    jobs.k = k;
+    jobs.spots = (SlimeSpot*) malloc((size_t)threads * k * sizeof(SlimeSpot));
+    jobs.nspots = (int*) calloc(threads, sizeof(int));
+    jobs.next = 0;
+    jobs.err = 0;
+    if (!jobs.spots || !jobs.nspots)
+    {
+        free(jobs.spots);
+        free(jobs.nspots);
+        return -1;
+    }
+
+    runParallel(threads, slimeWorker, &jobs);
+
+    // merge the best spots of all threads
+    n = 0;
+    for (i = 0; i < threads; i++)
+    {
+        for (j = 0; j < jobs.nspots[i]; j++)
+            jobs.spots[n++] = jobs.spots[(size_t)i * k + j];
+    }
+    qsort(jobs.spots, n, sizeof(SlimeSpot), cmpSlimeSpot);
+    if (n > k)
+        n = k;
+    memcpy(out, jobs.spots, n * sizeof(SlimeSpot));
+
+    free(jobs.spots);
+    free(jobs.nspots);
+    return jobs.err ? -1 : n;
+}
+
+
+//==============================================================================
+// Structure Index
+//==============================================================================
+
+
+static uint64_t hashStructureKey(int type, int regX, int regZ)
+{
+    uint64_t h = (uint32_t)regX | ((uint64_t)(uint32_t)regZ << 32);
+    h ^= (uint64_t)(type + 1) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+int initStructureIndex(StructureIndex *si, int mc, uint64_t seed,
+    size_t maxEntries)
+{
+    size_t i, cap = 16;
+    if (maxEntries == 0)
+        maxEntries = 1 << 16;
+    while (cap < 2 * maxEntries)
+        cap <<= 1;
+
+    memset(si, 0, sizeof(*si));
+    si->entries = (StructureIndexEntry*) malloc(cap * sizeof(*si->entries));
+    if (!si->entries)
+        return 1;
+    for (i = 0; i < cap; i++)
+        si->entries[i].type = -1;
+    si->mc = mc;
+    si->seed = seed;
+    si->cap = cap;
+    si->maxEntries = maxEntries;
+    return 0;
+}
+
+void freeStructureIndex(StructureIndex *si)
+{
+    free(si->entries);
+    memset(si, 0, sizeof(*si));
+}
+
+void clearStructureIndex(StructureIndex *si)
+{
+    size_t i;
+    for (i = 0; i < si->cap; i++)
+        si->entries[i].type = -1;
+    si->count = 0;
+}
+
+/// Finds the entry for a key, or the empty slot where it belongs.
+static StructureIndexEntry *findStructureSlot(StructureIndex *si,
+    int type, int regX, int regZ)
+{
+    size_t mask = si->cap - 1;
+    size_t i = hashStructureKey(type, regX, regZ) & mask;
+    for (;;)
+    {
+        StructureIndexEntry *e = &si->entries[i];
+        if (e->type < 0)
+            return e;
+        if (e->type == type && e->regX == regX && e->regZ == regZ)
+            return e;
+        i = (i + 1) & mask;
+    }
+}
+
+/// Claims a slot for a new key. When the memory bound is reached, the cached
+/// entries are dropped first.
+static StructureIndexEntry *addStructureSlot(StructureIndex *si,
+    int type, int regX, int regZ)
+{
+    StructureIndexEntry *e = findStructureSlot(si, type, regX, regZ);
+    if (e->type >= 0)
+        return e;
+    if (si->count >= si->maxEntries)
+    {
+        clearStructureIndex(si);
+        e = findStructureSlot(si, type, regX, regZ);
+    }
+    e->type = type;
+    e->regX = regX;
+    e->regZ = regZ;
+    e->valid = 0;
+    e->viable = -1;
+    si->count++;
+    return e;
+}
+
+/// Gets the (cached) attempt of a region and checks its viability if needed.
+/// Returns the position of a structure that passes all the available checks.
+static int getIndexedStructure(StructureIndex *si, Generator *g, int type,
+    StructureConfig sconf, int regX, int regZ, Pos *pos)
+{
+    StructureIndexEntry *e = findStructureSlot(si, type, regX, regZ);
+    if (e->type < 0)
+    {
+        Pos p;
+        int valid = getStructurePosConf(type, sconf, si->mc, si->seed,
+            regX, regZ, &p);
+        e = addStructureSlot(si, type, regX, regZ);
+        e->pos = p;
+        e->valid = !!valid;
+    }
+    if (!e->valid)
+        return 0;
+    if (g)
+    {
+        if (e->viable < 0)
+            e->viable = !!isViableStructurePos(type, g, e->pos.x, e->pos.z, 0);
+        if (!e->viable)
+            return 0;
+    }
+    *pos = e->pos;
+    return 1;
+}
+
+/// Drops the cached viability results if they were obtained with different
+/// generator flags.
+static void syncIndexFlags(StructureIndex *si, const Generator *g)
+{
+    size_t i;
+    if (!g || g->flags == si->flags)
+        return;
+    for (i = 0; i < si->cap; i++)
+        si->entries[i].viable = -1;
+    si->flags = g->flags;
+}
+
+/// Validates the generator for the index and gets the structure config.
+static int getIndexConfig(const StructureIndex *si, const Generator *g,
+    int type, StructureConfig *sconf)
+{
+    if (!getStructureConfig(type, si->mc, sconf))
+        return 0;
+    if (g && (g->mc != si->mc || g->seed != si->seed || g->dim != sconf->dim))
+        return 0;
+    return 1;
+}
+
+int getStructuresInArea(StructureIndex *si, Generator *g,
+    const int *types, int ntypes, int x0, int z0, int x1, int z1,
+    StructureLoc *out, int nmax)
+{
+    int t, n = 0;
+    syncIndexFlags(si, g);
+    for (t = 0; t < ntypes && n < nmax; t++)
+    {
+        StructureConfig sconf;
+        if (!getIndexConfig(si, g, types[t], &sconf))
+            continue;
+        int rsiz = sconf.regionSize * 16;
+        int rx0 = floordiv(x0, rsiz), rx1 = floordiv(x1, rsiz);
+        int rz0 = floordiv(z0, rsiz), rz1 = floordiv(z1, rsiz);
+        int rx, rz;
+        for (rz = rz0; rz <= rz1; rz++)
+        {
+            for (rx = rx0; rx <= rx1; rx++)
+            {
+                Pos p;
+                if (!getIndexedStructure(si, g, types[t], sconf, rx, rz, &p))
+                    continue;
+                if (p.x < x0 || p.x > x1 || p.z < z0 || p.z > z1)
+                    continue;
+                out[n].type = types[t];
+                out[n].pos = p;
+                if (++n >= nmax)
+                    return n;
+            }
+        }
+    }
+    return n;
+}
+
+STRUCT(NearestRings)
+{
+    StructureConfig sconf;
+    int type;
+    int rsiz, cx, cz;
+    int r;          // next ring to visit, or -1 once done
+};
+
+int getNearestStructures(StructureIndex *si, Generator *g,
+    const int *types, int ntypes, int x, int z, int maxdist,
+    StructureLoc *out, int k, int *truncated)
+{
+    int t, i, m = 0, n = 0;
+    int64_t *dist = NULL;
+    NearestRings *nr = NULL;
+    size_t budget = si->maxEntries / 2;
+
+    if (truncated)
+        *truncated = 0;
+    if (k <= 0 || ntypes <= 0)
+        return 0;
+    dist = (int64_t*) malloc(k * sizeof(*dist));
+    nr = (NearestRings*) malloc(ntypes * sizeof(*nr));
+    if (!dist || !nr)
+        goto L_end;
+    syncIndexFlags(si, g);
+
+    for (t = 0; t < ntypes; t++)
+    {
+        NearestRings *q = &nr[m];
+        if (!getIndexConfig(si, g, types[t], &q->sconf))
+            continue;
+        q->type = types[t];
+        q->rsiz = q->sconf.regionSize * 16;
+        q->cx = floordiv(x, q->rsiz);
+        q->cz = floordiv(z, q->rsiz);
+        q->r = 0;
+        m++;
+    }
+
+    // Visit the regions in square rings around the origin, always continuing
+    // with the type whose next ring is the closest, such that all the types
+    // share the budget. The attempts of ring r are at least (r-1) regions
+    // away.
+    for (;;)
+    {
+        NearestRings *q = NULL;
+        int64_t lb, qlb = 0;
+        for (t = 0; t < m; t++)
+        {
+            if (nr[t].r < 0)
+                continue;
+            lb = (int64_t)(nr[t].r - 1) * nr[t].rsiz;
+            if (lb > maxdist || (n == k && lb > 0 && lb*lb > dist[n-1]))
+            {
+                nr[t].r = -1;
+                continue;
+            }
+            if (!q || lb < qlb)
+            {
+                q = &nr[t];
+                qlb = lb;
+            }
+        }
+        if (!q)
+            break;
+        int r = q->r++;
+        size_t ring = r ? 8 * (size_t)r : 1;
+        if (ring > budget)
+        {
+            if (truncated)
+                *truncated = 1;
+            break;
+        }
+        budget -= ring;
+
+        int rx, rz;
+        for (rz = q->cz - r; rz <= q->cz + r; rz++)
+        {
+            int step = (rz == q->cz - r || rz == q->cz + r) ? 1 : 2*r;
+            for (rx = q->cx - r; rx <= q->cx + r; rx += step)
+            {
+                Pos p;
+                if (!getIndexedStructure(si, g, q->type, q->sconf, rx, rz, &p))
+                    continue;
+                int64_t dx = p.x - (int64_t)x, dz = p.z - (int64_t)z;
+                int64_t d = dx*dx + dz*dz;
+                if (d > (int64_t)maxdist * maxdist)
+                    continue;
+                if (n == k && d >= dist[n-1])
+                    continue;
+                // insert sorted by distance
+                i = n < k ? n++ : n-1;
+                for (; i > 0 && dist[i-1] > d; i--)
+                {
+                    dist[i] = dist[i-1];
+                    out[i] = out[i-1];
+                }
+                dist[i] = d;
+                out[i].type = q->type;
+                out[i].pos = p;
+            }
+        }
+    }
+
+L_end:
+    free(nr);
+    free(dist);
+    return n;
+}
+
+// File layout: "CBSI", format version, mc, seed, generator flags, entry count,
+// followed by the entries, all in host byte order.
+static const char g_sidx_magic[4] = { 'C', 'B', 'S', 'I' };
+enum { SIDX_FORMAT = 2 };
+
+int saveStructureIndex(const StructureIndex *si, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        return 1;
+    int32_t ver = SIDX_FORMAT, mc = si->mc;
+    uint32_t flags = si->flags;
+    uint64_t seed = si->seed, cnt = si->count;
+    size_t i;
+    int err = 0;
+    err |= fwrite(g_sidx_magic, 4, 1, fp) != 1;
+    err |= fwrite(&ver, sizeof(ver), 1, fp) != 1;
+    err |= fwrite(&mc, sizeof(mc), 1, fp) != 1;
+    err |= fwrite(&seed, sizeof(seed), 1, fp) != 1;
+    err |= fwrite(&flags, sizeof(flags), 1, fp) != 1;
+    err |= fwrite(&cnt, sizeof(cnt), 1, fp) != 1;
+    for (i = 0; i < si->cap && !err; i++)
+    {
+        const StructureIndexEntry *e = &si->entries[i];
+        if (e->type < 0)
+            continue;
+        int32_t v[5] = { e->type, e->regX, e->regZ, e->pos.x, e->pos.z };
+        int8_t f[2] = { e->valid, e->viable };
+        err |= fwrite(v, sizeof(v), 1, fp) != 1;
+        err |= fwrite(f, sizeof(f), 1, fp) != 1;
+    }
+    err |= fclose(fp) != 0;
+    return err;
+}
+
+int loadStructureIndex(StructureIndex *si, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 1;
+    char magic[4];
+    int32_t ver, mc;
+    uint32_t flags;
+    uint64_t seed, cnt, i;
+    int err = 0;
+    if (fread(magic, 4, 1, fp) != 1 || memcmp(magic, g_sidx_magic, 4) ||
+        fread(&ver, sizeof(ver), 1, fp) != 1 || ver != SIDX_FORMAT ||
+        fread(&mc, sizeof(mc), 1, fp) != 1 || mc != si->mc ||
+        fread(&seed, sizeof(seed), 1, fp) != 1 || seed != si->seed ||
+        fread(&flags, sizeof(flags), 1, fp) != 1 ||
+        fread(&cnt, sizeof(cnt), 1, fp) != 1)
+    {
+        err = 1;
+    }
+    else if (si->count == 0)
+    {
+        si->flags = flags;
+    }
+    for (i = 0; i < cnt && !err; i++)
+    {
+        int32_t v[5];
+        int8_t f[2];
+        if (fread(v, sizeof(v), 1, fp) != 1 || fread(f, sizeof(f), 1, fp) != 1)
+        {
+            err = 1;
+            break;
+        }
+        if (v[0] < 0 || v[0] >= FEATURE_NUM)
+        {
+            err = 1;
+            break;
+        }
+        if (si->count >= si->maxEntries)
+            break; // keep what fits in the memory bound
+        StructureIndexEntry *e = addStructureSlot(si, v[0], v[1], v[2]);
+        e->pos.x = v[3];
+        e->pos.z = v[4];
+        e->valid = f[0];
+        // viability results are only kept if they match the current flags
+        e->viable = flags == si->flags ? f[1] : -1;
+    }
+    fclose(fp);
+    return err;
+}
+
+
+//==============================================================================
+// Finding Properties of Structures
+//==============================================================================
+
+
+enum { PIECE_GRID_BITS = 8, PIECE_GRID_SHIFT = 5 };
+
+STRUCT(PieceGridEntry)
+{
+    Piece *p;
+    int next;
+    int bucket;
+};
+
+/* A hashed grid of 32x32 block columns with the pieces that overlap them, so
+ * that collision checks only have to look at nearby pieces. The entries are
+ * added in the order of the piece buffer, which allows discarded pieces to be
+ * removed from the end. If the entry buffer runs out, the checks fall back to
+ * scanning all the pieces.
+ */
+STRUCT(PieceGrid)
+{
+    int head[1 << PIECE_GRID_BITS];
+    PieceGridEntry *ent;
+    int n, cap;
+    int full;
+};
+
+STRUCT(PieceEnv)
+{
+    Piece *list;
+    PieceGrid *grid;
+    int *n;
+    uint64_t *rng;
+    int *ship;
+    int y;
+    int typlast;
+    int nmax;
+    int ntyp[PIECE_COUNT];
+};
+
+typedef int (piecefunc_t)(PieceEnv *env, Piece *current, int depth);
+
+static piecefunc_t genTower;
+static piecefunc_t genBridge;
+static piecefunc_t genHouseTower;
+static piecefunc_t genFatTower;
+
+
+static void initPieceGrid(PieceGrid *grid, PieceGridEntry *ent, int cap)
+{
+    memset(grid->head, -1, sizeof(grid->head));
+    grid->ent = ent;
+    grid->n = 0;
+    grid->cap = cap;
+    grid->full = 0;
+}
+
+static inline int getPieceBucket(int cx, int cz)
+{
+    uint32_t h = (uint32_t)cx * 0x9e3779b1U ^ (uint32_t)cz * 0x85ebca77U;
+    return h >> (32 - PIECE_GRID_BITS);
+}
+
+static inline int piecesIntersect(const Piece *p, const Piece *q)
+{
+    return
+        q->bb1.x >= p->bb0.x && q->bb0.x <= p->bb1.x &&
+        q->bb1.z >= p->bb0.z && q->bb0.z <= p->bb1.z &&
+        q->bb1.y >= p->bb0.y && q->bb0.y <= p->bb1.y;
+}
+
+static void insertPieceGrid(PieceGrid *grid, Piece *p)
+{
+    if (!grid || grid->full)
+        return;
+    int x0 = p->bb0.x >> PIECE_GRID_SHIFT, x1 = p->bb1.x >> PIECE_GRID_SHIFT;
+    int z0 = p->bb0.z >> PIECE_GRID_SHIFT, z1 = p->bb1.z >> PIECE_GRID_SHIFT;
+    int cx, cz;
+    for (cz = z0; cz <= z1; cz++)
+    {
+        for (cx = x0; cx <= x1; cx++)
+        {
+            if (grid->n >= grid->cap)
+            {
+                grid->full = 1;
+                return;
+            }
+            PieceGridEntry *e = grid->ent + grid->n;
+            e->p = p;
+            e->bucket = getPieceBucket(cx, cz);
+            e->next = grid->head[e->bucket];
+            grid->head[e->bucket] = grid->n++;
+        }
+    }
+}
+
+/// Removes the pieces at and after 'end' from the grid.
+static void truncPieceGrid(PieceGrid *grid, const Piece *end)
+{
+    if (!grid)
+        return;
+    while (grid->n > 0 && grid->ent[grid->n-1].p >= end)
+    {
+        PieceGridEntry *e = grid->ent + --grid->n;
+        grid->head[e->bucket] = e->next;
+    }
+}
+
+/// Returns the first piece in [lo, hi) that collides with 'p', or NULL.
+/// Short ranges are faster to scan directly.
+static Piece *findPieceCollision(const PieceGrid *grid, const Piece *p,
+        Piece *lo, Piece *hi)
+{
+    Piece *q, *first = NULL;
+    if (!grid || grid->full || hi - lo <= 64)
+    {
+        for (q = lo; q < hi; q++)
+        {
+            if (piecesIntersect(p, q))
+                return q;
+        }
+        return NULL;
+    }
+    int x0 = p->bb0.x >> PIECE_GRID_SHIFT, x1 = p->bb1.x >> PIECE_GRID_SHIFT;
+    int z0 = p->bb0.z >> PIECE_GRID_SHIFT, z1 = p->bb1.z >> PIECE_GRID_SHIFT;
+    int cx, cz, i;
+    for (cz = z0; cz <= z1; cz++)
+    {
+        for (cx = x0; cx <= x1; cx++)
+        {
+            i = grid->head[getPieceBucket(cx, cz)];
+            for (; i >= 0; i = grid->ent[i].next)
+            {   // the buckets are ordered from the newest piece to the oldest
+                q = grid->ent[i].p;
+                if (q < lo)
+                    break;
+                if (q >= hi || (first && q >= first))
+                    continue;
+                if (piecesIntersect(p, q))
+                    first = q;
+            }
+        }
+    }
+    return first;
+}
+
+
+int getVariant(StructureVariant *r, int structType, int mc, uint64_t seed,
+        int x, int z, int biomeID)
+{
+    int t;
+    char sx, sy, sz;
+    uint64_t rng = chunkGenerateRnd(seed, x >> 4, z >> 4);
+
+    memset(r, 0, sizeof(*r));
+    r->start = -1;
+    r->biome = -1;
+    r->y = 320;
+
+    switch (structType)
+    {
+    case Village:
+        if (mc <= MC_1_9)
+            return 0;
         if (!isViableFeatureBiome(mc, Village, biomeID))
             return 0;
         if (mc <= MC_1_13)
@@ -2394,6 +3596,7 @@ Piece *addEndCityPiece(PieceEnv *env, Piece *prev, int rot, int px, int py, int
         p->bb0.x += dx; p->bb0.y += dy; p->bb0.z += dz;
         p->bb1.x += dx; p->bb1.y += dy; p->bb1.z += dz;
     }
+    insertPieceGrid(env->grid, p);
     return p;
 }
 
@@ -2402,32 +3605,28 @@ int genPiecesRecusively(piecefunc_t gen, PieceEnv *env, Piece *current, int dept
 {
     if (depth > 8)
         return 0;
-    int i, j, n_local = 0;
+    int i, n_local = 0;
     PieceEnv env_local = *env;
     env_local.list = env->list + *env->n;
     env_local.n = &n_local;
     if (!gen(&env_local, current, depth))
-        return 0;
+        goto L_discard;
     int gendepth = next(env->rng, 32);
     for (i = 0; i < n_local; i++)
     {
         Piece *p = env_local.list + i;
         p->depth = gendepth;
-        for (j = 0; j < *env->n; j++)
-        {   // check for piece with bounding box collition
-            Piece *q = env->list + j;
-            if (q->bb1.x >= p->bb0.x && q->bb0.x <= p->bb1.x &&
-                q->bb1.z >= p->bb0.z && q->bb0.z <= p->bb1.z &&
-                q->bb1.y >= p->bb0.y && q->bb0.y <= p->bb1.y)
-            {
-                if (current->depth != q->depth)
-                    return 0;
-                break;
-            }
-        }
+        // check for piece with bounding box collition
+        Piece *q = findPieceCollision(env->grid, p, env->list, env_local.list);
+        if (q && current->depth != q->depth)
+            goto L_discard;
     }
     (*env->n) += n_local;
     return 1;
+
+L_discard:
+    truncPieceGrid(env->grid, env_local.list);
+    return 0;
 }
 
 static
@@ -2573,7 +3772,8 @@ int genFatTower(PieceEnv *env, Piece *current, int depth)
     return 1;
 }
 
-int getEndCityPieces(Piece *list, uint64_t seed, int chunkX, int chunkZ)
+static int genEndCityPieces(Piece *list, PieceGrid *grid,
+        uint64_t seed, int chunkX, int chunkZ)
 {
     uint64_t rng = chunkGenerateRnd(seed, chunkX, chunkZ);
     int rot = nextInt(&rng, 4);
@@ -2581,6 +3781,7 @@ int getEndCityPieces(Piece *list, uint64_t seed, int chunkX, int chunkZ)
     PieceEnv env;
     memset(&env, 0, sizeof(env));
     env.list = list;
+    env.grid = grid;
     env.n = &n;
     env.rng = &rng;
     env.ship = &ship;
@@ -2594,6 +3795,14 @@ int getEndCityPieces(Piece *list, uint64_t seed, int chunkX, int chunkZ)
     return n;
 }
 
+int getEndCityPieces(Piece *list, uint64_t seed, int chunkX, int chunkZ)
+{
+    PieceGridEntry ent[4 * END_CITY_PIECES_MAX];
+    PieceGrid grid;
+    initPieceGrid(&grid, ent, sizeof(ent) / sizeof(*ent));
+    return genEndCityPieces(list, &grid, seed, chunkX, chunkZ);
+}
+
 
 static const struct
 {
@@ -2646,6 +3855,8 @@ Piece *addFortressPiece(PieceEnv *env, int typ, int x, int y, int z, int depth,
         b1.x += d0.z;       b1.z += d0.x+d1.x;
         break;
     }
+    if (*env->n >= env->nmax)
+        return NULL;
     Piece *p = env->list + *env->n;
     p->name = fortress_info[typ].name;
     p->pos = pos;
@@ -2656,17 +3867,8 @@ Piece *addFortressPiece(PieceEnv *env, int typ, int x, int y, int z, int depth,
     p->type = typ;
     p->next = NULL;
 
-    int i, n = *env->n;
-    for (i = 0; i < n; i++)
-    {
-        Piece *q = env->list + i;
-        if (q->bb1.x >= p->bb0.x && q->bb0.x <= p->bb1.x &&
-            q->bb1.z >= p->bb0.z && q->bb0.z <= p->bb1.z &&
-            q->bb1.y >= p->bb0.y && q->bb0.y <= p->bb1.y)
-        {
-            return NULL; // collision
-        }
-    }
+    if (findPieceCollision(env->grid, p, env->list, env->list + *env->n))
+        return NULL; // collision
     // accept the piece and append it to the processing front
     skipNextN(env->rng, fortress_info[typ].skip);
     //int queue = 0;
@@ -2674,6 +3876,7 @@ Piece *addFortressPiece(PieceEnv *env, int typ, int x, int y, int z, int depth,
     {
         (*env->n)++;
         env->ntyp[typ]++;
+        insertPieceGrid(env->grid, p);
         if (typ != FORTRESS_END)
             env->typlast = typ;
         Piece *q = env->list;
@@ -2795,7 +3998,8 @@ void extendFortressPiece(PieceEnv *env, Piece *p)
     }
 }
 
-int getFortressPieces(Piece *list, int n, int mc, uint64_t seed, int chunkX, int chunkZ)
+static int genFortressPieces(Piece *list, int n, PieceGrid *grid,
+        int mc, uint64_t seed, int chunkX, int chunkZ)
 {
     uint64_t rng = seed;
     if (mc <= MC_1_15)
@@ -2814,6 +4018,7 @@ int getFortressPieces(Piece *list, int n, int mc, uint64_t seed, int chunkX, int
     PieceEnv env;
     memset(&env, 0, sizeof(env));
     env.list = list;
+    env.grid = grid;
     env.n = &count;
     env.rng = &rng;
     env.ntyp[0] = 1;
@@ -2830,6 +4035,7 @@ int getFortressPieces(Piece *list, int n, int mc, uint64_t seed, int chunkX, int
     p->depth = 0;
     p->type = 0;
     p->next = NULL;
+    insertPieceGrid(grid, p);
     extendFortressPiece(&env, p);
     while (list->next)
     {
@@ -2849,6 +4055,101 @@ int getFortressPieces(Piece *list, int n, int mc, uint64_t seed, int chunkX, int
     return count;
 }
 
+int getFortressPieces(Piece *list, int n, int mc, uint64_t seed, int chunkX, int chunkZ)
+{
+    if (n <= 0)
+        return 0;
+    // room for typical fortresses, larger ones fall back to scanning the pieces
+    PieceGridEntry ent[4 * 512];
+    PieceGrid grid;
+    initPieceGrid(&grid, ent, sizeof(ent) / sizeof(*ent));
+    return genFortressPieces(list, n, &grid, mc, seed, chunkX, chunkZ);
+}
+
+
+/// Makes room for 'cap' pieces in total and collision checks for structures
+/// with up to 'maxn' pieces.
+static int reservePieceArena(PieceArena *arena, int cap, int maxn)
+{
+    if (cap > arena->cap)
+    {
+        int newcap = arena->cap > 0 ? arena->cap : 1024;
+        while (newcap < cap)
+            newcap *= 2;
+        Piece *p = (Piece*) realloc(arena->pieces, newcap * sizeof(Piece));
+        if (!p)
+            return -1;
+        arena->pieces = p;
+        arena->cap = newcap;
+    }
+    if (4 * maxn > arena->gridcap)
+    {
+        void *g = realloc(arena->grid, 4 * maxn * sizeof(PieceGridEntry));
+        if (!g)
+            return -1;
+        arena->grid = g;
+        arena->gridcap = 4 * maxn;
+    }
+    return 0;
+}
+
+int initPieceArena(PieceArena *arena, int cap)
+{
+    memset(arena, 0, sizeof(*arena));
+    return reservePieceArena(arena, cap, 0);
+}
+
+void freePieceArena(PieceArena *arena)
+{
+    free(arena->pieces);
+    free(arena->grid);
+    memset(arena, 0, sizeof(*arena));
+}
+
+int getEndCityPiecesBatch(PieceArena *arena, uint64_t seed,
+        const Pos *chunks, int n, int *offs)
+{
+    PieceGrid grid;
+    int i, cnt = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (reservePieceArena(arena, cnt + END_CITY_PIECES_MAX, END_CITY_PIECES_MAX))
+            return -1;
+        initPieceGrid(&grid, (PieceGridEntry*) arena->grid, arena->gridcap);
+        offs[i] = cnt;
+        cnt += genEndCityPieces(arena->pieces + cnt, &grid, seed,
+            chunks[i].x, chunks[i].z);
+    }
+    offs[n] = cnt;
+    return cnt;
+}
+
+int getFortressPiecesBatch(PieceArena *arena, int mc, uint64_t seed,
+        const Pos *chunks, int n, int *offs)
+{
+    PieceGrid grid;
+    int i, m, cnt = 0;
+    int lim = 512;
+    for (i = 0; i < n; i++)
+    {
+        for (;;)
+        {   // regenerate with a larger limit if the fortress did not fit
+            if (reservePieceArena(arena, cnt + lim, lim))
+                return -1;
+            initPieceGrid(&grid, (PieceGridEntry*) arena->grid, arena->gridcap);
+            m = genFortressPieces(arena->pieces + cnt, lim, &grid, mc, seed,
+                chunks[i].x, chunks[i].z);
+            if (m < lim)
+                break;
+            lim *= 2;
+        }
+        offs[i] = cnt;
+        cnt += m;
+    }
+    offs[n] = cnt;
+    return cnt;
+}
+
 
 uint64_t getHouseList(int *out, uint64_t seed, int chunkX, int chunkZ)
 {
@@ -3052,20 +4353,55 @@ void wilson(double n, double p, double z, double *lo, double *hi)
     *hi = w + d;
 }
 
-int monteCarloBiomes(
+struct touple { int x, y, z; };
+
+STRUCT(MonteCarloBatch)
+{
+    Generator *g;
+    Range r;
+    int (*eval)(Generator *g, int scale, int x, int y, int z, void*);
+    void *data;
+    const struct touple *pts;
+    int *status;
+    volatile int next;
+    int n;
+};
+
+static void monteCarloWorker(void *arg, int t)
+{
+    MonteCarloBatch *mb = (MonteCarloBatch*) arg;
+    const Range *r = &mb->r;
+    int i;
+    (void) t;
+
+    while ((i = parallelNext(&mb->next)) < mb->n)
+    {
+        const struct touple *p = &mb->pts[i];
+        mb->status[i] = mb->eval(mb->g, r->scale, r->x+p->x, r->y+p->y, r->z+p->z,
+            mb->data);
+    }
+}
+
+int monteCarloBiomesParallel(
         Generator         * g,
         Range               r,
         uint64_t          * rng,
         double              coverage,
         double              confidence,
         int (*eval)(Generator *g, int scale, int x, int y, int z, void*),
-        void              * data
+        void              * data,
+        int                 batch,
+        int                 threads
         )
 {
     if (r.sy == 0)
         r.sy = 1;
+    if (threads < 1)
+        threads = 1;
+    if (batch < 1)
+        batch = threads > 1 ? 64 * threads : 1;
 
-    struct touple { int x, y, z; } *buf = 0;
+    struct touple *buf = 0;
     size_t n = (size_t)r.sx*r.sy*r.sz;
 
     // z-score (i.e. probit, or standard deviations) for the confidence
@@ -3104,74 +4440,155 @@ int monteCarloBiomes(
         }
     }
 
+    // The sample positions of a batch are drawn up front, remembering the
+    // random state after each one, then they are evaluated (in parallel) and
+    // the results are consumed in order of drawing. This way the outcome and
+    // the final random state are the same as for a one-by-one evaluation.
+    MonteCarloBatch mb;
+    mb.g = g;
+    mb.r = r;
+    mb.eval = eval;
+    mb.data = data;
+    // a single-sample batch (the serial case) does not allocate
+    struct touple pt1, *pts = &pt1;
+    uint64_t seed1, *seeds = &seed1;
+    int status1, *status = &status1;
+    if (batch > 1)
+    {
+        pts = (struct touple*) malloc(batch * sizeof(*pts));
+        seeds = (uint64_t*) malloc(batch * sizeof(*seeds));
+        status = (int*) malloc(batch * sizeof(*status));
+        if (!pts || !seeds || !status)
+        {   // fall back to evaluating the positions one by one
+            free(status);
+            free(seeds);
+            free(pts);
+            pts = &pt1;
+            seeds = &seed1;
+            status = &status1;
+            batch = 1;
+        }
+    }
+    mb.pts = pts;
+    mb.status = status;
+
     size_t i = 0;
     double m = 0; // number of samples
     double x = 0; // number of successes
     int ret = 1;
 
     // iterate over the area in a random order
-    for (i = 0; i < n; i++)
+    while (i < n)
     {
-        struct touple t;
-        if (buf)
+        int b, cnt = n - i < (size_t)batch ? (int)(n - i) : batch;
+
+        for (b = 0; b < cnt; b++)
         {
-            int j = n - i;
-            int k = nextInt(rng, j);
-            t = buf[k];
-            if (k != j-1)
+            struct touple t;
+            if (buf)
+            {
+                int j = n - i - b;
+                int k = nextInt(rng, j);
+                t = buf[k];
+                if (k != j-1)
+                {
+                    buf[k] = buf[j-1];
+                    buf[j-1] = t;
+                }
+            }
+            else
             {
-                buf[k] = buf[j-1];
-                buf[j-1] = t;
+                t.x = nextInt(rng, r.sx);
+                t.y = nextInt(rng, r.sy);
+                t.z = nextInt(rng, r.sz);
             }
+            pts[b] = t;
+            seeds[b] = *rng;
         }
-        else
+        i += cnt;
+
+        if (threads > 1 && cnt > 1)
         {
-            t.x = nextInt(rng, r.sx);
-            t.y = nextInt(rng, r.sy);
-            t.z = nextInt(rng, r.sz);
+            mb.next = 0;
+            mb.n = cnt;
+            runParallel(threads < cnt ? threads : cnt, monteCarloWorker, &mb);
         }
 
-        int status = eval(g, r.scale, r.x+t.x, r.y+t.y, r.z+t.z, data);
-        if (status == -1)
-            continue;
-        else if (status == 0)
-            ;
-        else if (status == 1)
-            x += 1.0;
-        else
+        for (b = 0; b < cnt; b++)
         {
-            ret = 0;
-            break;
-        }
-        m += 1.0;
+            int st;
+            if (threads > 1 && cnt > 1)
+                st = status[b];
+            else
+                st = eval(g, r.scale, r.x+pts[b].x, r.y+pts[b].y, r.z+pts[b].z, data);
+
+            if (st == -1)
+                continue;
+            else if (st == 0)
+                ;
+            else if (st == 1)
+                x += 1.0;
+            else
+            {
+                ret = 0;
+                break;
+            }
+            m += 1.0;
 
-        // check if we can abort early with the current confidence interval
-        double per_m = 1.0 / m;
-        double lo, hi;
-        wilson(m, x * per_m, zscore, &lo, &hi);
+            // check if we can abort early with the current confidence interval
+            double per_m = 1.0 / m;
+            double lo, hi;
+            wilson(m, x * per_m, zscore, &lo, &hi);
 
-        if (lo - per_m > coverage)
-        {
-            ret = 1;
-            break;
+            if (lo - per_m > coverage)
+            {
+                ret = 1;
+                break;
+            }
+            if (hi + per_m < coverage)
+            {
+                ret = 0;
+                break;
+            }
+
+            if (hi - lo < whi - wlo)
+            {   // should occur around i ~ wn
+                ret = x * per_m > coverage;
+                break;
+            }
         }
-        if (hi + per_m < coverage)
-        {
-            ret = 0;
+        if (b < cnt)
+        {   // rewind to the random state after the deciding sample
+            *rng = seeds[b];
             break;
         }
+    }
 
-        if (hi - lo < whi - wlo)
-        {   // should occur around i ~ wn
-            ret = x * per_m > coverage;
-            break;
-        }
+    if (batch > 1)
+    {
+        free(status);
+        free(seeds);
+        free(pts);
     }
     if (buf)
         free(buf);
     return ret;
 }
 
+int monteCarloBiomes(
+        Generator         * g,
+        Range               r,
+        uint64_t          * rng,
+        double              coverage,
+        double              confidence,
+        int (*eval)(Generator *g, int scale, int x, int y, int z, void*),
+        void              * data
+        )
+{
+    return monteCarloBiomesParallel(g, r, rng, coverage, confidence, eval, data,
+        1, 1);
+}
+
 
 void setupBiomeFilter(
     BiomeFilter *bf,
@@ -3589,41 +5006,242 @@ typedef struct {
     volatile char *stop;
 } gdt_info_t;
 
+/// Adds a sampled biome and returns non-zero once the outcome is known.
+static int addCheckedBiome(gdt_info_t *info, int id)
+{
+    if (id < 128) info->b |= (1ULL << id);
+    else info->m |= (1ULL << (id-128));
+
+    // check if we know enough to stop
+    int match_exc = (info->bexc|info->mexc) == 0;
+    int match_any = (info->bany|info->many) == 0;
+    int match_req = (info->breq|info->mreq) == 0;
+    if (!match_exc && ((info->b & info->bexc) || (info->m & info->mexc)))
+        return 1; // encountered an excluded biome -> stop
+    match_any |= ((info->b & info->bany) || (info->m & info->many));
+    match_req |= ((info->b & info->breq) == info->breq &&
+                  (info->m & info->mreq) == info->mreq);
+    if (match_exc && match_any && match_req)
+        return 1; // all conditions met -> stop
+    return 0;
+}
+
 static int f_graddesc_test(void *data, int x, int z, double p)
 {
-    (void) p;
-    gdt_info_t *info = (gdt_info_t *) data;
-    if (info->stop && *info->stop)
-        return 1;
-    int idx = (z - info->r.z) * info->r.sx + (x - info->r.x);
-    if (info->ids[idx] != -1)
-        return 0;
-    int id = getBiomeAt(info->g, info->r.scale, x, info->r.y, z);
-    info->ids[idx] = id;
-    if (id < 128) info->b |= (1ULL << id);
-    else info->m |= (1ULL << (id-128));
+    (void) p;
+    gdt_info_t *info = (gdt_info_t *) data;
+    if (info->stop && *info->stop)
+        return 1;
+    int idx = (z - info->r.z) * info->r.sx + (x - info->r.x);
+    if (info->ids[idx] != -1)
+        return 0;
+    int id = getBiomeAt(info->g, info->r.scale, x, info->r.y, z);
+    info->ids[idx] = id;
+    return addCheckedBiome(info, id);
+}
+
+
+STRUCT(ClimateQuad)
+{
+    gdt_info_t *info;
+    const BiomeNoise *bn;
+    int approx;     // sample only the tile centers (BF_APPROX)
+    int n;          // number of biomes of interest
+    int ids[256];
+    const int *lim[256];
+};
+
+/// Checks if any biome that could still change the outcome is possible in
+/// the tile, subdividing it until the remaining points are sampled.
+/// Returns non-zero once the outcome is known.
+static int checkClimateQuad(ClimateQuad *cq, int x, int z, int w, int h)
+{
+    static const int para[] = {
+        NP_TEMPERATURE, NP_HUMIDITY, NP_CONTINENTALNESS, NP_EROSION, NP_WEIRDNESS
+    };
+    gdt_info_t *info = cq->info;
+    int i, j, k;
+
+    if (info->stop && *info->stop)
+        return 1;
+
+    // climate intervals of the tile, widened by the sampling shift
+    const DoublePerlinNoise *shift = &cq->bn->climate[NP_SHIFT];
+    double a[3], b[3], smin, smax, vmin, vmax;
+    a[0] = x; a[1] = 0; a[2] = z;
+    b[0] = x + w - 1; b[1] = 0; b[2] = z + h - 1;
+    sampleDoublePerlinBounds(shift, a, b, &smin, &smax);
+    double px0 = a[0] + 4.0 * smin, px1 = b[0] + 4.0 * smax;
+    a[0] = z; a[1] = x; a[2] = 0;
+    b[0] = z + h - 1; b[1] = x + w - 1; b[2] = 0;
+    sampleDoublePerlinBounds(shift, a, b, &smin, &smax);
+    double pz0 = a[0] + 4.0 * smin, pz1 = b[0] + 4.0 * smax;
+
+    int64_t lo[6], hi[6];
+    a[0] = px0; a[1] = 0; a[2] = pz0;
+    b[0] = px1; b[1] = 0; b[2] = pz1;
+    for (k = 0; k < 5; k++)
+    {
+        int p = para[k];
+        sampleDoublePerlinBounds(&cq->bn->climate[p], a, b, &vmin, &vmax);
+        lo[p] = (int64_t) floor(10000.0 * vmin) - 1;
+        hi[p] = (int64_t) ceil(10000.0 * vmax) + 1;
+    }
+
+    int any = (info->bany|info->many) == 0 ||
+        (info->b & info->bany) || (info->m & info->many);
+    for (i = 0; i < cq->n; i++)
+    {
+        int id = cq->ids[i];
+        uint64_t bit = 1ULL << (id & 0x3f);
+        uint64_t b = id < 128 ? info->b : info->m;
+        uint64_t req = id < 128 ? info->breq : info->mreq;
+        uint64_t exc = id < 128 ? info->bexc : info->mexc;
+        uint64_t pick = id < 128 ? info->bany : info->many;
+        if (!((exc & bit) || ((req & bit) && !(b & bit)) || ((pick & bit) && !any)))
+            continue; // already settled
+        const int *l = cq->lim[i];
+        for (k = 0; k < 5; k++)
+        {
+            int p = para[k];
+            if (l[2*p] > hi[p] || l[2*p+1] < lo[p])
+                break;
+        }
+        if (k == 5)
+            break;
+    }
+    if (i == cq->n)
+        return 0; // nothing in this tile can change the outcome
+
+    if (w * h <= 16)
+    {
+        Range *r = &info->r;
+        if (cq->approx)
+        {   // a single sample from the center of the tile
+            x += w / 2; z += h / 2;
+            w = h = 1;
+        }
+        for (k = 0; k < r->sy; k++)
+        {
+            for (j = 0; j < h; j++)
+            {
+                for (i = 0; i < w; i++)
+                {
+                    int id = sampleBiomeNoise(cq->bn, NULL, x+i, r->y+k, z+j, NULL, 0);
+                    if (k == 0)
+                        info->ids[(z+j - r->z) * r->sx + (x+i - r->x)] = id;
+                    if (addCheckedBiome(info, id))
+                        return 1;
+                }
+            }
+        }
+        return 0;
+    }
+    if (w >= h)
+    {
+        return checkClimateQuad(cq, x, z, w/2, h) ||
+            checkClimateQuad(cq, x + w/2, z, w - w/2, h);
+    }
+    return checkClimateQuad(cq, x, z, w, h/2) ||
+        checkClimateQuad(cq, x, z + h/2, w, h - h/2);
+}
+
+/// Evaluates the biome requirements for a range at scale 1:4 in the 1.18+
+/// Overworld with a climate quadtree.
+static void checkBiomesClimateQuad(gdt_info_t *info, const BiomeNoise *bn, int mc)
+{
+    ClimateQuad cq;
+    int id;
+
+    cq.info = info;
+    cq.bn = bn;
+    cq.approx = (info->flags & BF_APPROX) != 0;
+    cq.n = 0;
+    for (id = 0; id < 256; id++)
+    {
+        uint64_t bit = 1ULL << (id & 0x3f);
+        if (id < 64)
+        {
+            if (!((info->breq | info->bexc | info->bany) & bit))
+                continue;
+        }
+        else if (id >= 128 && id < 192)
+        {
+            if (!((info->mreq | info->mexc | info->many) & bit))
+                continue;
+        }
+        else continue;
+        // biomes without limits do not generate and never show up
+        const int *l = getBiomeParaLimits(mc, id);
+        if (!l)
+            continue;
+        cq.ids[cq.n] = id;
+        cq.lim[cq.n] = l;
+        cq.n++;
+    }
+
+    checkClimateQuad(&cq, info->r.x, info->r.z, info->r.sx, info->r.sz);
+}
+
+struct itouple { int i, x, y, z; };
+
+size_t getBiomeCheckScratchSize(const Generator *g, Range r, int dim)
+{
+    if (r.sy == 0)
+        r.sy = 1;
+    // the cache size depends on the dimension, which may not be applied yet
+    Generator gd = *g;
+    gd.dim = dim;
+    size_t len = getMinCacheSize(&gd, r.scale, r.sx, r.sy, r.sz);
+    return len * sizeof(int) + (size_t)r.sx * r.sy * r.sz * sizeof(struct itouple);
+}
+
+int checkForBiomes(
+        Generator         * g,
+        int               * cache,
+        Range               r,
+        int                 dim,
+        uint64_t            seed,
+        const BiomeFilter * filter,
+        volatile char     * stop
+        )
+{
+    uint64_t rng = 0;
+    void *scratch = NULL;
+    int ret;
 
-    // check if we know enough to stop
-    int match_exc = (info->bexc|info->mexc) == 0;
-    int match_any = (info->bany|info->many) == 0;
-    int match_req = (info->breq|info->mreq) == 0;
-    if (!match_exc && ((info->b & info->bexc) || (info->m & info->mexc)))
-        return 1; // encountered an excluded biome -> stop
-    match_any |= ((info->b & info->bany) || (info->m & info->many));
-    match_req |= ((info->b & info->breq) == info->breq &&
-                  (info->m & info->mreq) == info->mreq);
-    if (match_exc && match_any && match_req)
-        return 1; // all conditions met -> stop
-    return 0;
+    // the layered and beta generators do not sample and only need memory
+    // for the biomes
+    int layered = g->mc <= MC_B1_7 || (g->mc <= MC_1_17 && dim == DIM_OVERWORLD);
+    if (!cache || !layered)
+    {
+        size_t siz = getBiomeCheckScratchSize(g, r, dim);
+        if (cache)
+        {   // only the sample order is needed
+            if (r.sy == 0)
+                r.sy = 1;
+            siz = (size_t)r.sx * r.sy * r.sz * sizeof(struct itouple);
+        }
+        scratch = malloc(siz);
+        if (!scratch)
+            return 0;
+    }
+    if (!layered)
+        setSeed(&rng, rand());
+    ret = checkForBiomesR(g, cache, r, dim, seed, filter, &rng, scratch, stop);
+    free(scratch);
+    return ret;
 }
 
-int checkForBiomes(
+int checkForBiomesR(
         Generator         * g,
         int               * cache,
         Range               r,
         int                 dim,
         uint64_t            seed,
         const BiomeFilter * filter,
+        uint64_t          * rng,
+        void              * scratch,
         volatile char     * stop
         )
 {
@@ -3633,14 +5251,13 @@ int checkForBiomes(
     if (r.sy == 0)
         r.sy = 1;
 
+    // the scratch memory holds the sample order followed by the cache
+    int n = r.sx*r.sy*r.sz;
+    struct itouple *buf = (struct itouple*) scratch;
+    int *ids = cache ? cache : (int*) (buf + n);
+
     if (g->mc <= MC_B1_7)
     {   // TODO: optimize
-        int *ids;
-        if (cache)
-            ids = cache;
-        else
-            ids = allocCache(g, r);
-
         if (g->dim != dim || g->seed != seed)
             applySeed(g, dim, seed);
 
@@ -3649,9 +5266,6 @@ int checkForBiomes(
         for (i = 0; i < r.sx*r.sz; i++)
             b |= (1ULL << ids[i]);
 
-        if (ids != cache)
-            free(ids);
-
         int match_exc = (filter->biomeToExcl) == 0;
         int match_any = (filter->biomeToPick) == 0;
         int match_req = (filter->biomeToFind) == 0;
@@ -3663,7 +5277,7 @@ int checkForBiomes(
     if (g->mc <= MC_1_17 && dim == DIM_OVERWORLD)
     {
         Layer *entry = (Layer*) getLayerForScale(g, r.scale);
-        ret = checkForBiomesAtLayer(&g->ls, entry, cache, seed,
+        ret = checkForBiomesAtLayer(&g->ls, entry, ids, seed,
             r.x, r.z, r.sx, r.sz, filter);
         if (ret == 0 && r.sy > 1 && cache)
         {
@@ -3676,12 +5290,7 @@ int checkForBiomes(
         return ret;
     }
 
-    int *ids, id;
-    if (cache)
-        ids = cache;
-    else
-        ids = allocCache(g, r);
-
+    int id;
     if (g->dim != dim || g->seed != seed)
     {
         applySeed(g, dim, seed);
@@ -3704,9 +5313,17 @@ int checkForBiomes(
     ret = 0;
     memset(ids, -1, r.sx * r.sz * sizeof(int));
 
-    int n = r.sx*r.sy*r.sz;
     int trials = n;
-    struct touple { int i, x, y, z; } *buf = NULL;
+
+    if (r.scale == 4 && dim == DIM_OVERWORLD && g->mc >= MC_1_18 &&
+        g->bn.nptype < 0)
+    {
+        // Subdivide the area into tiles, which are skipped when the climate
+        // bounds show that none of the relevant biomes can generate there.
+        // This finds exactly the relevant biomes that are present.
+        checkBiomesClimateQuad(info, &g->bn, g->mc);
+        goto L_end;
+    }
 
     if (r.scale == 4 && r.sx * r.sz > 64 && dim == DIM_OVERWORLD)
     {
@@ -3740,8 +5357,6 @@ int checkForBiomes(
 
     // We'll shuffle the coordinates so we'll generate the biomes in a
     // stochasitc mannor.
-    buf = (struct touple*) malloc(n * sizeof(*buf));
-
     id = 0;
     for (k = 0; k < r.sy; k++)
     {
@@ -3770,9 +5385,9 @@ int checkForBiomes(
 
     for (i = 0; i < trials; i++)
     {
-        struct touple t;
+        struct itouple t;
         j = n - i;
-        k = rand() % j;
+        k = nextInt(rng, j);
         t = buf[k];
         if (k != j-1)
         {
@@ -3819,10 +5434,6 @@ L_end:
         ret = (match_exc && match_any && match_req);
     }
 
-    if (buf)
-        free(buf);
-    if (ids != cache)
-        free(ids);
     return ret;
 }
 
@@ -4122,178 +5733,174 @@ int testExclusion(Layer *layer, int *cache, int x, int z, const BiomeFilter *bf)
     return (bf->biomeToExclM & (1ULL << (id-128))) != 0;
 }
 
-int checkForBiomesAtLayer(
-        LayerStack        * g,
-        Layer             * entry,
-        int               * cache,
-        uint64_t            seed,
-        int                 x,
-        int                 z,
-        unsigned int        w,
-        unsigned int        h,
-        const BiomeFilter * filter
-        )
+/// Gets the cells of layer 'l' that cover the area (x,z,w,h) of 'entry'.
+static void getFilterCells(const Layer *entry, const Layer *l,
+        int x, int z, int w, int h, int *x0, int *z0, int *x1, int *z1)
 {
-    Layer *l;
-    int *ids;
-    int ret, err;
-    int memsiz, mem1x1;
-
-    if (filter->flags & BF_APPROX) // TODO: protoCheck for 1.6-
-    {
-        l = entry;
+    int bx = x * entry->scale;
+    int bz = z * entry->scale;
+    int bw = w * entry->scale;
+    int bh = h * entry->scale;
+    *x0 = bx / l->scale; if (x < 0) (*x0)--;
+    *z0 = bz / l->scale; if (z < 0) (*z0)--;
+    *x1 = (bx + bw) / l->scale; if (x+w >= 0) (*x1)++;
+    *z1 = (bz + bh) / l->scale; if (z+h >= 0) (*z1)++;
+}
 
-        int i, j;
-        int bx = x * l->scale;
-        int bz = z * l->scale;
-        int bw = w * l->scale;
-        int bh = h * l->scale;
-        int x0, z0, x1, z1;
-        uint64_t ss, cs;
-        uint64_t potential, required;
+/// Pre-check: enough special climates at 1:1024.
+static int filterStageSpecial(const LayerStack *g, const Layer *entry,
+        uint64_t seed, int x, int z, int w, int h, const BiomeFilter *filter)
+{
+    const Layer *l = &g->layers[L_SPECIAL_1024];
+    int specialcnt = filter->specialCnt;
+    int i, j, x0, z0, x1, z1;
+    getFilterCells(entry, l, x, z, w, h, &x0, &z0, &x1, &z1);
+    uint64_t ss = getStartSeed(seed, l->layerSalt);
 
-        int specialcnt = filter->specialCnt;
-        if (specialcnt > 0)
+    for (j = z0; j <= z1; j++)
+    {
+        for (i = x0; i <= x1; i++)
         {
-            l = &g->layers[L_SPECIAL_1024];
-            x0 = (bx) / l->scale; if (x < 0) x0--;
-            z0 = (bz) / l->scale; if (z < 0) z0--;
-            x1 = (bx + bw) / l->scale; if (x+(int)w >= 0) x1++;
-            z1 = (bz + bh) / l->scale; if (z+(int)h >= 0) z1++;
-            ss = getStartSeed(seed, l->layerSalt);
-
-            for (j = z0; j <= z1; j++)
-            {
-                for (i = x0; i <= x1; i++)
-                {
-                    cs = getChunkSeed(ss, i, j);
-                    if (mcFirstIsZero(cs, 13))
-                        specialcnt--;
-                }
-            }
-            if (specialcnt > 0)
-                return 0;
+            uint64_t cs = getChunkSeed(ss, i, j);
+            if (mcFirstIsZero(cs, 13))
+                specialcnt--;
         }
+    }
+    return specialcnt <= 0;
+}
 
-        l = &g->layers[L_BIOME_256];
-        x0 = bx / l->scale; if (x < 0) x0--;
-        z0 = bz / l->scale; if (z < 0) z0--;
-        x1 = (bx + bw) / l->scale; if (x+(int)w >= 0) x1++;
-        z1 = (bz + bh) / l->scale; if (z+(int)h >= 0) z1++;
+/// Pre-check: a proto mushroom island at 1:256.
+static int filterStageMushroom(const LayerStack *g, const Layer *entry,
+        uint64_t seed, int x, int z, int w, int h, const BiomeFilter *filter)
+{
+    const Layer *l = &g->layers[L_BIOME_256];
+    int i, j, x0, z0, x1, z1;
+    (void) filter;
+    getFilterCells(entry, l, x, z, w, h, &x0, &z0, &x1, &z1);
+    uint64_t ss = getStartSeed(seed, g->layers[L_MUSHROOM_256].layerSalt);
 
-        if (filter->majorToFind & (1ULL << mushroom_fields))
+    for (j = z0; j <= z1; j++)
+    {
+        for (i = x0; i <= x1; i++)
         {
-            ss = getStartSeed(seed, g->layers[L_MUSHROOM_256].layerSalt);
-
-            for (j = z0; j <= z1; j++)
-            {
-                for (i = x0; i <= x1; i++)
-                {
-                    cs = getChunkSeed(ss, i, j);
-                    if (mcFirstIsZero(cs, 100))
-                        goto L_has_proto_mushroom;
-                }
-            }
-            return 0;
+            uint64_t cs = getChunkSeed(ss, i, j);
+            if (mcFirstIsZero(cs, 100))
+                return 1;
         }
-L_has_proto_mushroom:
+    }
+    return 0;
+}
 
-        potential = 0;
-        required = filter->majorToFind & (
-                (1ULL << badlands_plateau) | (1ULL << wooded_badlands_plateau) |
-                (1ULL << desert) | (1ULL << savanna) | (1ULL << plains) |
-                (1ULL << forest) | (1ULL << dark_forest) | (1ULL << mountains) |
-                (1ULL << birch_forest) | (1ULL << swamp));
+static uint64_t getFilterMajorReq(const BiomeFilter *filter)
+{
+    return filter->majorToFind & (
+            (1ULL << badlands_plateau) | (1ULL << wooded_badlands_plateau) |
+            (1ULL << desert) | (1ULL << savanna) | (1ULL << plains) |
+            (1ULL << forest) | (1ULL << dark_forest) | (1ULL << mountains) |
+            (1ULL << birch_forest) | (1ULL << swamp));
+}
 
-        ss = getStartSeed(seed, l->layerSalt);
+/// Pre-check: the potential major biomes at 1:256.
+static int filterStageMajor(const LayerStack *g, const Layer *entry,
+        uint64_t seed, int x, int z, int w, int h, const BiomeFilter *filter)
+{
+    const Layer *l = &g->layers[L_BIOME_256];
+    int i, j, x0, z0, x1, z1;
+    getFilterCells(entry, l, x, z, w, h, &x0, &z0, &x1, &z1);
+    uint64_t potential = 0;
+    uint64_t required = getFilterMajorReq(filter);
+    uint64_t ss = getStartSeed(seed, l->layerSalt);
 
-        for (j = z0; j <= z1; j++)
+    for (j = z0; j <= z1; j++)
+    {
+        for (i = x0; i <= x1; i++)
         {
-            for (i = x0; i <= x1; i++)
-            {
-                cs = getChunkSeed(ss, i, j);
-                int cs6 = mcFirstInt(cs, 6);
-                int cs3 = mcFirstInt(cs, 3);
-                int cs4 = mcFirstInt(cs, 4);
+            uint64_t cs = getChunkSeed(ss, i, j);
+            int cs6 = mcFirstInt(cs, 6);
+            int cs3 = mcFirstInt(cs, 3);
+            int cs4 = mcFirstInt(cs, 4);
 
-                if (cs3) potential |= (1ULL << badlands_plateau);
-                else potential |= (1ULL << wooded_badlands_plateau);
-
-                switch (cs6)
-                {
-                case 0: potential |= (1ULL << desert) | (1ULL << forest); break;
-                case 1: potential |= (1ULL << desert) | (1ULL << dark_forest); break;
-                case 2: potential |= (1ULL << desert) | (1ULL << mountains); break;
-                case 3: potential |= (1ULL << savanna) | (1ULL << plains); break;
-                case 4: potential |= (1ULL << savanna) | (1ULL << birch_forest); break;
-                case 5: potential |= (1ULL << plains) | (1ULL << swamp); break;
-                }
+            if (cs3) potential |= (1ULL << badlands_plateau);
+            else potential |= (1ULL << wooded_badlands_plateau);
 
-                if (cs4 == 3) potential |= (1ULL << snowy_taiga);
-                else potential |= (1ULL << snowy_tundra);
+            switch (cs6)
+            {
+            case 0: potential |= (1ULL << desert) | (1ULL << forest); break;
+            case 1: potential |= (1ULL << desert) | (1ULL << dark_forest); break;
+            case 2: potential |= (1ULL << desert) | (1ULL << mountains); break;
+            case 3: potential |= (1ULL << savanna) | (1ULL << plains); break;
+            case 4: potential |= (1ULL << savanna) | (1ULL << birch_forest); break;
+            case 5: potential |= (1ULL << plains) | (1ULL << swamp); break;
             }
-        }
 
-        if ((potential & required) ^ required)
-            return 0;
+            if (cs4 == 3) potential |= (1ULL << snowy_taiga);
+            else potential |= (1ULL << snowy_tundra);
+        }
     }
+    return ((potential & required) ^ required) == 0;
+}
 
-    l = g->layers;
-    if (cache)
+/// Pre-check: excluded biomes at a few sample points, if these are cheap
+/// compared to the full area.
+static int filterStageExclude(Layer *entry, int *ids, uint64_t seed,
+        int x, int z, int w, int h, const BiomeFilter *filter)
+{
+    int memsiz = getMinLayerCacheSize(entry, w, h);
+    int mem1x1 = getMinLayerCacheSize(entry, 1, 1);
+    int err = 0;
+    if (mem1x1 * 2 < memsiz)
     {
-        memsiz = 0;
-        ids = cache;
+        setLayerSeed(entry, seed);
+        err = testExclusion(entry, ids, x+w/2, z+h/2, filter);
     }
-    else
+    if (mem1x1 * 5 < memsiz)
     {
-        memsiz = getMinLayerCacheSize(entry, w, h);
-        ids = (int*) calloc(memsiz, sizeof(int));
+        if (!err) err = testExclusion(entry, ids, x,     z,     filter);
+        if (!err) err = testExclusion(entry, ids, x+w-1, z+h-1, filter);
+        if (!err) err = testExclusion(entry, ids, x,     z+h-1, filter);
+        if (!err) err = testExclusion(entry, ids, x+w-1, z,     filter);
     }
+    return !err;
+}
 
-    if ((filter->biomeToExcl | filter->biomeToExclM) && w*h > 1)
-    {
-        err = 0;
-        if (memsiz == 0)
-            memsiz = getMinLayerCacheSize(entry, w, h);
-        mem1x1 = getMinLayerCacheSize(entry, 1, 1);
-        if (mem1x1 * 2 < memsiz)
-        {
-            setLayerSeed(entry, seed);
-            err = testExclusion(entry, ids, x+w/2, z+h/2, filter);
-        }
-        if (mem1x1 * 5 < memsiz)
-        {
-            if (!err) err = testExclusion(entry, ids, x,     z,     filter);
-            if (!err) err = testExclusion(entry, ids, x+w-1, z+h-1, filter);
-            if (!err) err = testExclusion(entry, ids, x,     z+h-1, filter);
-            if (!err) err = testExclusion(entry, ids, x+w-1, z,     filter);
-        }
-        if (err)
-        {
-            if (cache == NULL)
-                free(ids);
-            return 0;
-        }
-    }
+enum
+{   // layers with filter kernels, in the order of swapping
+    FL_OCEAN_MIX, FL_RIVER_MIX, FL_SHORE, FL_SUNFLOWER, FL_BIOME_EDGE,
+    FL_OCEAN_TEMP, FL_BIOME, FL_MUSHROOM, FL_SPECIAL, FL_MAX
+};
+
+/// Generates the area with filter kernels at the layers in 'mask'.
+static int genFilteredArea(LayerStack *g, Layer *entry, int *ids,
+        uint64_t seed, int x, int z, int w, int h, const BiomeFilter *filter,
+        uint32_t mask)
+{
+    static const struct {
+        int layer;
+        int (*map)(const Layer *, int *, int, int, int, int);
+    } fl[FL_MAX] = {
+        { L_OCEAN_MIX_4,    mapFilterOceanMix },
+        { L_RIVER_MIX_4,    mapFilterRiverMix },
+        { L_SHORE_16,       mapFilterShore },
+        { L_SUNFLOWER_64,   mapFilterRareBiome },
+        { L_BIOME_EDGE_64,  mapFilterBiomeEdge },
+        { L_OCEAN_TEMP_256, mapFilterOceanTemp },
+        { L_BIOME_256,      mapFilterBiome },
+        { L_MUSHROOM_256,   mapFilterMushroom },
+        { L_SPECIAL_1024,   mapFilterSpecial },
+    };
+    filter_data_t fd[FL_MAX];
+    Layer *l = g->layers;
+    int i, err, ret = 0;
 
-    filter_data_t fd[9];
-    swapMap(fd+0, filter, l+L_OCEAN_MIX_4,    mapFilterOceanMix);
-    swapMap(fd+1, filter, l+L_RIVER_MIX_4,    mapFilterRiverMix);
-    swapMap(fd+2, filter, l+L_SHORE_16,       mapFilterShore);
-    swapMap(fd+3, filter, l+L_SUNFLOWER_64,   mapFilterRareBiome);
-    swapMap(fd+4, filter, l+L_BIOME_EDGE_64,  mapFilterBiomeEdge);
-    swapMap(fd+5, filter, l+L_OCEAN_TEMP_256, mapFilterOceanTemp);
-    swapMap(fd+6, filter, l+L_BIOME_256,      mapFilterBiome);
-    swapMap(fd+7, filter, l+L_MUSHROOM_256,   mapFilterMushroom);
-    swapMap(fd+8, filter, l+L_SPECIAL_1024,   mapFilterSpecial);
+    for (i = 0; i < FL_MAX; i++)
+        if (mask & (1U << i))
+            swapMap(fd+i, filter, l+fl[i].layer, fl[i].map);
 
-    ret = 0;
     setLayerSeed(entry, seed);
     err = entry->getMap(entry, ids, x, z, w, h);
     if (err == 0)
     {
         uint64_t b = 0, m = 0;
-        unsigned int i;
         for (i = 0; i < w*h; i++)
         {
             int id = ids[i];
@@ -4320,15 +5927,54 @@ L_has_proto_mushroom:
         ret = 2;
     }
 
-    restoreMap(fd+8, l+L_SPECIAL_1024);
-    restoreMap(fd+7, l+L_MUSHROOM_256);
-    restoreMap(fd+6, l+L_BIOME_256);
-    restoreMap(fd+5, l+L_OCEAN_TEMP_256);
-    restoreMap(fd+4, l+L_BIOME_EDGE_64);
-    restoreMap(fd+3, l+L_SUNFLOWER_64);
-    restoreMap(fd+2, l+L_SHORE_16);
-    restoreMap(fd+1, l+L_RIVER_MIX_4);
-    restoreMap(fd+0, l+L_OCEAN_MIX_4);
+    for (i = FL_MAX-1; i >= 0; i--)
+        if (mask & (1U << i))
+            restoreMap(fd+i, l+fl[i].layer);
+    return ret;
+}
+
+int checkForBiomesAtLayer(
+        LayerStack        * g,
+        Layer             * entry,
+        int               * cache,
+        uint64_t            seed,
+        int                 x,
+        int                 z,
+        unsigned int        w,
+        unsigned int        h,
+        const BiomeFilter * filter
+        )
+{
+    int *ids;
+    int ret;
+
+    if (filter->flags & BF_APPROX) // TODO: protoCheck for 1.6-
+    {
+        if (filter->specialCnt > 0 &&
+            !filterStageSpecial(g, entry, seed, x, z, w, h, filter))
+            return 0;
+        if ((filter->majorToFind & (1ULL << mushroom_fields)) &&
+            !filterStageMushroom(g, entry, seed, x, z, w, h, filter))
+            return 0;
+        if (!filterStageMajor(g, entry, seed, x, z, w, h, filter))
+            return 0;
+    }
+
+    if (cache)
+        ids = cache;
+    else
+        ids = (int*) calloc(getMinLayerCacheSize(entry, w, h), sizeof(int));
+
+    if ((filter->biomeToExcl | filter->biomeToExclM) && w*h > 1 &&
+        !filterStageExclude(entry, ids, seed, x, z, w, h, filter))
+    {
+        ret = 0;
+    }
+    else
+    {
+        ret = genFilteredArea(g, entry, ids, seed, x, z, w, h, filter,
+            (1U << FL_MAX) - 1);
+    }
 
     if (cache == NULL)
         free(ids);
@@ -4337,6 +5983,143 @@ L_has_proto_mushroom:
 }
 
 
+void compileBiomeFilter(BiomeFilterPlan *plan, const BiomeFilter *bf, int adapt)
+{
+    memset(plan, 0, sizeof(*plan));
+    plan->bf = *bf;
+    plan->adapt = adapt;
+
+    if (bf->flags & BF_APPROX)
+    {
+        if (bf->specialCnt > 0)
+            plan->stage[plan->nstage++] = BF_STAGE_SPECIAL;
+        if (bf->majorToFind & (1ULL << mushroom_fields))
+            plan->stage[plan->nstage++] = BF_STAGE_MUSHROOM;
+        if (getFilterMajorReq(bf))
+            plan->stage[plan->nstage++] = BF_STAGE_MAJOR;
+    }
+    if (bf->biomeToExcl | bf->biomeToExclM)
+        plan->stage[plan->nstage++] = BF_STAGE_EXCLUDE;
+
+    // filter kernels for the layers that have something to check
+    uint32_t m = 0;
+    if (bf->oceanToFind || bf->riverToFind)
+        m |= 1U << FL_OCEAN_MIX; // also generates the river mix first
+    if (bf->riverToFind || bf->riverToFindM)
+        m |= 1U << FL_RIVER_MIX;
+    if (bf->shoreToFind || bf->shoreToFindM)
+        m |= 1U << FL_SHORE;
+    if (bf->raresToFind || bf->raresToFindM)
+        m |= 1U << FL_SUNFLOWER;
+    if (bf->edgesToFind)
+        m |= 1U << FL_BIOME_EDGE;
+    if (bf->otempToFind)
+        m |= 1U << FL_OCEAN_TEMP;
+    if (bf->majorToFind)
+        m |= 1U << FL_BIOME;
+    if (bf->majorToFind & (1ULL << mushroom_fields))
+        m |= 1U << FL_MUSHROOM;
+    if (bf->specialCnt > 0 || bf->tempsToFind)
+        m |= 1U << FL_SPECIAL;
+    plan->layers = m;
+}
+
+/// Orders the pre-checks by their observed rejection rate per unit of cost.
+static void reorderFilterPlan(BiomeFilterPlan *plan)
+{
+    double score[BF_STAGE_MAX];
+    int i, j;
+    for (i = 0; i < plan->nstage; i++)
+    {
+        int s = plan->stage[i];
+        double rate = (plan->rejects[s] + 1.0) / (plan->calls[s] + 2.0);
+        score[s] = rate / (plan->cost[s] > 0 ? plan->cost[s] : 1);
+    }
+    for (i = 1; i < plan->nstage; i++)
+    {   // insertion sort keeps the order of equal scores
+        int s = plan->stage[i];
+        for (j = i; j > 0 && score[plan->stage[j-1]] < score[s]; j--)
+            plan->stage[j] = plan->stage[j-1];
+        plan->stage[j] = s;
+    }
+}
+
+int checkForBiomesPlan(
+        BiomeFilterPlan   * plan,
+        LayerStack        * g,
+        Layer             * entry,
+        int               * cache,
+        uint64_t            seed,
+        int                 x,
+        int                 z,
+        unsigned int        w,
+        unsigned int        h
+        )
+{
+    const BiomeFilter *bf = &plan->bf;
+    int *ids = cache;
+    int i, ret = 0, pass = 1;
+
+    if (plan->adapt > 0 && ++plan->count >= plan->adapt)
+    {
+        reorderFilterPlan(plan);
+        plan->count = 0;
+    }
+
+    for (i = 0; i < plan->nstage && pass; i++)
+    {
+        int s = plan->stage[i];
+        int x0, z0, x1, z1;
+        switch (s)
+        {
+        case BF_STAGE_SPECIAL:
+            getFilterCells(entry, &g->layers[L_SPECIAL_1024], x, z, w, h,
+                &x0, &z0, &x1, &z1);
+            plan->cost[s] = (x1 - x0 + 1) * (z1 - z0 + 1);
+            pass = filterStageSpecial(g, entry, seed, x, z, w, h, bf);
+            break;
+        case BF_STAGE_MUSHROOM:
+            getFilterCells(entry, &g->layers[L_BIOME_256], x, z, w, h,
+                &x0, &z0, &x1, &z1);
+            plan->cost[s] = (x1 - x0 + 1) * (z1 - z0 + 1);
+            pass = filterStageMushroom(g, entry, seed, x, z, w, h, bf);
+            break;
+        case BF_STAGE_MAJOR:
+            getFilterCells(entry, &g->layers[L_BIOME_256], x, z, w, h,
+                &x0, &z0, &x1, &z1);
+            plan->cost[s] = 3 * (x1 - x0 + 1) * (z1 - z0 + 1);
+            pass = filterStageMajor(g, entry, seed, x, z, w, h, bf);
+            break;
+        case BF_STAGE_EXCLUDE:
+            if (w*h <= 1)
+                continue;
+            if (!ids)
+                ids = (int*) calloc(getMinLayerCacheSize(entry, w, h), sizeof(int));
+            plan->cost[s] = 5 * getMinLayerCacheSize(entry, 1, 1);
+            pass = filterStageExclude(entry, ids, seed, x, z, w, h, bf);
+            break;
+        default:
+            UNREACHABLE();
+        }
+        plan->calls[s]++;
+        plan->rejects[s] += !pass;
+    }
+
+    if (pass)
+    {
+        if (!ids)
+            ids = (int*) calloc(getMinLayerCacheSize(entry, w, h), sizeof(int));
+        ret = genFilteredArea(g, entry, ids, seed, x, z, w, h, bf, plan->layers);
+        plan->calls[BF_STAGE_FULL]++;
+        plan->rejects[BF_STAGE_FULL] += (ret == 0);
+    }
+
+    if (ids != cache)
+        free(ids);
+    return ret;
+}
+
+
 int checkForTemps(LayerStack *g, uint64_t seed, int x, int z, int w, int h, const int tc[9])
 {
     uint64_t ls = getLayerSalt(3); // L_SPECIAL_1024 layer seed
@@ -4393,97 +6176,167 @@ int checkForTemps(LayerStack *g, uint64_t seed, int x, int z, int w, int h, cons
 }
 
 
-struct locate_info_t
+STRUCT(CompStat)
+{
+    int64_t sumx, sumz;
+    int area;
+};
+
+/// Union-find root with path halving.
+static inline int ccFind(int *parent, int k)
+{
+    while (parent[k] != k)
+    {
+        parent[k] = parent[parent[k]];
+        k = parent[k];
+    }
+    return k;
+}
+
+/// Joins two sets, keeping the smaller (i.e. first in row-major order) root.
+static inline void ccUnion(int *parent, int a, int b)
+{
+    a = ccFind(parent, a);
+    b = ccFind(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+/// Labels the connected components of the cells that equal 'match'. Cells
+/// join the same component if they are at most 'tol' apart in manhattan
+/// distance, i.e. if they are separated by a gap of fewer than 'tol' cells.
+/// Every component cell ends up pointing directly to its root in 'parent',
+/// while all other cells are set to -1. Returns non-zero if stopped.
+static int labelComponents(int *parent, const int *ids, int sx, int sz,
+    int match, int tol, volatile char *stop)
+{
+    int i, j, di, dj;
+    for (j = 0; j < sz; j++)
+    {
+        for (i = 0; i < sx; i++)
+        {
+            int k = j*sx + i;
+            parent[k] = ids[k] == match ? k : -1;
+        }
+    }
+
+    for (j = 0; j < sz; j++)
+    {
+        if (stop && *stop)
+            return 1;
+        for (i = 0; i < sx; i++)
+        {
+            int k = j*sx + i;
+            if (parent[k] < 0)
+                continue;
+            // only look forward, the earlier cells have already joined us
+            for (dj = 0; dj <= tol && j+dj < sz; dj++)
+            {
+                int w = tol - dj;
+                for (di = (dj == 0 ? 1 : -w); di <= w; di++)
+                {
+                    if (i+di < 0 || i+di >= sx)
+                        continue;
+                    int kk = k + dj*sx + di;
+                    if (parent[kk] >= 0)
+                        ccUnion(parent, k, kk);
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < sx*sz; i++)
+    {
+        if (parent[i] >= 0)
+            parent[i] = ccFind(parent, i);
+    }
+    return 0;
+}
+
+STRUCT(CenterSearch)
 {
     Generator *g;
-    int *ids;
     Range r;
-    int match, tol;
-    volatile char *stop;
+    int match;
+    int *ids;
+    int *cache;
+    int *queue;
+    int qn;
 };
 
-static
-int floodFillGen(struct locate_info_t *info, int i, int j, Pos *p)
-{
-    typedef struct { int i, j, d; } entry_t;
-    entry_t *queue = (entry_t*) malloc(info->r.sx*info->r.sz * sizeof(*queue));
-    int qn = 1;
-    queue->i = i;
-    queue->j = j;
-    queue->d = 0;
-    int64_t sumx = 0;
-    int64_t sumz = 0;
-    int n = 0;
-    while (--qn >= 0)
+/// Generates the cells [i0,i1] of row j that have not been visited yet, with
+/// one genBiomes() call for each contiguous run, and queues the matching ones.
+static void visitCellRow(CenterSearch *cs, int i0, int i1, int j)
+{
+    const Range *r = &cs->r;
+    int i, k, n, err;
+    if (j < 0 || j >= r->sz)
+        return;
+    if (i0 < 0) i0 = 0;
+    if (i1 >= r->sx) i1 = r->sx - 1;
+
+    for (i = i0; i <= i1; i += n)
     {
-        if (info->stop && *info->stop)
+        int *ids = cs->ids + j*r->sx + i;
+        if (ids[0] != INT_MIN)
         {
-            free(queue);
-            return 0;
-        }
-        int d = queue[qn].d;
-        i = queue[qn].i;
-        j = queue[qn].j;
-        int k = j * info->r.sx + i;
-        int id = info->ids[k];
-        if (id == INT_MAX)
+            n = 1;
             continue;
-        info->ids[k] = INT_MAX;
-        int x = info->r.x + i;
-        int z = info->r.z + j;
-        if (info->g->mc >= MC_1_18)
-            id = getBiomeAt(info->g, info->r.scale, x, info->r.y, z);
-        if (id == info->match)
-        {
-            sumx += x;
-            sumz += z;
-            n++;
-            d = 0;
-        }
-        else
-        {
-            if (++d >= info->tol)
-                continue;
         }
-        entry_t next[] = { {i,j-1,d}, {i,j+1,d}, {i-1,j,d}, {i+1,j,d} };
-        for (k = 0; k < 4; k++)
+        for (n = 1; i+n <= i1 && ids[n] == INT_MIN; n++);
+        Range pr = { r->scale, r->x+i, r->z+j, n, 1, r->y, 1 };
+        err = genBiomes(cs->g, cs->cache, pr);
+        for (k = 0; k < n; k++)
         {
-            i = next[k].i; j = next[k].j;
-            if (i < 0 || i >= info->r.sx || j < 0 || j >= info->r.sz)
-                continue;
-            if (info->ids[j * info->r.sx + i] == INT_MAX)
-                continue;
-            queue[qn++] = next[k];
+            ids[k] = err ? -1 : cs->cache[k];
+            if (ids[k] == cs->match)
+                cs->queue[cs->qn++] = j*r->sx + i + k;
         }
     }
-    free(queue);
-    if (n)
-    {
-        p->x = (int) round((sumx / (double)n + 0.5) * info->r.scale);
-        p->z = (int) round((sumz / (double)n + 0.5) * info->r.scale);
-    }
-    return n;
 }
 
-
 int getBiomeCenters(Pos *pos, int *siz, int nmax, Generator *g, Range r,
     int match, int minsiz, int tol, volatile char *stop)
 {
     if (minsiz <= 0)
         minsiz = 1;
-    int i, j, k, n = 0;
-    int *ids = (int*) malloc(r.sx*r.sz * sizeof(int));
-    memset(ids, -1, r.sx*r.sz * sizeof(int));
     if (tol <= 0)
         tol = 1;
+    int i, j, k, di, dj, n = 0;
     int step = tol;
-    struct locate_info_t info;
-    info.g = g;
-    info.ids = ids;
-    info.r = r;
-    info.stop = stop;
-    info.match = match;
-    info.tol = tol;
+    if (g->mc >= MC_1_18 && tol == 1)
+        step = 1 + floor(sqrt(minsiz) * 0.5);
+
+    // 1.17- checks and generates the area in tiles of this size
+    int ts = 32 / r.scale;
+    if (r.sx + r.sz < 32)
+        ts = 8;
+
+    // All the buffers come from one allocation: the component labels (which
+    // double as the work queue while generating, and hold the component
+    // statistics at the end), the biome map, a generation cache for a tile
+    // or, for 1.18+, for one row of the cells within joining distance, and
+    // the candidate flags of the seeding lattice.
+    int lw = (r.sx + step - 1) / step, lh = (r.sz + step - 1) / step;
+    size_t cells = (size_t)r.sx * r.sz;
+    size_t nparent = (sizeof(CompStat) + sizeof(int) - 1) / sizeof(int);
+    if (nparent < cells)
+        nparent = cells;
+    size_t ncache;
+    if (g->mc >= MC_1_18)
+        ncache = getMinCacheSize(g, r.scale, 2*tol+1, 1, 1);
+    else
+        ncache = getMinCacheSize(g, r.scale, ts, 1, ts);
+    char *mem = (char*) malloc((nparent + cells + ncache) * sizeof(int) + lw * lh);
+    if (!mem)
+        return 0;
+    int *parent = (int*) mem;
+    int *ids = parent + nparent;
+    int *cache = ids + cells;
+    char *cand = (char*) (cache + ncache);
+    memset(cand, 0, lw * lh);
 
     if (g->mc >= MC_1_18)
     {
@@ -4497,8 +6350,10 @@ int getBiomeCenters(Pos *pos, int *siz, int nmax, Generator *g, Range r,
             NP_WEIRDNESS,
         };
         int npara = sizeof(para) / sizeof(para[0]);
-        if (tol == 1)
-            step = 1 + floor(sqrt(minsiz) * 0.5);
+        CenterSearch cs = { g, r, match, ids, cache, parent, 0 };
+
+        for (k = 0; k < (int)cells; k++)
+            ids[k] = INT_MIN; // not generated
 
         for (j = 0; j < r.sz; j += step)
         {
@@ -4506,7 +6361,7 @@ int getBiomeCenters(Pos *pos, int *siz, int nmax, Generator *g, Range r,
             {
                 if (stop && *stop)
                     break;
-                for (k = 0; k < npara; k++)
+                for (k = 0; lim && k < npara; k++)
                 {
                     const int *plim = lim + 2*para[k];
                     if (plim[0] == INT_MIN && plim[1] == INT_MAX)
@@ -4516,21 +6371,37 @@ int getBiomeCenters(Pos *pos, int *siz, int nmax, Generator *g, Range r,
                     double pz = (r.z+j) * r.scale / 4.0;
                     int p = 10000 * sampleDoublePerlin(dpn, px, 0, pz);
                     if (p < plim[0] || p > plim[1])
-                    {
-                        ids[j*r.sx + i] = -2;
                         break;
-                    }
                 }
+                if (lim && k < npara)
+                    continue;
+                cand[(j/step)*lw + i/step] = 1;
+                // generate the cells within reach of the candidate
+                for (dj = 1-tol; dj < tol; dj++)
+                {
+                    int w = tol - 1 - abs(dj);
+                    visitCellRow(&cs, i-w, i+w, j+dj);
+                }
+            }
+        }
+
+        // Follow the matching cells outwards, generating everything within
+        // joining distance of them, until all the components are complete.
+        while (cs.qn > 0 && !(stop && *stop))
+        {
+            k = cs.queue[--cs.qn];
+            i = k % r.sx;
+            j = k / r.sx;
+            for (dj = -tol; dj <= tol; dj++)
+            {
+                int w = tol - abs(dj);
+                visitCellRow(&cs, i-w, i+w, j+dj);
             }
         }
-        match = -1; // id entries that are still -1 are our candidates
     }
     else // 1.17-
     {
-        int ts = 32 / r.scale;
-        if (r.sx + r.sz < 32)
-            ts = 8;
-
+        memset(ids, -1, cells * sizeof(int));
         int tx = (int) floor(r.x / (double)ts);
         int tz = (int) floor(r.z / (double)ts);
         int tw = (int) ceil((r.x+r.sx) / (double)ts) - tx;
@@ -4542,7 +6413,6 @@ int getBiomeCenters(Pos *pos, int *siz, int nmax, Generator *g, Range r,
         //applySeed(g, 0, g->seed);
 
         Range tr = { r.scale, 0, 0, ts, ts, 0, 1 };
-        int *cache = allocCache(g, r);
 
         for (tj = 0; tj < th; tj++)
         {
@@ -4572,38 +6442,92 @@ int getBiomeCenters(Pos *pos, int *siz, int nmax, Generator *g, Range r,
                 }
             }
         }
-        free(cache);
+
+        for (j = 0; j < r.sz; j += step)
+            for (i = 0; i < r.sx; i += step)
+                cand[(j/step)*lw + i/step] = 1;
     }
 
     applySeed(g, DIM_OVERWORLD, g->seed);
+    if ((stop && *stop) ||
+        labelComponents(parent, ids, r.sx, r.sz, match, tol, stop))
+        goto L_end;
+
+    // Give the components that are reached from the candidate cells on the
+    // seeding lattice a slot, in the order in which they are reported. The
+    // biome map is no longer needed and maps the roots to their slots.
+    int nc = 0, cap, s, s0, s1;
+    for (k = 0; k < (int)cells; k++)
+        ids[k] = -1;
     for (j = 0; j < r.sz; j += step)
     {
         for (i = 0; i < r.sx; i += step)
         {
-            if (stop && *stop)
-                break;
-            if (ids[j*r.sx + i] != match)
+            if (!cand[(j/step)*lw + i/step])
                 continue;
-            Pos center;
-            int area = floodFillGen(&info, i, j, &center);
-            if (area >= minsiz)
+            for (dj = 1-tol; dj < tol; dj++)
             {
-                pos[n] = center;
-                if (siz) siz[n] = area;
-                if (++n >= nmax)
-                    goto L_end;
+                int w = tol - 1 - abs(dj);
+                for (di = -w; di <= w; di++)
+                {
+                    int ii = i + di, jj = j + dj;
+                    if (ii < 0 || ii >= r.sx || jj < 0 || jj >= r.sz)
+                        continue;
+                    int root = parent[jj*r.sx + ii];
+                    if (root >= 0 && ids[root] < 0)
+                        ids[root] = nc++;
+                }
             }
         }
     }
+    // Map each cell to the slot of its component. The roots are the first
+    // cells of their components, so this works in place.
+    for (k = 0; k < (int)cells; k++)
+        ids[k] = parent[k] >= 0 ? ids[parent[k]] : -1;
+
+    // The labels are free now and hold the statistics of the slots. This
+    // takes a few passes at most, since the components are separated by gaps
+    // and there are fewer of them than half of the cells.
+    CompStat *comp = (CompStat*) parent;
+    cap = nparent * sizeof(int) / sizeof(CompStat);
+    for (s0 = 0; s0 < nc && n < nmax; s0 = s1)
+    {
+        if (stop && *stop)
+            break;
+        s1 = nc - s0 < cap ? nc : s0 + cap;
+        memset(comp, 0, (s1 - s0) * sizeof(*comp));
+        for (k = 0; k < (int)cells; k++)
+        {
+            s = ids[k];
+            if (s < s0 || s >= s1)
+                continue;
+            CompStat *c = &comp[s - s0];
+            c->area++;
+            c->sumx += r.x + k % r.sx;
+            c->sumz += r.z + k / r.sx;
+        }
+        for (s = s0; s < s1 && n < nmax; s++)
+        {
+            CompStat *c = &comp[s - s0];
+            int area = c->area;
+            if (area < minsiz)
+                continue;
+            pos[n].x = (int) round((c->sumx / (double)area + 0.5) * r.scale);
+            pos[n].z = (int) round((c->sumz / (double)area + 0.5) * r.scale);
+            if (siz) siz[n] = area;
+            n++;
+        }
+    }
 
 L_end:
-    free(ids);
+    free(mem);
 
     return n;
 }
 
 
-int canBiomeGenerate(int layerId, int mc, uint32_t flags, int id)
+/// Returns -1 if the layer is not supported for the version.
+static int _canBiomeGenerate(int layerId, int mc, uint32_t flags, int id)
 {
     int dofilter = 0;
 
@@ -4714,16 +6638,145 @@ int canBiomeGenerate(int layerId, int mc, uint32_t flags, int id)
     }
 
     if (!dofilter && layerId != L_VORONOI_1)
+        return -1;
+    return isOverworld(mc, id);
+}
+
+struct _gp_args
+{
+    uint64_t *mL, *mM;
+    int mc;
+    uint32_t flags;
+    struct BiomeGenTable *tab;  // memoized lookups, NULL to recurse fully
+    int quiet;  // record unsupported layers in err instead of printing
+    int err;
+};
+
+static void _genPotential(struct _gp_args *a, int layer, int id);
+static void _genPotentialStep(struct _gp_args *a, int layer, int id);
+
+enum { GP_DONE = 1, GP_ERR = 2, GP_SLOTS = 16 };
+
+/// Cached results of canBiomeGenerate() and genPotential() for the biome IDs
+/// [0,256) of one version and FORCE_OCEAN_VARIANTS setting. The tables are
+/// built once on first use and are read-only afterwards.
+STRUCT(BiomeGenTable)
+{
+    uint64_t can[L_NUM][4];
+    uint64_t bad[L_NUM][4];  // IDs for which the layer is unsupported
+    uint64_t pot[GP_SLOTS][256][2];
+    uint8_t potstat[GP_SLOTS][256];
+};
+
+static BiomeGenTable *volatile g_biome_gen[MC_NEWEST+1][2];
+
+/// Maps the entry layers of genPotential() onto table slots.
+static int getPotentialSlot(int layer)
+{
+    switch (layer)
+    {
+    case L_SPECIAL_1024:    return 0;
+    case L_MUSHROOM_256:    return 1;
+    case L_DEEP_OCEAN_256:  return 2;
+    case L_BIOME_256:       return 3;
+    case L_BAMBOO_256:      return 4;
+    case L_ZOOM_64:         return 5;
+    case L_BIOME_EDGE_64:   return 6;
+    case L_HILLS_64:        return 7;
+    case L_SUNFLOWER_64:    return 8;
+    case L_ZOOM_16:         return 9;
+    case L_SHORE_16:        return 10;
+    case L_SWAMP_RIVER_16:  return 11;
+    case L_ZOOM_4:          return 12;
+    case L_RIVER_MIX_4:     return 13;
+    case L_OCEAN_MIX_4:     return 14;
+    case L_VORONOI_1:       return 15;
+    default:                return -1;
+    }
+}
+
+/// Fills in the genPotential() entry for (layer, id) and its dependencies.
+static const uint64_t *getPotentialEntry(BiomeGenTable *tab, int slot,
+    int layer, int mc, uint32_t flags, int id)
+{
+    uint64_t *pot = tab->pot[slot][id];
+    if (!tab->potstat[slot][id])
+    {
+        struct _gp_args args = { pot, pot+1, mc, flags, tab, 1, 0 };
+        pot[0] = pot[1] = 0;
+        _genPotentialStep(&args, layer, id);
+        tab->potstat[slot][id] = GP_DONE | (args.err ? GP_ERR : 0);
+    }
+    return pot;
+}
+
+static void buildBiomeGenTable(BiomeGenTable *tab, int mc, uint32_t flags)
+{
+    int layer, id, slot;
+    for (layer = 0; layer < L_NUM; layer++)
+    {
+        for (id = 0; id < 256; id++)
+        {
+            int c = _canBiomeGenerate(layer, mc, flags, id);
+            if (c < 0)
+                tab->bad[layer][id >> 6] |= 1ULL << (id & 63);
+            else if (c)
+                tab->can[layer][id >> 6] |= 1ULL << (id & 63);
+        }
+    }
+    for (layer = 0; layer < L_NUM; layer++)
+    {
+        if ((slot = getPotentialSlot(layer)) < 0)
+            continue;
+        for (id = 0; id < 256; id++)
+            getPotentialEntry(tab, slot, layer, mc, flags, id);
+    }
+}
+
+/// Gets the shared table for the version, building it on first use. Threads
+/// that race on the first use each build a table and only one is published.
+static const BiomeGenTable *getBiomeGenTable(int mc, uint32_t flags)
+{
+    BiomeGenTable *tab, *cur;
+    int o = (flags & FORCE_OCEAN_VARIANTS) != 0;
+
+    if (mc < 0 || mc > MC_NEWEST)
+        return NULL;
+    if ((tab = g_biome_gen[mc][o]) != NULL)
+        return tab;
+    if (!(tab = (BiomeGenTable*) calloc(1, sizeof(*tab))))
+        return NULL;
+    buildBiomeGenTable(tab, mc, flags & FORCE_OCEAN_VARIANTS);
+    cur = (BiomeGenTable*) parallelSetOnce((void *volatile*) &g_biome_gen[mc][o], tab);
+    if (cur != tab)
+        free(tab);
+    return cur;
+}
+
+int canBiomeGenerate(int layerId, int mc, uint32_t flags, int id)
+{
+    const BiomeGenTable *tab;
+    int c;
+
+    if (id >= 0 && id < 256 && layerId >= 0 && layerId < L_NUM &&
+        (tab = getBiomeGenTable(mc, flags)) != NULL &&
+        !(tab->bad[layerId][id >> 6] & (1ULL << (id & 63))))
+    {
+        return (tab->can[layerId][id >> 6] >> (id & 63)) & 1;
+    }
+    c = _canBiomeGenerate(layerId, mc, flags, id);
+    if (c < 0)
     {
         printf("canBiomeGenerate(): unsupported layer (%d) or version (%d)\n",
             layerId, mc);
         return 0;
     }
-    return isOverworld(mc, id);
+    return c;
 }
 
 void getAvailableBiomes(uint64_t *mL, uint64_t *mM, int layerId, int mc, uint32_t flags)
 {
+    const BiomeGenTable *tab;
     *mL = *mM = 0;
     int i;
     if (mc <= MC_B1_7 || mc >= MC_1_18)
@@ -4745,31 +6798,63 @@ void getAvailableBiomes(uint64_t *mL, uint64_t *mM, int layerId, int mc, uint32_
             (1ULL << lukewarm_ocean) |
             (1ULL << cold_ocean);
     }
+    else if (layerId >= 0 && layerId < L_NUM &&
+        (tab = getBiomeGenTable(mc, flags)) != NULL &&
+        !tab->bad[layerId][0] && !tab->bad[layerId][2])
+    {
+        *mL = tab->can[layerId][0];
+        *mM = tab->can[layerId][2];
+    }
     else
     {
         for (i = 0; i < 64; i++)
         {
-            if (canBiomeGenerate(layerId, mc, i, flags))
+            if (canBiomeGenerate(layerId, mc, flags, i))
                 *mL |= (1ULL << i);
-            if (canBiomeGenerate(layerId, mc, i+128, flags))
+            if (canBiomeGenerate(layerId, mc, flags, i+128))
                 *mM |= (1ULL << i);
         }
     }
 }
 
-struct _gp_args
+static void _genPotential(struct _gp_args *a, int layer, int id)
 {
-    uint64_t *mL, *mM;
-    int mc;
-    uint32_t flags;
-};
+    int mc = a->mc;
+    int slot;
 
-static void _genPotential(struct _gp_args *a, int layer, int id)
+    if (a->tab && id >= 0 && id < 256 && (slot = getPotentialSlot(layer)) >= 0)
+    {
+        const uint64_t *pot = getPotentialEntry(a->tab, slot, layer, mc, a->flags, id);
+        *a->mL |= pot[0];
+        *a->mM |= pot[1];
+        if (a->tab->potstat[slot][id] & GP_ERR)
+            a->err = 1;
+        return;
+    }
+    _genPotentialStep(a, layer, id);
+}
+
+static void _genPotentialStep(struct _gp_args *a, int layer, int id)
 {
     int mc = a->mc;
+
     // filter out bad biomes
-    if (layer >= L_BIOME_256 && !canBiomeGenerate(layer, mc, a->flags, id))
-        return;
+    if (layer >= L_BIOME_256)
+    {
+        int c = _canBiomeGenerate(layer, mc, a->flags, id);
+        if (c < 0)
+        {
+            if (a->quiet)
+            {
+                a->err = 1;
+                return;
+            }
+            printf("canBiomeGenerate(): unsupported layer (%d) or version (%d)\n",
+                layer, mc);
+        }
+        if (c <= 0)
+            return;
+    }
 
     switch (layer)
     {
@@ -5034,24 +7119,42 @@ static void _genPotential(struct _gp_args *a, int layer, int id)
         break;
 
     default:
-        printf("genPotential() not implemented for layer %d\n", layer);
+        if (a->quiet)
+            a->err = 1;
+        else
+            printf("genPotential() not implemented for layer %d\n", layer);
     }
     if (0)
     {
     L_bad_layer:
-        printf("genPotential() bad layer %d for version\n", layer);
+        if (a->quiet)
+            a->err = 1;
+        else
+            printf("genPotential() bad layer %d for version\n", layer);
     }
 }
 
 void genPotential(uint64_t *mL, uint64_t *mM, int layerId, int mc, uint32_t flags, int id)
 {
-    struct _gp_args args = { mL, mM, mc, flags };
+    struct _gp_args args = { mL, mM, mc, flags, NULL, 0, 0 };
+    const BiomeGenTable *tab = getBiomeGenTable(mc, flags);
+
+    // The table is read-only once published, so a failed lookup falls back to
+    // the full recursion, which also reports unsupported layers.
+    args.tab = (BiomeGenTable*) tab;
+    args.quiet = 1;
     _genPotential(&args, layerId, id);
+    if (args.err || !tab)
+    {
+        struct _gp_args full = { mL, mM, mc, flags, NULL, 0, 0 };
+        _genPotential(&full, layerId, id);
+    }
 }
 
 
-double getParaDescent(const DoublePerlinNoise *para, double factor,
-    int x, int z, int w, int h, int i0, int j0, int maxrad,
+/// Descent from (i0,j0), where 's0' is the noise value sampled at the start.
+static double paraDescentFrom(const DoublePerlinNoise *para, double factor,
+    double s0, int x, int z, int w, int h, int i0, int j0, int maxrad,
     int maxiter, double alpha, void *data, int (*func)(void*,int,int,double))
 {
     /// Do a gradient descent on a grid...
@@ -5074,7 +7177,7 @@ double getParaDescent(const DoublePerlinNoise *para, double factor,
     int dirx = 0, dirz = 0, dira;
     int k, i, j;
     double v, vd, va;
-    v = factor * sampleDoublePerlin(para, x+i0, 0, z+j0);
+    v = factor * s0;
     if (func)
     {
         if (func(data, x+i0, z+j0, factor < 0 ? -v : v))
@@ -5184,17 +7287,208 @@ double getParaDescent(const DoublePerlinNoise *para, double factor,
     return v;
 }
 
+double getParaDescent(const DoublePerlinNoise *para, double factor,
+    int x, int z, int w, int h, int i0, int j0, int maxrad,
+    int maxiter, double alpha, void *data, int (*func)(void*,int,int,double))
+{
+    double s0 = sampleDoublePerlin(para, x+i0, 0, z+j0);
+    return paraDescentFrom(para, factor, s0, x, z, w, h, i0, j0, maxrad,
+        maxiter, alpha, data, func);
+}
+
+
+STRUCT(ParaRangeJobs)
+{
+    const DoublePerlinNoise *para;
+    int x, z, w, h;
+    int findmin, findmax;
+    int step, ww, hh, maxrad, maxiter;
+    double factor, beta, dr, vdif;
+    double vmin, vmax;
+    volatile char *skip;
+    void *data;
+    int (*func)(void*,int,int,double);
+    void *cbdata;
+    int (*cb)(void*,int,int,double);
+    int sign;
+    volatile int next;
+    volatile int lock;  // guards vmin, vmax and err
+    volatile int flock; // serializes the user callback
+    volatile int err;
+};
+
+/// Callback wrapper used with several threads: the user function is never
+/// entered concurrently, and an abort in any thread stops all the others.
+static int f_para_serial(void *data, int x, int z, double v)
+{
+    ParaRangeJobs *jobs = (ParaRangeJobs*) data;
+    int e = jobs->err;
+    if (e)
+        return e;
+    parallelLock(&jobs->flock);
+    e = jobs->err;
+    if (!e)
+        e = jobs->func(jobs->data, x, z, v);
+    parallelUnlock(&jobs->flock);
+    return e;
+}
+
+static void setParaErr(ParaRangeJobs *jobs, int err)
+{
+    parallelLock(&jobs->lock);
+    if (!jobs->err)
+        jobs->err = err;
+    parallelUnlock(&jobs->lock);
+}
+
+static void updateParaBounds(ParaRangeJobs *jobs, double vmin, double vmax)
+{
+    parallelLock(&jobs->lock);
+    if (vmin < jobs->vmin) jobs->vmin = vmin;
+    if (vmax > jobs->vmax) jobs->vmax = vmax;
+    parallelUnlock(&jobs->lock);
+}
+
+/// First pass: descents from a coarse grid, one grid row per job. The start
+/// points of a row are sampled together, and each sample is shared by the
+/// minimum and maximum descents.
+static void getParaCoarseWorker(void *arg, int t)
+{
+    ParaRangeJobs *jobs = (ParaRangeJobs*) arg;
+    const DoublePerlinNoise *para = jobs->para;
+    int x = jobs->x, z = jobs->z, w = jobs->w, h = jobs->h;
+    int step = jobs->step;
+    int i, j, k, n;
+    double v, row[256];
+    (void) t;
+
+    while (!jobs->err && (j = parallelNext(&jobs->next)) < (h+step-1) / step)
+    {
+        j *= step;
+        for (i = 0; i < w; i += step)
+        {
+            k = (i / step) % 256;
+            if (k == 0)
+            {
+                n = (w - i + step-1) / step;
+                if (n > 256) n = 256;
+                sampleDoublePerlinRow(para, row, x+i, step, z+j, n);
+            }
+            if (jobs->err)
+                return;
+            if (jobs->findmin)
+            {
+                v = paraDescentFrom(para, +jobs->factor, row[k], x, z, w, h,
+                    i, j, step, step, jobs->dr, jobs->cbdata, jobs->cb);
+                if (v != v) goto L_abort;
+                updateParaBounds(jobs, v, -DBL_MAX);
+            }
+            if (jobs->findmax)
+            {
+                v = -paraDescentFrom(para, -jobs->factor, row[k], x, z, w, h,
+                    i, j, step, step, jobs->dr, jobs->cbdata, jobs->cb);
+                if (v != v) goto L_abort;
+                updateParaBounds(jobs, DBL_MAX, v);
+            }
+        }
+    }
+    return;
+L_abort:
+    setParaErr(jobs, 1);
+}
+
+/// Second pass: checks the fine grid for minima (sign=+1) or maxima (sign=-1),
+/// one grid row per job. Rows are handed out in order, so the skip marks of
+/// the preceding rows are usually in place by the time a row is processed.
+static void getParaGridWorker(void *arg, int t)
+{
+    ParaRangeJobs *jobs = (ParaRangeJobs*) arg;
+    const DoublePerlinNoise *para = jobs->para;
+    int x = jobs->x, z = jobs->z, w = jobs->w, h = jobs->h;
+    int step = jobs->step, ww = jobs->ww, hh = jobs->hh;
+    double factor = jobs->sign * jobs->factor;
+    int i, j, ii, jj, e;
+    double v, vb, dr;
+    (void) t;
+
+    while (!jobs->err && (jj = parallelNext(&jobs->next)) <= hh)
+    {
+        j = jj * step; if (j >= h) j = h-1;
+        for (ii = 0; ii <= ww; ii++)
+        {
+            if (jobs->err)
+                return;
+            i = ii * step; if (i >= w) i = w-1;
+            if (jobs->skip[jj*ww+ii]) continue;
+
+            v = factor * sampleDoublePerlin(para, x+i, 0, z+j);
+            if (jobs->cb)
+            {
+                e = jobs->cb(jobs->cbdata, x+i, z+j, jobs->sign * v);
+                if (e)
+                {
+                    setParaErr(jobs, e);
+                    return;
+                }
+            }
+
+            parallelLock(&jobs->lock);
+            if (jobs->sign > 0)
+            {   // not looking for maxima yet, but update the bounds anyway
+                if (jobs->findmax && v > jobs->vmax) jobs->vmax = v;
+                vb = jobs->vmin;
+            }
+            else
+            {
+                vb = -jobs->vmax;
+            }
+            parallelUnlock(&jobs->lock);
+
+            dr = jobs->beta * (v - vb) / jobs->vdif;
+            if (dr > 1.0)
+            {   // difference is too large -> mark visinity to be skipped
+                int a, b, r = (int) dr;
+                for (b = 0; b < r; b++)
+                {
+                    if (b+jj < 0 || b+jj >= hh) continue;
+                    for (a = -r+1; a < r; a++)
+                    {
+                        if (a+ii < 0 || a+ii >= ww) continue;
+                        jobs->skip[(b+jj)*ww + (a+ii)] = 1;
+                    }
+                }
+                continue;
+            }
+            v = getParaDescent(para, factor, x, z, w, h, i, j,
+                jobs->maxrad, jobs->maxiter, dr, jobs->cbdata, jobs->cb);
+            if (v != v)
+            {
+                setParaErr(jobs, 1);
+                return;
+            }
+            if (jobs->sign > 0)
+                updateParaBounds(jobs, v, -DBL_MAX);
+            else
+                updateParaBounds(jobs, DBL_MAX, -v);
+        }
+    }
+}
 
 int getParaRange(const DoublePerlinNoise *para, double *pmin, double *pmax,
     int x, int z, int w, int h, void *data, int (*func)(void*,int,int,double))
 {
-    const double beta = 1.5;
+    return getParaRangeParallel(para, pmin, pmax, x, z, w, h, data, func, 1);
+}
+
+int getParaRangeParallel(const DoublePerlinNoise *para,
+    double *pmin, double *pmax, int x, int z, int w, int h,
+    void *data, int (*func)(void*,int,int,double), int threads)
+{
     const double factor = 10000;
     const double perlin_grad = 2.0 * 1.875; // max perlin noise gradient
-    double v, lmin, lmax, dr, vdif, small_regime;
-    char *skip = NULL;
-    int i, j, step, ii, jj, ww, hh, skipsiz;
-    int maxrad, maxiter;
+    ParaRangeJobs jobs;
+    double v, lmin, lmax, small_regime;
+    int i, j, skipsiz;
     int err = 1;
 
     if (pmin) *pmin = DBL_MAX;
@@ -5213,11 +7507,17 @@ int getParaRange(const DoublePerlinNoise *para, double *pmin, double *pmax,
     small_regime = 1e3 * sqrt(lmax);
     if (w*h < small_regime)
     {
+        double row[256];
         for (j = 0; j < h; j++)
         {
             for (i = 0; i < w; i++)
             {
-                v = factor * sampleDoublePerlin(para, x+i, 0, z+j);
+                if (i % 256 == 0)
+                {
+                    int n = w - i < 256 ? w - i : 256;
+                    sampleDoublePerlinRow(para, row, x+i, 1, z+j, n);
+                }
+                v = factor * row[i % 256];
                 if (func)
                 {
                     err = func(data, x+i, z+j, v);
@@ -5231,163 +7531,96 @@ int getParaRange(const DoublePerlinNoise *para, double *pmin, double *pmax,
         return 0;
     }
 
-    // Start with the largest noise period to get some bounds for pmin, pmax
-    step = (int) (0.5 / lmin - FLT_EPSILON) + 1;
-
-    dr = lmax / lmin * beta;
-    for (j = 0; j < h; j += step)
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.para = para;
+    jobs.x = x;
+    jobs.z = z;
+    jobs.w = w;
+    jobs.h = h;
+    jobs.findmin = pmin != NULL;
+    jobs.findmax = pmax != NULL;
+    jobs.factor = factor;
+    jobs.beta = 1.5;
+    jobs.vmin = DBL_MAX;
+    jobs.vmax = -DBL_MAX;
+    jobs.data = data;
+    jobs.func = func;
+    if (threads > 1 && func)
+    {
+        jobs.cbdata = &jobs;
+        jobs.cb = f_para_serial;
+    }
+    else
     {
-        for (i = 0; i < w; i += step)
-        {
-            if (pmin)
-            {
-                v = getParaDescent(para, +factor, x, z, w, h, i, j,
-                    step, step, dr, data, func);
-                if (v != v) goto L_end;
-                if (v < *pmin) *pmin = v;
-            }
-            if (pmax)
-            {
-                v = -getParaDescent(para, -factor, x, z, w, h, i, j,
-                    step, step, dr, data, func);
-                if (v != v) goto L_end;
-                if (v > *pmax) *pmax = v;
-            }
-        }
+        jobs.cbdata = data;
+        jobs.cb = func;
     }
 
-    //(*(double*)data) = -1e9+1; // testing
+    // Start with the largest noise period to get some bounds for pmin, pmax
+    jobs.step = (int) (0.5 / lmin - FLT_EPSILON) + 1;
+    jobs.dr = lmax / lmin * jobs.beta;
+    runParallel(threads, getParaCoarseWorker, &jobs);
+    if (jobs.err)
+        goto L_end;
 
-    step = (int) (1.0 / (perlin_grad * lmax + FLT_EPSILON)) + 1;
+    jobs.step = (int) (1.0 / (perlin_grad * lmax + FLT_EPSILON)) + 1;
 
     /// We can determine the maximum contribution we expect from all noise
     /// periods for a distance of step. If this does not account for the
     /// necessary difference, we can skip that point.
-    vdif = 0;
+    jobs.vdif = 0;
     for (i = 0; i < para->octA.octcnt; i++)
     {
         const PerlinNoise *p = para->octA.octaves + i;
-        double contrib = step * p->lacunarity * 1.0;
+        double contrib = jobs.step * p->lacunarity * 1.0;
         if (contrib > 1.0) contrib = 1;
-        vdif += contrib * p->amplitude;
+        jobs.vdif += contrib * p->amplitude;
     }
     for (i = 0; i < para->octB.octcnt; i++)
     {
         const double lac_factB = 337.0 / 331.0;
         const PerlinNoise *p = para->octB.octaves + i;
-        double contrib = step * p->lacunarity * lac_factB;
+        double contrib = jobs.step * p->lacunarity * lac_factB;
         if (contrib > 1.0) contrib = 1;
-        vdif += contrib * p->amplitude;
+        jobs.vdif += contrib * p->amplitude;
     }
-    vdif = fabs(factor * vdif * para->amplitude);
-    //printf("%g %g %g\n", para->amplitude, 1./lmin, 1./lmax);
-    //printf("first pass: [%g %g] diff=%g step:%d\n", *pmin, *pmax, vdif, step);
+    jobs.vdif = fabs(jobs.factor * jobs.vdif * para->amplitude);
 
-    maxrad = step;
-    maxiter = step*2;
-    ww = (w+step-1) / step;
-    hh = (h+step-1) / step;
-    skipsiz = (ww+1) * (hh+1) * sizeof(*skip);
-    skip = (char*) malloc(skipsiz);
+    jobs.maxrad = jobs.step;
+    jobs.maxiter = jobs.step*2;
+    jobs.ww = (w+jobs.step-1) / jobs.step;
+    jobs.hh = (h+jobs.step-1) / jobs.step;
+    skipsiz = (jobs.ww+1) * (jobs.hh+1) * sizeof(*jobs.skip);
+    jobs.skip = (volatile char*) malloc(skipsiz);
+    if (!jobs.skip)
+        goto L_end;
 
     if (pmin)
     {   // look for minima
-        memset(skip, 0, skipsiz);
-
-        for (jj = 0; jj <= hh; jj++)
-        {
-            j = jj * step; if (j >= h) j = h-1;
-            for (ii = 0; ii <= ww; ii++)
-            {
-                i = ii * step; if (i >= w) i = w-1;
-                if (skip[jj*ww+ii]) continue;
-
-                v = factor * sampleDoublePerlin(para, x+i, 0, z+j);
-                if (func)
-                {
-                    int e = func(data, x+i, z+j, v);
-                    if (e)
-                    {
-                        err = e;
-                        goto L_end;
-                    }
-                }
-                // not looking for maxima yet, but update the bounds anyway
-                if (pmax && v > *pmax) *pmax = v;
-
-                dr = beta * (v - *pmin) / vdif;
-                if (dr > 1.0)
-                {   // difference is too large -> mark visinity to be skipped
-                    int a, b, r = (int) dr;
-                    for (b = 0; b < r; b++)
-                    {
-                        if (b+jj < 0 || b+jj >= hh) continue;
-                        for (a = -r+1; a < r; a++)
-                        {
-                            if (a+ii < 0 || a+ii >= ww) continue;
-                            skip[(b+jj)*ww + (a+ii)] = 1;
-                        }
-                    }
-                    continue;
-                }
-                v = getParaDescent(para, +factor, x, z, w, h, i, j,
-                    maxrad, maxiter, dr, data, func);
-                if (v != v) goto L_end;
-                if (v < *pmin) *pmin = v;
-            }
-        }
+        memset((char*) jobs.skip, 0, skipsiz);
+        jobs.sign = +1;
+        jobs.next = 0;
+        runParallel(threads, getParaGridWorker, &jobs);
+        if (jobs.err)
+            goto L_end;
     }
-
     if (pmax)
     {   // look for maxima
-        memset(skip, 0, skipsiz);
-
-        for (jj = 0; jj <= hh; jj++)
-        {
-            j = jj * step; if (j >= h) j = h-1;
-            for (ii = 0; ii <= ww; ii++)
-            {
-                i = ii * step; if (i >= w) i = w-1;
-                if (skip[jj*ww+ii]) continue;
-
-                v = -factor * sampleDoublePerlin(para, x+i, 0, z+j);
-                if (func)
-                {
-                    int e = func(data, x+i, z+j, -v);
-                    if (e)
-                    {
-                        err = e;
-                        goto L_end;
-                    }
-                }
-
-                dr = beta * (v + *pmax) / vdif;
-                if (dr > 1.0)
-                {   // difference too large -> mark visinity to be skipped
-                    int a, b, r = (int) dr;
-                    for (b = 0; b < r; b++)
-                    {
-                        if (b+jj < 0 || b+jj >= hh) continue;
-                        for (a = -r+1; a < r; a++)
-                        {
-                            if (a+ii < 0 || a+ii >= ww) continue;
-                            skip[(b+jj)*ww + (a+ii)] = 1;
-                        }
-                    }
-                    continue;
-                }
-                v = -getParaDescent(para, -factor, x, z, w, h, i, j,
-                    maxrad, maxiter, dr, data, func);
-                if (v != v) goto L_end;
-                if (v > *pmax) *pmax = v;
-            }
-        }
+        memset((char*) jobs.skip, 0, skipsiz);
+        jobs.sign = -1;
+        jobs.next = 0;
+        runParallel(threads, getParaGridWorker, &jobs);
+        if (jobs.err)
+            goto L_end;
     }
 
     err = 0;
 L_end:
-    if (skip)
-        free(skip);
+    if (jobs.err)
+        err = jobs.err;
+    if (pmin) *pmin = jobs.vmin;
+    if (pmax) *pmax = jobs.vmax;
+    free((char*) jobs.skip);
     return err;
 }
 
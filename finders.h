@@ -216,6 +216,26 @@ int getStructureConfig_override(int stype, int mc, StructureConfig *sconf);
  */
 int getStructurePos(int structureType, int mc, uint64_t seed, int regX, int regZ, Pos *pos);
 
+/* Finds the structure generation attempts for a rectangle of regions at once.
+ * The positions are written in row-major order (regW * regH entries) and are
+ * the same as those of getStructurePos(), but the structure configuration is
+ * only looked up once and the region seeds are stepped along each row.
+ *
+ * @structureType   : structure type
+ * @mc              : minecraft version
+ * @seed            : world seed (only the lower 48-bits are relevant)
+ * @regX,regZ       : first region coordinates
+ * @regW,regH       : number of regions along x and z
+ * @pos             : output block positions, regW * regH entries
+ * @valid           : output validity of each attempt, as getStructurePos()
+ *                    would return it (nullable)
+ *
+ * Returns the number of valid positions, or -1 if the version does not
+ * support the structure type.
+ */
+int getStructurePosGrid(int structureType, int mc, uint64_t seed,
+    int regX, int regZ, int regW, int regH, Pos *pos, char *valid);
+
 /* The inline functions below get the generation attempt position given a
  * structure configuration. Most small structures use the getFeature..
  * variants, which have a uniform distribution, while large structures
@@ -303,6 +323,20 @@ Pos initFirstStronghold(StrongholdIter *sh, int mc, uint64_t s48);
  */
 int nextStronghold(StrongholdIter *sh, const Generator *g);
 
+/* Finds the accurate locations of the first 'n' strongholds in the world
+ * (128 for 1.9+ and 3 before). From 1.19.3 onwards the biome searches of the
+ * strongholds are independent of one another and get distributed over the
+ * given number of threads. Earlier versions are iterated sequentially.
+ *
+ * @out     : output buffer for at least 'n' stronghold positions
+ * @n       : maximum number of strongholds to locate
+ * @g       : generator, initialized for Overworld generation with a seed
+ * @threads : number of threads to use
+ *
+ * Returns the number of positions written, or -1 on allocation failure.
+ */
+int getStrongholds(Pos *out, int n, const Generator *g, int threads);
+
 
 /* Finds the approximate spawn point in the world.
  * The random state 'rng' output can be NULL to ignore.
@@ -356,6 +390,17 @@ static inline uint64_t getShadow(uint64_t seed)
  */
 int isViableStructurePos(int structType, Generator *g, int blockX, int blockZ, uint32_t flags);
 
+/* Batched version of isViableStructurePos() for 'n' block positions. The
+ * result for each position is written to 'viable' as 0 or 1, and the number
+ * of viable positions is returned.
+ * For the 1.18+ Overworld, structures that are decided by a single biome
+ * sample reject most positions from a partial climate sample, using the
+ * parameter limits of the biomes the structure accepts. Other positions, as
+ * well as other versions and dimensions, use the full check.
+ */
+int areViableStructurePos(int structType, Generator *g, const Pos *pos, int n,
+        uint32_t flags, char *viable);
+
 /* Checks if the specified structure type could generate in the given biome.
  */
 int isViableFeatureBiome(int mc, int structureType, int biomeID);
@@ -378,6 +423,122 @@ int isViableEndCityTerrain(const Generator *g, const SurfaceNoise *sn,
         int blockX, int blockZ);
 
 
+//==============================================================================
+// Slime Chunk Clusters
+//==============================================================================
+
+STRUCT(SlimeSpot)
+{
+    int sidx;       // index of the seed in the searched seed list
+    int x, z;       // chunk position of the spot
+    int count;      // number of slime chunks around the spot
+};
+
+/* Fills a row-major bitmap 'out' of size (chunkW x chunkH) with the slime
+ * chunks in the area starting at (chunkX, chunkZ), using the same test as
+ * isSlimeChunk(), but stepping through RNG_LANES chunks at a time. Returns
+ * the number of slime chunks in the area.
+ */
+int getSlimeChunks(uint64_t seed, int chunkX, int chunkZ, int chunkW,
+        int chunkH, char *out);
+
+/* Finds the 'k' chunk positions with the most slime chunks around them for
+ * a list of 'nseeds' seeds. Candidate positions lie within the chunk area
+ * starting at (chunkX, chunkZ) with size (chunkW, chunkH). For a positive
+ * 'radius' a candidate counts the slime chunks within that chunk distance
+ * (e.g. 8 for an AFK spot at the chunk center), otherwise it counts the
+ * rectangle of (sx x sz) chunks that has the candidate at its north-west
+ * corner. The work is split into strips of rows that are processed on up to
+ * 'threads' threads, each of which keeps its own 'k' best spots, so that
+ * the memory use does not grow with the number of seeds. The spots are
+ * written to 'out' ordered by descending count (ties go to the lower seed
+ * index, then lower z and x).
+ * Returns the number of spots written or -1 if an allocation failed.
+ */
+int findSlimeClusters(const uint64_t *seeds, int nseeds,
+        int chunkX, int chunkZ, int chunkW, int chunkH,
+        int sx, int sz, int radius, SlimeSpot *out, int k, int threads);
+
+
+//==============================================================================
+// Structure Index
+//==============================================================================
+
+/* A per-seed cache of structure generation attempts and their biome checks,
+ * keyed by structure type and region. The entries are filled lazily by the
+ * queries and live in a hash table of fixed capacity. When 'maxEntries' is
+ * reached the cache is cleared, bounding the memory use to roughly
+ * 2 * maxEntries * sizeof(StructureIndexEntry). The cached biome checks are
+ * discarded when the index is queried with a generator of different flags.
+ */
+STRUCT(StructureIndexEntry)
+{
+    int32_t regX, regZ;
+    Pos pos;
+    int8_t type;    // structure type, or -1 for an empty slot
+    int8_t valid;   // the attempt is valid (see getStructurePos())
+    int8_t viable;  // result of isViableStructurePos(), -1 if untested
+};
+
+STRUCT(StructureIndex)
+{
+    int mc;
+    uint64_t seed;
+    uint32_t flags; // generator flags of the cached viability results
+    StructureIndexEntry *entries;
+    size_t cap;
+    size_t count;
+    size_t maxEntries;
+};
+
+STRUCT(StructureLoc)
+{
+    int type;
+    Pos pos;
+};
+
+/* Initializes an empty index for a world seed. Use maxEntries = 0 for a
+ * default bound. Returns non-zero if the table could not be allocated.
+ */
+int initStructureIndex(StructureIndex *si, int mc, uint64_t seed,
+    size_t maxEntries);
+void freeStructureIndex(StructureIndex *si);
+void clearStructureIndex(StructureIndex *si);
+
+/* Finds the structures of the given types within a block area, including the
+ * bounds. The generator 'g' performs the biome checks and should match the
+ * version, seed and dimension of the structures. Types of other dimensions are
+ * skipped. If 'g' is NULL, all valid generation attempts are returned without
+ * biome checks.
+ * Returns the number of structures written to 'out' (at most 'nmax').
+ */
+int getStructuresInArea(StructureIndex *si, Generator *g,
+    const int *types, int ntypes, int x0, int z0, int x1, int z1,
+    StructureLoc *out, int nmax);
+
+/* Finds the 'k' nearest structures of the given types to the block position
+ * (x,z) and no further than 'maxdist', sorted by distance. The generator is
+ * used in the same way as for getStructuresInArea(). The search visits the
+ * regions of all the types in rings around (x,z), nearest rings first, and
+ * stops before the total number of visited regions would exceed half the
+ * index capacity (maxEntries / 2), so that it does not evict its own entries.
+ * If this budget runs out before the result is certain, '*truncated' (if not
+ * NULL) is set to 1 and the structures found so far are returned. These are
+ * the nearest ones up to the distance of the first ring that was skipped.
+ * Returns the number of structures written to 'out'.
+ */
+int getNearestStructures(StructureIndex *si, Generator *g,
+    const int *types, int ntypes, int x, int z, int maxdist,
+    StructureLoc *out, int k, int *truncated);
+
+/* Saves the cached entries to a file, or loads them into an index that was
+ * initialized for the same version and seed. The file uses the host byte
+ * order. Returns non-zero on failure.
+ */
+int saveStructureIndex(const StructureIndex *si, const char *path);
+int loadStructureIndex(StructureIndex *si, const char *path);
+
+
 //==============================================================================
 // Finding Properties of Structures
 //==============================================================================
@@ -462,6 +623,38 @@ enum
     PIECE_COUNT,
 };
 
+/* Reusable memory for generating the pieces of many structures, such as all
+ * the End Cities in a region. The pieces of a batch are stored one structure
+ * after another in 'pieces' and remain valid until the next batch. The piece
+ * buffer is reallocated as it grows, so pieces should be referred to by their
+ * index rather than by pointers that are kept across batches. The 'next'
+ * links of the generated pieces are always NULL.
+ */
+STRUCT(PieceArena)
+{
+    Piece *pieces;  // generated pieces
+    int cap;        // capacity of the piece buffer
+    void *grid;     // memory for the collision checks
+    int gridcap;
+};
+
+/* Allocates an arena with room for 'cap' pieces, which grows as needed.
+ * Returns 0 on success or -1 if the allocation failed.
+ */
+int initPieceArena(PieceArena *arena, int cap);
+void freePieceArena(PieceArena *arena);
+
+/* Generate the pieces of the End Cities or Nether Fortresses at the 'n'
+ * given chunk positions of a seed. The pieces of structure i are placed in
+ * arena->pieces from index offs[i] up to offs[i+1]-1, so 'offs' should have
+ * room for n+1 elements. Fortresses are not limited in their piece count.
+ * Returns the total number of pieces, or -1 if an allocation failed.
+ */
+int getEndCityPiecesBatch(PieceArena *arena, uint64_t seed,
+        const Pos *chunks, int n, int *offs);
+int getFortressPiecesBatch(PieceArena *arena, int mc, uint64_t seed,
+        const Pos *chunks, int n, int *offs);
+
 /* Find the 20 fixed inner positions where End Gateways generate upon defeating
  * the Dragon. The positions are written to 'src' in generation order.
  */
@@ -543,6 +736,31 @@ int monteCarloBiomes(
         void              * data
         );
 
+/* Variant of monteCarloBiomes() that draws the sampling positions in batches
+ * and evaluates each batch over multiple threads. The results are consumed in
+ * drawing order, such that the outcome and the final state of 'rng' are the
+ * same as for monteCarloBiomes(). With more than one thread, eval() is called
+ * concurrently and must not modify the generator or the shared data.
+ *
+ * @batch       : number of positions per batch (<= 0 for a default)
+ * @threads     : number of threads to use
+ *
+ * The return value is the same as for monteCarloBiomes(). With batch = 1 no
+ * batch buffers are needed, and if they cannot be allocated the positions
+ * are evaluated one by one instead.
+ */
+int monteCarloBiomesParallel(
+        Generator         * g,
+        Range               r,
+        uint64_t          * rng,
+        double              coverage,
+        double              confidence,
+        int (*eval)(Generator *g, int scale, int x, int y, int z, void *data),
+        void              * data,
+        int                 batch,
+        int                 threads
+        );
+
 
 //==============================================================================
 // Seed Filters (for versions up to 1.17)
@@ -569,7 +787,9 @@ void setupBiomeFilter(
  * The area will be generated inside the cache (if != NULL) but is only
  * defined if the generation was fully completed (check return value).
  * More aggressive filtering can be enabled with the flags which may yield
- * some false negatives in exchange for speed.
+ * some false negatives in exchange for speed. For 1.18+ Overworld ranges at
+ * scale 1:4, BF_APPROX samples only the center of each 4x4 tile that the
+ * climate bounds cannot rule out.
  *
  * The generator should be set up for the correct version, however the
  * dimension and seed will be applied internally. This will modify the
@@ -595,6 +815,30 @@ int checkForBiomes(
         volatile char     * stop // should be atomic, but is fine as stop flag
         );
 
+/* Reentrant variant of checkForBiomes() that does not use the global rand(),
+ * so that concurrent workers can each filter seeds with their own generator.
+ * The random sampling order is drawn from 'rng', which is a Java random state
+ * (e.g. from setSeed()). The working memory 'scratch' is provided by the
+ * caller and should have a size of at least getBiomeCheckScratchSize() bytes
+ * for the generator, range and dimension. If a 'cache' is given for the Beta
+ * or the layered (up to 1.17) Overworld generators, 'scratch' is not used.
+ * The only memory this function allocates is the temporary bitmap that
+ * getParaRange() uses on 1.18+, when the generator is restricted to a
+ * single noise parameter (nptype >= 0).
+ */
+int checkForBiomesR(
+        Generator         * g,
+        int               * cache,
+        Range               r,
+        int                 dim,
+        uint64_t            seed,
+        const BiomeFilter * filter,
+        uint64_t          * rng,
+        void              * scratch,
+        volatile char     * stop
+        );
+size_t getBiomeCheckScratchSize(const Generator *g, Range r, int dim);
+
 /* Specialization of checkForBiomes() for a LayerStack, i.e. the Overworld up
  * to 1.17.
  *
@@ -617,6 +861,58 @@ int checkForBiomesAtLayer(
         const BiomeFilter * filter
         );
 
+enum
+{   // checks of a compiled biome filter
+    BF_STAGE_SPECIAL,   // special climates at 1:1024 (BF_APPROX)
+    BF_STAGE_MUSHROOM,  // proto mushroom islands at 1:256 (BF_APPROX)
+    BF_STAGE_MAJOR,     // potential major biomes at 1:256 (BF_APPROX)
+    BF_STAGE_EXCLUDE,   // excluded biomes at a few sample points
+    BF_STAGE_FULL,      // filtered layer generation (always last)
+    BF_STAGE_MAX
+};
+
+/* A biome filter compiled for repeated use with checkForBiomesPlan(). The
+ * cheap pre-checks that apply to the filter are listed in 'stage' in the
+ * order they are run, and only the layers that have requirements get filter
+ * kernels during generation. The plan records how often each stage was run
+ * and how often it rejected a seed. With adaptive reordering the pre-checks
+ * are periodically sorted by their rejection rate relative to their cost,
+ * which does not change the results. The statistics make the plan mutable,
+ * so each thread should use its own copy.
+ */
+STRUCT(BiomeFilterPlan)
+{
+    BiomeFilter bf;
+    uint32_t layers;                // layers with filter kernels
+    int nstage;
+    int stage[BF_STAGE_MAX];        // pre-checks in order of evaluation
+    int cost[BF_STAGE_MAX];         // estimated cost of the last evaluation
+    uint64_t calls[BF_STAGE_MAX];
+    uint64_t rejects[BF_STAGE_MAX];
+    int adapt;                      // checks between reorderings (0: fixed)
+    int count;
+};
+
+/* Compiles the biome filter 'bf' (see setupBiomeFilter()) into a plan. A
+ * positive 'adapt' enables the reordering of the pre-checks after every
+ * 'adapt' seeds.
+ */
+void compileBiomeFilter(BiomeFilterPlan *plan, const BiomeFilter *bf, int adapt);
+
+/* Equivalent to checkForBiomesAtLayer() with the filter of a compiled plan.
+ */
+int checkForBiomesPlan(
+        BiomeFilterPlan   * plan,
+        LayerStack        * ls,
+        Layer             * entry,
+        int               * cache,
+        uint64_t            seed,
+        int                 x,
+        int                 z,
+        unsigned int        w,
+        unsigned int        h
+        );
+
 /* Checks that the area (x,z,w,h) at layer Special, scale 1:1024 contains the
  * temperature category requirements defined by 'tc' as:
  * if (tc[TEMP_CAT] >= 0) require at least this many entries of this category
@@ -635,7 +931,8 @@ int checkForTemps(LayerStack *g, uint64_t seed, int x, int z, int w, int h, cons
  * @r       : area to examine, requires: scale = 4, sy = 1
  * @match   : biome id to find
  * @minsiz  : minimum size of output biomes
- * @tol     : border tolerance
+ * @tol     : border tolerance, cells of the biome that are separated by a gap
+ *            of fewer than 'tol' cells belong to the same area
  * @stop    : stopping flag (nullable)
  * Returns the number of entries written to pos and siz.
  */
@@ -671,6 +968,10 @@ void genPotential(uint64_t *mL, uint64_t *mM, int layerId, int mc, uint32_t flag
  * L_OCEAN_TEMP_256 and 1.18+, where the layerId is ignored.
  * mL : for ids 0-63
  * mM : for ids 128-191
+ *
+ * The results of these three functions are looked up in tables that are
+ * built once per version (and FORCE_OCEAN_VARIANTS setting) on first use.
+ * The tables are shared between threads and are never freed.
  */
 void getAvailableBiomes(uint64_t *mL, uint64_t *mM, int layerId, int mc, uint32_t flags);
 
@@ -714,6 +1015,21 @@ double getParaDescent(const DoublePerlinNoise *para, double factor,
 int getParaRange(const DoublePerlinNoise *para, double *pmin, double *pmax,
     int x, int z, int w, int h, void *data, int (*func)(void*,int,int,double));
 
+/**
+ * Multi-threaded variant of getParaRange(). The area is processed in grid rows
+ * that are distributed over the given number of threads, which share the
+ * running bounds for pmin and pmax. The results carry the same guarantees as
+ * for getParaRange(), although the exact points visited can vary between runs
+ * with threads > 1.
+ * The optional func is never called concurrently, so it does not need to be
+ * thread-safe, but it may be called from any of the worker threads. If it
+ * returns non-zero, all threads stop and that error is returned.
+ * With threads <= 1 this is equivalent to getParaRange().
+ */
+int getParaRangeParallel(const DoublePerlinNoise *para,
+    double *pmin, double *pmax, int x, int z, int w, int h,
+    void *data, int (*func)(void*,int,int,double), int threads);
+
 /**
  * Gets the min/max parameter values within which a biome change can occur.
  */
@@ -1,5 +1,6 @@
 #include "generator.h"
 #include "layers.h"
+#include "parallel.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -131,7 +132,7 @@ void applySeed(Generator *g, int dim, uint64_t seed)
     {
         if (g->mc <= MC_1_17 && dim == DIM_OVERWORLD && !g->entry)
             g->sha = g->ls.entry_1->startSalt;
-        else
+        else if (!(g->flags & NO_VORONOI_SHA))
             g->sha = getVoronoiSHA(seed);
     }
 }
@@ -182,6 +183,10 @@ int genBiomes(const Generator *g, int *cache, Range r)
 {
     int err = 1;
     int64_t i, k;
+    uint64_t sha = g->sha;
+
+    if (r.scale == 1 && (g->flags & NO_VORONOI_SHA) && g->mc >= MC_1_15)
+        sha = getVoronoiSHA(g->seed); // was not computed by applySeed()
 
     if (g->dim == DIM_OVERWORLD)
     {
@@ -200,7 +205,7 @@ int genBiomes(const Generator *g, int *cache, Range r)
         }
         else if (g->mc >= MC_1_18)
         {
-            return genBiomeNoiseScaled(&g->bn, cache, r, g->sha);
+            return genBiomeNoiseScaled(&g->bn, cache, r, sha);
         }
         else // g->mc <= MC_B1_7
         {
@@ -225,11 +230,11 @@ int genBiomes(const Generator *g, int *cache, Range r)
     }
     else if (g->dim == DIM_NETHER)
     {
-        return genNetherScaled(&g->nn, cache, r, g->mc, g->sha);
+        return genNetherScaled(&g->nn, cache, r, g->mc, sha);
     }
     else if (g->dim == DIM_END)
     {
-        return genEndScaled(&g->en, cache, r, g->mc, g->sha);
+        return genEndScaled(&g->en, cache, r, g->mc, sha);
     }
 
     return err;
@@ -670,8 +675,23 @@ int mapApproxHeight(float *y, int *ids, const Generator *g, const SurfaceNoise *
     int64_t i, j;
     int ii, jj;
 
+    // The height search below samples each column at cell heights in [1, 32],
+    // so the level terms of the surface noise are prepared once for all
+    // columns and the column terms once for each column.
+    SurfaceNoiseLevel *lvl = (SurfaceNoiseLevel*) malloc(sizeof(*lvl) * 33);
+    SurfaceNoiseColumn col;
+
     Range r = {4, x-2, z-2, w+5, h+5, 0, 1};
     int *cache = allocCache(g, r);
+    if (!depth || !lvl || !cache)
+    {
+        free(cache);
+        free(lvl);
+        free(depth);
+        return -1;
+    }
+    for (ii = 0; ii <= 32; ii++)
+        initSurfaceNoiseLevel(&lvl[ii], sn, ii);
     genBiomes(g, cache, r);
 
     for (j = 0; j < h; j++)
@@ -726,6 +746,7 @@ int mapApproxHeight(float *y, int *ids, const Generator *g, const SurfaceNoise *
             if (off < 0) off *= 1./28;
             else off *= 1./40;
 
+            initSurfaceNoiseColumn(&col, sn, px, pz);
             double vmin = 0, vmax = 0;
             int ytest = 8, ymin = 0, ymax = 32;
             do
@@ -735,7 +756,7 @@ int mapApproxHeight(float *y, int *ids, const Generator *g, const SurfaceNoise *
                 for (k = 0; k < 2; k++)
                 {
                     int py = ytest + k;
-                    double n0 = sampleSurfaceNoise(sn, px, py, pz);
+                    double n0 = sampleSurfaceNoiseColumn(sn, &col, &lvl[py]);
                     double fall = 1 - 2 * py / 32.0 + off - 0.46875;
                     fall = scale[j*w+i] * (fall + depth[j*w+i]);
                     n0 += (fall > 0 ? 4*fall : fall);
@@ -762,12 +783,65 @@ int mapApproxHeight(float *y, int *ids, const Generator *g, const SurfaceNoise *
             y[j*w+i] = 8 * (vmin / (double)(vmin - vmax) + ymin);
         }
     }
+    free(lvl);
     free(depth);
     return 0;
 }
 
 
+STRUCT(ApproxHeightTiles)
+{
+    float *y;
+    int *ids;
+    const Generator *g;
+    const SurfaceNoise *sn;
+    int x, z, w, h;
+    int strip0, nstrips;
+    volatile int next;
+    volatile int err;
+};
+
+static void mapApproxHeightWorker(void *data, int t)
+{
+    ApproxHeightTiles *d = (ApproxHeightTiles*) data;
+    enum { S = 32 }; // strip height, aligned to whole noise cells
+    int k;
+    (void) t;
 
+    while ((k = parallelNext(&d->next)) < d->nstrips)
+    {
+        int j0 = (d->strip0 + k) * S - d->z;
+        int j1 = j0 + S;
+        if (j0 < 0) j0 = 0;
+        if (j1 > d->h) j1 = d->h;
+        int err = mapApproxHeight(d->y + (int64_t)j0 * d->w,
+            d->ids ? d->ids + (int64_t)j0 * d->w : NULL,
+            d->g, d->sn, d->x, d->z + j0, d->w, j1 - j0);
+        if (err)
+            d->err = err;
+    }
+}
 
-
-
+int mapApproxHeightTiled(float *y, int *ids, const Generator *g,
+    const SurfaceNoise *sn, int x, int z, int w, int h, int threads)
+{
+    enum { S = 32 };
+    ApproxHeightTiles d;
+    d.y = y;
+    d.ids = ids;
+    d.g = g;
+    d.sn = sn;
+    d.x = x;
+    d.z = z;
+    d.w = w;
+    d.h = h;
+    d.strip0 = floordiv(z, S);
+    d.nstrips = floordiv(z + h - 1, S) - d.strip0 + 1;
+    d.next = 0;
+    d.err = 0;
+
+    if (threads > d.nstrips)
+        threads = d.nstrips;
+    runParallel(threads, mapApproxHeightWorker, &d);
+    return d.err;
+}
@@ -10,6 +10,7 @@ enum
     LARGE_BIOMES            = 0x1,
     NO_BETA_OCEAN           = 0x2,
     FORCE_OCEAN_VARIANTS    = 0x4,
+    NO_VORONOI_SHA          = 0x8,
 };
 
 STRUCT(Generator)
@@ -51,7 +52,10 @@ extern "C"
 /**
  * Sets up a biome generator for a given MC version. The 'flags' can be used to
  * control LARGE_BIOMES or to FORCE_OCEAN_VARIANTS to enable ocean variants at
- * scales higher than normal.
+ * scales higher than normal. With NO_VORONOI_SHA, applySeed() does not hash
+ * the seed for the 1:1 scale, which is useful when many seeds are checked at
+ * other scales only. The 'sha' member then remains zero and 1:1 generation
+ * hashes the seed on each call instead.
  */
 void setupGenerator(Generator *g, int mc, uint32_t flags);
 
@@ -131,10 +135,19 @@ int genArea(const Layer *layer, int *out, int areaX, int areaZ, int areaWidth, i
  * Map an approximation of the Overworld surface height.
  * The horizontal scaling is 1:4. If non-null, the ids are filled with the
  * biomes of the area. The height (written to y) is in blocks.
+ * Returns -1 if the working memory could not be allocated.
  */
 int mapApproxHeight(float *y, int *ids, const Generator *g,
     const SurfaceNoise *sn, int x, int z, int w, int h);
 
+/**
+ * Multi-threaded variant of mapApproxHeight() for large areas. The area is
+ * split into strips along the z-axis that are distributed over the given
+ * number of threads. The output is identical to that of mapApproxHeight().
+ */
+int mapApproxHeightTiled(float *y, int *ids, const Generator *g,
+    const SurfaceNoise *sn, int x, int z, int w, int h, int threads);
+
 
 #ifdef __cplusplus
 }
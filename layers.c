@@ -5,6 +5,11 @@
 #include <math.h>
 #include <float.h>
 
+#if defined(__SHA__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define USE_SHA_NI
+#endif
+
 
 //==============================================================================
 // Essentials
@@ -2056,31 +2061,77 @@ int mapVoronoi114(const Layer * l, int * out, int x, int z, int w, int h)
 }
 
 
-uint64_t getVoronoiSHA(uint64_t seed)
+static const uint32_t g_sha_k[64] = {
+    0x428a2f98,0x71374491, 0xb5c0fbcf,0xe9b5dba5,
+    0x3956c25b,0x59f111f1, 0x923f82a4,0xab1c5ed5,
+    0xd807aa98,0x12835b01, 0x243185be,0x550c7dc3,
+    0x72be5d74,0x80deb1fe, 0x9bdc06a7,0xc19bf174,
+    0xe49b69c1,0xefbe4786, 0x0fc19dc6,0x240ca1cc,
+    0x2de92c6f,0x4a7484aa, 0x5cb0a9dc,0x76f988da,
+    0x983e5152,0xa831c66d, 0xb00327c8,0xbf597fc7,
+    0xc6e00bf3,0xd5a79147, 0x06ca6351,0x14292967,
+    0x27b70a85,0x2e1b2138, 0x4d2c6dfc,0x53380d13,
+    0x650a7354,0x766a0abb, 0x81c2c92e,0x92722c85,
+    0xa2bfe8a1,0xa81a664b, 0xc24b8b70,0xc76c51a3,
+    0xd192e819,0xd6990624, 0xf40e3585,0x106aa070,
+    0x19a4c116,0x1e376c08, 0x2748774c,0x34b0bcb5,
+    0x391c0cb3,0x4ed8aa4a, 0x5b9cca4f,0x682e6ff3,
+    0x748f82ee,0x78a5636f, 0x84c87814,0x8cc70208,
+    0x90befffa,0xa4506ceb, 0xbef9a3f7,0xc67178f2,
+};
+static const uint32_t g_sha_b[8] = {
+    0x6a09e667,0xbb67ae85, 0x3c6ef372,0xa54ff53a,
+    0x510e527f,0x9b05688c, 0x1f83d9ab,0x5be0cd19,
+};
+
+#ifdef USE_SHA_NI
+/// Single block SHA-256 with the x86 SHA extensions, the state is kept in the
+/// (A,B,E,F) and (C,D,G,H) register layout that the instructions expect.
+static uint64_t getVoronoiSHA_NI(uint64_t seed)
 {
-    static const uint32_t K[64] = {
-        0x428a2f98,0x71374491, 0xb5c0fbcf,0xe9b5dba5,
-        0x3956c25b,0x59f111f1, 0x923f82a4,0xab1c5ed5,
-        0xd807aa98,0x12835b01, 0x243185be,0x550c7dc3,
-        0x72be5d74,0x80deb1fe, 0x9bdc06a7,0xc19bf174,
-        0xe49b69c1,0xefbe4786, 0x0fc19dc6,0x240ca1cc,
-        0x2de92c6f,0x4a7484aa, 0x5cb0a9dc,0x76f988da,
-        0x983e5152,0xa831c66d, 0xb00327c8,0xbf597fc7,
-        0xc6e00bf3,0xd5a79147, 0x06ca6351,0x14292967,
-        0x27b70a85,0x2e1b2138, 0x4d2c6dfc,0x53380d13,
-        0x650a7354,0x766a0abb, 0x81c2c92e,0x92722c85,
-        0xa2bfe8a1,0xa81a664b, 0xc24b8b70,0xc76c51a3,
-        0xd192e819,0xd6990624, 0xf40e3585,0x106aa070,
-        0x19a4c116,0x1e376c08, 0x2748774c,0x34b0bcb5,
-        0x391c0cb3,0x4ed8aa4a, 0x5b9cca4f,0x682e6ff3,
-        0x748f82ee,0x78a5636f, 0x84c87814,0x8cc70208,
-        0x90befffa,0xa4506ceb, 0xbef9a3f7,0xc67178f2,
-    };
-    static const uint32_t B[8] = {
-        0x6a09e667,0xbb67ae85, 0x3c6ef372,0xa54ff53a,
-        0x510e527f,0x9b05688c, 0x1f83d9ab,0x5be0cd19,
-    };
+    __m128i w[16], abef, cdgh, abef0, msg, tmp;
+    int i;
+
+    w[0] = _mm_set_epi32(0, 0x80000000,
+        BSWAP32((uint32_t)(seed >> 32)), BSWAP32((uint32_t)(seed)));
+    w[1] = _mm_setzero_si128();
+    w[2] = _mm_setzero_si128();
+    w[3] = _mm_set_epi32(0x00000040, 0, 0, 0);
+    for (i = 4; i < 16; i++)
+    {
+        msg = _mm_sha256msg1_epu32(w[i-4], w[i-3]);
+        msg = _mm_add_epi32(msg, _mm_alignr_epi8(w[i-1], w[i-2], 4));
+        w[i] = _mm_sha256msg2_epu32(msg, w[i-1]);
+    }
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&g_sha_b[0]), 0xB1);
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&g_sha_b[4]), 0x1B);
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+    abef0 = abef;
+
+    for (i = 0; i < 16; i++)
+    {
+        msg = _mm_add_epi32(w[i], _mm_loadu_si128((const __m128i*)&g_sha_k[4*i]));
+        cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+        msg = _mm_shuffle_epi32(msg, 0x0E);
+        abef = _mm_sha256rnds2_epu32(abef, cdgh, msg);
+    }
+
+    // only the first two words of the hash are needed
+    abef = _mm_add_epi32(abef, abef0);
 
+    uint32_t a0 = (uint32_t) _mm_extract_epi32(abef, 3);
+    uint32_t a1 = (uint32_t) _mm_extract_epi32(abef, 2);
+    return BSWAP32(a0) | ((uint64_t)BSWAP32(a1) << 32);
+}
+#endif
+
+uint64_t getVoronoiSHA(uint64_t seed)
+{
+#ifdef USE_SHA_NI
+    return getVoronoiSHA_NI(seed);
+#else
     uint32_t m[64];
     uint32_t a0,a1,a2,a3,a4,a5,a6,a7;
     uint32_t i, x, y;
@@ -2100,18 +2151,18 @@ uint64_t getVoronoiSHA(uint64_t seed)
         m[i] += rotr32(x,17) ^ rotr32(x,19) ^ (x >> 10);
     }
 
-    a0 = B[0];
-    a1 = B[1];
-    a2 = B[2];
-    a3 = B[3];
-    a4 = B[4];
-    a5 = B[5];
-    a6 = B[6];
-    a7 = B[7];
+    a0 = g_sha_b[0];
+    a1 = g_sha_b[1];
+    a2 = g_sha_b[2];
+    a3 = g_sha_b[3];
+    a4 = g_sha_b[4];
+    a5 = g_sha_b[5];
+    a6 = g_sha_b[6];
+    a7 = g_sha_b[7];
 
     for (i = 0; i < 64; i++)
     {
-        x = a7 + K[i] + m[i];
+        x = a7 + g_sha_k[i] + m[i];
         x += rotr32(a4,6) ^ rotr32(a4,11) ^ rotr32(a4,25);
         x += (a4 & a5) ^ (~a4 & a6);
 
@@ -2128,10 +2179,95 @@ uint64_t getVoronoiSHA(uint64_t seed)
         a0 = x + y;
     }
 
-    a0 += B[0];
-    a1 += B[1];
+    a0 += g_sha_b[0];
+    a1 += g_sha_b[1];
 
     return BSWAP32(a0) | ((uint64_t)BSWAP32(a1) << 32);
+#endif
+}
+
+void getVoronoiSHAs(const uint64_t *seeds, uint64_t *out, int n)
+{
+#ifdef USE_SHA_NI
+    int j;
+    for (j = 0; j < n; j++)
+        out[j] = getVoronoiSHA_NI(seeds[j]);
+#else
+    // multi-buffer: the lanes are independent hashes of one block each,
+    // stepped together so the loops over the lanes can be vectorized
+    enum { L = 8 };
+    uint32_t m[64][L];
+    uint32_t a0[L], a1[L], a2[L], a3[L], a4[L], a5[L], a6[L], a7[L];
+    uint32_t i, x, y;
+    int j, l;
+
+    for (i = 2; i < 16; i++)
+        for (l = 0; l < L; l++)
+            m[i][l] = i == 2 ? 0x80000000 : i == 15 ? 0x00000040 : 0;
+
+    for (j = 0; j < n; j += L)
+    {
+        for (l = 0; l < L; l++)
+        {
+            uint64_t seed = j + l < n ? seeds[j + l] : 0;
+            m[0][l] = BSWAP32((uint32_t)(seed));
+            m[1][l] = BSWAP32((uint32_t)(seed >> 32));
+        }
+
+        for (i = 16; i < 64; ++i)
+        {
+            for (l = 0; l < L; l++)
+            {
+                m[i][l] = m[i - 7][l] + m[i - 16][l];
+                x = m[i - 15][l];
+                m[i][l] += rotr32(x,7) ^ rotr32(x,18) ^ (x >> 3);
+                x = m[i - 2][l];
+                m[i][l] += rotr32(x,17) ^ rotr32(x,19) ^ (x >> 10);
+            }
+        }
+
+        for (l = 0; l < L; l++)
+        {
+            a0[l] = g_sha_b[0];
+            a1[l] = g_sha_b[1];
+            a2[l] = g_sha_b[2];
+            a3[l] = g_sha_b[3];
+            a4[l] = g_sha_b[4];
+            a5[l] = g_sha_b[5];
+            a6[l] = g_sha_b[6];
+            a7[l] = g_sha_b[7];
+        }
+
+        for (i = 0; i < 64; i++)
+        {
+            for (l = 0; l < L; l++)
+            {
+                x = a7[l] + g_sha_k[i] + m[i][l];
+                x += rotr32(a4[l],6) ^ rotr32(a4[l],11) ^ rotr32(a4[l],25);
+                x += (a4[l] & a5[l]) ^ (~a4[l] & a6[l]);
+
+                y = rotr32(a0[l],2) ^ rotr32(a0[l],13) ^ rotr32(a0[l],22);
+                y += (a0[l] & a1[l]) ^ (a0[l] & a2[l]) ^ (a1[l] & a2[l]);
+
+                a7[l] = a6[l];
+                a6[l] = a5[l];
+                a5[l] = a4[l];
+                a4[l] = a3[l] + x;
+                a3[l] = a2[l];
+                a2[l] = a1[l];
+                a1[l] = a0[l];
+                a0[l] = x + y;
+            }
+        }
+
+        for (l = 0; l < L && j + l < n; l++)
+        {
+            uint32_t h0 = a0[l] + g_sha_b[0];
+            uint32_t h1 = a1[l] + g_sha_b[1];
+            out[j + l] = BSWAP32(h0) | ((uint64_t)BSWAP32(h1) << 32);
+        }
+    }
+#endif
 }
 
 void voronoiAccess3D(uint64_t sha, int x, int y, int z, int *x4, int *y4, int *z4)
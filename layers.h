@@ -177,6 +177,9 @@ mapfunc_t mapVoronoi114;
 // It is seeded by the first 8-bytes of the SHA-256 hash of the world seed.
 ATTR(const)
 uint64_t getVoronoiSHA(uint64_t worldSeed);
+// Computes getVoronoiSHA() for 'n' seeds at once, either as several hashes
+// in parallel lanes or with the SHA extensions when they are enabled.
+void getVoronoiSHAs(const uint64_t *worldSeeds, uint64_t *out, int n);
 void voronoiAccess3D(uint64_t sha, int x, int y, int z, int *x4, int *y4, int *z4);
 
 // Applies a 2D voronoi mapping at height 'y' to a 'src' plane, where
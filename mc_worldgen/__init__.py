@@ -1,6 +1,13 @@
 from ._mc_worldgen import Generator as _Generator
 from . import _mc_worldgen
 from enum import IntEnum
+import array as _array
+import os as _os
+
+try:
+    import numpy as _np
+except ImportError:
+    _np = None
 
 def _make_enum(name, source_cls):
     constants = {k: v for k, v in source_cls.__dict__.items() if not k.startswith('_')}
@@ -10,6 +17,46 @@ Version = _make_enum('Version', _mc_worldgen.Version)
 Dimension = _make_enum('Dimension', _mc_worldgen.Dimension)
 Flag = _make_enum('Flag', _mc_worldgen.Flag)
 Biome = _make_enum('Biome', _mc_worldgen.Biome)
+Structure = _make_enum('Structure', _mc_worldgen.Structure)
+BiomeMap = _mc_worldgen.BiomeMap
+
+def _dtype_name(dtype):
+    if isinstance(dtype, str):
+        return dtype
+    return _np.dtype(dtype).name if _np is not None else dtype.__name__
+
+def _threads(threads):
+    return threads if threads is not None else (_os.cpu_count() or 1)
+
+def _as_array(res):
+    # Both views share the memory of the BiomeMap and keep it alive.
+    if _np is not None:
+        return _np.asarray(res)
+    return memoryview(res)
+
+def _int32_tuples(points):
+    if _np is not None:
+        return _np.ascontiguousarray(points, dtype=_np.int32)
+    if isinstance(points, _array.array):
+        return points
+    return _array.array('i', [c for p in points for c in p])
+
+def get_structure_pos_grid(stype: int, mc: int, seed: int, reg_x: int, reg_z: int, reg_w: int, reg_h: int):
+    pos, valid = _mc_worldgen.get_structure_pos_grid(stype, mc, seed, reg_x, reg_z, reg_w, reg_h)
+    return _as_array(pos), _as_array(valid)
+
+get_structure_pos_grid.__doc__ = _mc_worldgen.get_structure_pos_grid.__doc__
+
+def get_structure_pos_seeds(stype: int, mc: int, seeds, reg_x: int, reg_z: int):
+    pos, valid = _mc_worldgen.get_structure_pos_seeds(stype, mc, seeds, reg_x, reg_z)
+    return _as_array(pos), _as_array(valid)
+
+get_structure_pos_seeds.__doc__ = _mc_worldgen.get_structure_pos_seeds.__doc__
+
+def search_quad_bases(stype: int, mc: int, radius: int = 128, threads=None, path=None, cachedir=None):
+    return _as_array(_mc_worldgen.search_quad_bases(stype, mc, radius, _threads(threads), path, cachedir))
+
+search_quad_bases.__doc__ = _mc_worldgen.search_quad_bases.__doc__
 
 class Generator(_Generator):
     def get_biome_at(self, scale: int, x: int, y: int, z: int) -> Biome:
@@ -17,9 +64,49 @@ class Generator(_Generator):
 
     get_biome_at.__doc__ = _Generator.get_biome_at.__doc__
 
-    def gen_biomes(self, scale: int, x: int, z: int, sx: int, sz: int, y: int = 0, sy: int = 1) -> list[Biome]:
-        return [Biome(b) for b in super().gen_biomes(scale, x, z, sx, sz, y, sy)]
+    def gen_biomes(self, scale: int, x: int, z: int, sx: int, sz: int, y: int = 0, sy: int = 1,
+                   dtype='int32', out=None):
+        res = super().gen_biomes(scale, x, z, sx, sz, y, sy, dtype=_dtype_name(dtype), out=out)
+        if out is not None:
+            return out
+        return _as_array(res)
 
     gen_biomes.__doc__ = _Generator.gen_biomes.__doc__
 
+    def biomes_at(self, scale: int, points, dtype='int32', threads=None):
+        points = _int32_tuples(points)
+        res = super().biomes_at(scale, points, dtype=_dtype_name(dtype), threads=_threads(threads))
+        return _as_array(res)
+
+    biomes_at.__doc__ = _Generator.biomes_at.__doc__
+
+    def gen_biomes_batch(self, ranges, dtype='int32', threads=None):
+        res = super().gen_biomes_batch(ranges, dtype=_dtype_name(dtype), threads=_threads(threads))
+        return [_as_array(r) for r in res]
+
+    gen_biomes_batch.__doc__ = _Generator.gen_biomes_batch.__doc__
+
+    def gen_biomes_seeds(self, seeds, dim: int, scale: int, x: int, z: int, sx: int, sz: int,
+                         y: int = 0, sy: int = 1, dtype='int32', threads=None):
+        res = super().gen_biomes_seeds(seeds, dim, scale, x, z, sx, sz, y, sy,
+                                       dtype=_dtype_name(dtype), threads=_threads(threads))
+        return _as_array(res)
+
+    gen_biomes_seeds.__doc__ = _Generator.gen_biomes_seeds.__doc__
+
+    def are_viable_structure_pos(self, stype: int, positions, flags: int = 0):
+        return _as_array(super().are_viable_structure_pos(stype, _int32_tuples(positions), flags))
+
+    are_viable_structure_pos.__doc__ = _Generator.are_viable_structure_pos.__doc__
+
+    def get_strongholds(self, n: int = 128, threads=None):
+        return _as_array(super().get_strongholds(n, _threads(threads)))
+
+    get_strongholds.__doc__ = _Generator.get_strongholds.__doc__
+
+    def get_spawns(self, seeds, estimate: bool = False, threads=None):
+        return _as_array(super().get_spawns(seeds, estimate, _threads(threads)))
+
+    get_spawns.__doc__ = _Generator.get_spawns.__doc__
+
 Generator.__doc__ = _Generator.__doc__
@@ -1,6 +1,6 @@
 """Type stubs for mc_worldgen"""
 
-from typing import List, Optional
+from typing import Any, List, Optional, Tuple, Union
 from enum import IntEnum
 
 class Version(IntEnum):
@@ -46,6 +46,34 @@ class Flag(IntEnum):
     NO_BETA_OCEAN: int = ...
     FORCE_OCEAN_VARIANTS: int = ...
 
+class Structure(IntEnum):
+    """Structure types"""
+    Feature: int = ...
+    Desert_Pyramid: int = ...
+    Jungle_Temple: int = ...
+    Swamp_Hut: int = ...
+    Igloo: int = ...
+    Village: int = ...
+    Ocean_Ruin: int = ...
+    Shipwreck: int = ...
+    Monument: int = ...
+    Mansion: int = ...
+    Outpost: int = ...
+    Ruined_Portal: int = ...
+    Ruined_Portal_N: int = ...
+    Ancient_City: int = ...
+    Treasure: int = ...
+    Mineshaft: int = ...
+    Desert_Well: int = ...
+    Geode: int = ...
+    Fortress: int = ...
+    Bastion: int = ...
+    End_City: int = ...
+    End_Gateway: int = ...
+    End_Island: int = ...
+    Trail_Ruins: int = ...
+    Trial_Chambers: int = ...
+
 class Biome(IntEnum):
     """Biome IDs"""
     ocean: int = ...
@@ -192,6 +220,17 @@ class Biome(IntEnum):
     cherry_grove: int = ...
     pale_garden: int = ...
 
+class BiomeMap:
+    """Biome map that exposes its storage through the buffer protocol."""
+    @property
+    def shape(self) -> Tuple[int, int, int]:
+        """The map dimensions (sy, sz, sx)."""
+        ...
+    @property
+    def dtype(self) -> str:
+        """The element type, 'int32' or 'uint8'."""
+        ...
+
 class Generator:
     """Minecraft World Generator object."""
 
@@ -230,7 +269,8 @@ class Generator:
         """
         ...
 
-    def gen_biomes(self, scale: int, x: int, z: int, sx: int, sz: int, y: int = 0, sy: int = 1) -> List[Biome]:
+    def gen_biomes(self, scale: int, x: int, z: int, sx: int, sz: int, y: int = 0, sy: int = 1,
+                   dtype: Any = 'int32', out: Optional[Any] = None) -> Union[memoryview, Any]:
         """
         Generate biomes for a given range.
 
@@ -242,8 +282,137 @@ class Generator:
             sz: The horizontal size in Z direction.
             y: The starting Y coordinate.
             sy: The vertical size.
+            dtype: 'int32' or 'uint8' (or the equivalent numpy dtype).
+            out: Optional writable C-contiguous buffer with at least
+                sy*sz*sx elements of the dtype to generate into.
+
+        Returns:
+            A numpy array (if numpy is installed) or memoryview of shape
+            (sy, sz, sx) that shares the generated memory, or out if given.
+        """
+        ...
+
+    def biomes_at(self, scale: int, points: Any, dtype: Any = 'int32',
+                  threads: Optional[int] = None) -> Union[memoryview, Any]:
+        """
+        Get the biome IDs at many coordinates, like get_biome_at().
+
+        Args:
+            scale: The horizontal scale factor (1, 4, 16, 64, or 256).
+            points: A sequence or array of (x, y, z) triples.
+            dtype: 'int32' or 'uint8' (or the equivalent numpy dtype).
+            threads: Number of native threads. Defaults to the CPU count,
+                small batches use fewer threads.
+
+        Returns:
+            An array of shape (n,) with the biome IDs.
+        """
+        ...
+
+    def gen_biomes_batch(self, ranges: Any, dtype: Any = 'int32',
+                         threads: Optional[int] = None) -> List[Union[memoryview, Any]]:
+        """
+        Generate biomes for many ranges, like gen_biomes().
+
+        Args:
+            ranges: Tuples of (scale, x, z, sx, sz[, y, sy]).
+            dtype: 'int32' or 'uint8' (or the equivalent numpy dtype).
+            threads: Number of native threads. Defaults to the CPU count,
+                small batches use fewer threads.
 
         Returns:
-            A flat list of biome IDs.
+            One array of shape (sy, sz, sx) per range.
         """
         ...
+
+    def gen_biomes_seeds(self, seeds: Any, dim: int, scale: int, x: int, z: int, sx: int, sz: int,
+                         y: int = 0, sy: int = 1, dtype: Any = 'int32',
+                         threads: Optional[int] = None) -> Union[memoryview, Any]:
+        """
+        Generate the same range for many world seeds. The seed of this
+        generator is left unchanged.
+
+        Args:
+            seeds: The 64-bit integer world seeds.
+            dim: The dimension.
+            scale, x, z, sx, sz, y, sy: The range, as for gen_biomes().
+            dtype: 'int32' or 'uint8' (or the equivalent numpy dtype).
+            threads: Number of native threads. Defaults to the CPU count,
+                small batches use fewer threads.
+
+        Returns:
+            An array of shape (len(seeds), sy, sz, sx).
+        """
+        ...
+
+    def are_viable_structure_pos(self, stype: int, positions: Any, flags: int = 0) -> Union[memoryview, Any]:
+        """
+        Check the biome requirements of structure attempts at many block positions.
+
+        Args:
+            stype: The structure type (use Structure constants).
+            positions: A sequence or array of (x, z) block positions.
+            flags: Structure specific flags, such as the village variant.
+
+        Returns:
+            A uint8 array of shape (n,), 1 for viable positions.
+        """
+        ...
+
+    def get_strongholds(self, n: int = 128, threads: Optional[int] = None) -> Union[memoryview, Any]:
+        """
+        Find the accurate positions of the first n strongholds for the applied seed.
+
+        Returns:
+            An int32 array of (x, z) block positions, shaped (count, 2).
+        """
+        ...
+
+    def get_spawn(self, estimate: bool = False) -> Tuple[int, int]:
+        """
+        Find the world spawn for the applied seed, or its faster estimate.
+        """
+        ...
+
+    def get_spawns(self, seeds: Any, estimate: bool = False,
+                   threads: Optional[int] = None) -> Union[memoryview, Any]:
+        """
+        Find the world spawn for many seeds. The seed of this generator is
+        left unchanged.
+
+        Returns:
+            An int32 array of (x, z) block positions, shaped (len(seeds), 2).
+        """
+        ...
+
+def get_structure_pos_grid(stype: int, mc: int, seed: int, reg_x: int, reg_z: int,
+                           reg_w: int, reg_h: int) -> Tuple[Any, Any]:
+    """
+    Find the structure generation attempts for a rectangle of regions.
+
+    Returns:
+        The int32 block positions, shaped (reg_h, reg_w, 2), and uint8 flags
+        for the valid attempts, shaped (reg_h, reg_w).
+    """
+    ...
+
+def get_structure_pos_seeds(stype: int, mc: int, seeds: Any, reg_x: int, reg_z: int) -> Tuple[Any, Any]:
+    """
+    Find the structure generation attempt in one region for many seeds.
+
+    Returns:
+        The int32 block positions, shaped (len(seeds), 2), and uint8 flags
+        for the valid attempts, shaped (len(seeds),).
+    """
+    ...
+
+def search_quad_bases(stype: int, mc: int, radius: int = 128, threads: Optional[int] = None,
+                      path: Optional[str] = None, cachedir: Optional[str] = None) -> Any:
+    """
+    Search all 48-bit seeds for quad-structure bases. This is a lengthy
+    search, so the results can also be written to a file at 'path'.
+
+    Returns:
+        A uint64 array of the 48-bit seed bases.
+    """
+    ...
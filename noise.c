@@ -106,49 +106,15 @@ void xPerlinInit(PerlinNoise *noise, Xoroshiro *xr)
     noise->t2 = d2*d2*d2 * (d2 * (d2*6.0-15.0) + 10.0);
 }
 
-double samplePerlin(const PerlinNoise *noise, double d1, double d2, double d3,
-        double yamp, double ymin)
+/* Combines the gradients of the eight lattice corners surrounding a sampling
+ * position, given the lattice indices, the fractional offsets and the fade
+ * weights in each direction.
+ */
+ATTR(hot)
+static inline double perlinMix(const uint8_t *idx,
+        uint8_t h1, uint8_t h2, uint8_t h3, double d1, double d2, double d3,
+        double t1, double t2, double t3)
 {
-    uint8_t h1, h2, h3;
-    double t1, t2, t3;
-
-    if (d2 == 0.0)
-    {
-        d2 = noise->d2;
-        h2 = noise->h2;
-        t2 = noise->t2;
-    }
-    else
-    {
-        d2 += noise->b;
-        double i2 = floor(d2);
-        d2 -= i2;
-        h2 = (int) i2;
-        t2 = d2*d2*d2 * (d2 * (d2*6.0-15.0) + 10.0);
-    }
-
-    d1 += noise->a;
-    d3 += noise->c;
-
-    double i1 = floor(d1);
-    double i3 = floor(d3);
-    d1 -= i1;
-    d3 -= i3;
-
-    h1 = (int) i1;
-    h3 = (int) i3;
-
-    t1 = d1*d1*d1 * (d1 * (d1*6.0-15.0) + 10.0);
-    t3 = d3*d3*d3 * (d3 * (d3*6.0-15.0) + 10.0);
-
-    if (yamp)
-    {
-        double yclamp = ymin < d2 ? ymin : d2;
-        d2 -= floor(yclamp / yamp) * yamp;
-    }
-
-    const uint8_t *idx = noise->d;
-
 #if 1
     // try to promote optimizations that can utilize the {xh, xl} registers
     typedef struct vec2 { uint8_t a, b; } vec2;
@@ -207,6 +173,205 @@ double samplePerlin(const PerlinNoise *noise, double d1, double d2, double d3,
     return lerp(t3, l1, l5);
 }
 
+double samplePerlin(const PerlinNoise *noise, double d1, double d2, double d3,
+        double yamp, double ymin)
+{
+    uint8_t h1, h2, h3;
+    double t1, t2, t3;
+
+    if (d2 == 0.0)
+    {
+        d2 = noise->d2;
+        h2 = noise->h2;
+        t2 = noise->t2;
+    }
+    else
+    {
+        d2 += noise->b;
+        double i2 = floor(d2);
+        d2 -= i2;
+        h2 = (int) i2;
+        t2 = d2*d2*d2 * (d2 * (d2*6.0-15.0) + 10.0);
+    }
+
+    d1 += noise->a;
+    d3 += noise->c;
+
+    double i1 = floor(d1);
+    double i3 = floor(d3);
+    d1 -= i1;
+    d3 -= i3;
+
+    h1 = (int) i1;
+    h3 = (int) i3;
+
+    t1 = d1*d1*d1 * (d1 * (d1*6.0-15.0) + 10.0);
+    t3 = d3*d3*d3 * (d3 * (d3*6.0-15.0) + 10.0);
+
+    if (yamp)
+    {
+        double yclamp = ymin < d2 ? ymin : d2;
+        d2 -= floor(yclamp / yamp) * yamp;
+    }
+
+    return perlinMix(noise->d, h1, h2, h3, d1, d2, d3, t1, t2, t3);
+}
+
+/// Gradient of a lattice corner, as used by indexedLerp().
+static void perlinGrad(uint8_t idx, int g[3])
+{
+    static const int8_t grad[16][3] = {
+        { 1, 1, 0}, {-1, 1, 0}, { 1,-1, 0}, {-1,-1, 0},
+        { 1, 0, 1}, {-1, 0, 1}, { 1, 0,-1}, {-1, 0,-1},
+        { 0, 1, 1}, { 0,-1, 1}, { 0, 1,-1}, { 0,-1,-1},
+        { 1, 1, 0}, { 0,-1, 1}, {-1, 1, 0}, { 0,-1,-1},
+    };
+    g[0] = grad[idx & 0xf][0];
+    g[1] = grad[idx & 0xf][1];
+    g[2] = grad[idx & 0xf][2];
+}
+
+/// Interval version of lerp() for independent arguments.
+static void lerpBounds(double t0, double t1, const double a[2], const double b[2],
+        double out[2])
+{
+    double l0 = a[0] + t0 * (b[0] - a[0]), l1 = a[0] + t1 * (b[0] - a[0]);
+    double h0 = a[1] + t0 * (b[1] - a[1]), h1 = a[1] + t1 * (b[1] - a[1]);
+    out[0] = l0 < l1 ? l0 : l1;
+    out[1] = h0 > h1 ? h0 : h1;
+}
+
+static inline double fade(double d)
+{
+    return d*d*d * (d * (d*6.0-15.0) + 10.0);
+}
+
+/// Bounds samplePerlin() within a single lattice cell for the fractional
+/// offsets d[k] in [d0[k], d1[k]].
+static void samplePerlinCellBounds(const PerlinNoise *noise, const int h[3],
+        const double d0[3], const double d1[3], double out[2])
+{
+    const uint8_t *idx = noise->d;
+    double l[8][2];
+    int i, k;
+    for (i = 0; i < 8; i++)
+    {
+        int c[3] = { i & 1, (i >> 1) & 1, (i >> 2) & 1 };
+        uint8_t a = idx[(uint8_t)(h[0]) + c[0]] + (uint8_t)h[1];
+        uint8_t b = idx[a + c[1]] + (uint8_t)h[2];
+        int g[3];
+        perlinGrad(idx[b + c[2]], g);
+        l[i][0] = l[i][1] = 0;
+        for (k = 0; k < 3; k++)
+        {   // the gradient dot product is linear in the offset
+            double u = g[k] * (d0[k] - c[k]), v = g[k] * (d1[k] - c[k]);
+            l[i][0] += u < v ? u : v;
+            l[i][1] += u > v ? u : v;
+        }
+    }
+    double t0[3], t1[3];
+    for (k = 0; k < 3; k++)
+    {
+        t0[k] = fade(d0[k]);
+        t1[k] = fade(d1[k]);
+    }
+    for (i = 0; i < 8; i += 2)
+        lerpBounds(t0[0], t1[0], l[i], l[i+1], l[i]);
+    lerpBounds(t0[1], t1[1], l[0], l[2], l[0]);
+    lerpBounds(t0[1], t1[1], l[4], l[6], l[4]);
+    lerpBounds(t0[2], t1[2], l[0], l[4], out);
+}
+
+void samplePerlinBounds(const PerlinNoise *noise, const double lo[3],
+        const double hi[3], double *vmin, double *vmax)
+{
+    double p0[3] = { lo[0] + noise->a, lo[1] + noise->b, lo[2] + noise->c };
+    double p1[3] = { hi[0] + noise->a, hi[1] + noise->b, hi[2] + noise->c };
+    double c0[3], c1[3];
+    int k;
+    for (k = 0; k < 3; k++)
+    {
+        c0[k] = floor(p0[k]);
+        c1[k] = floor(p1[k]);
+    }
+    *vmin = -2;
+    *vmax = +2;
+    // the corner contributions are at most 2, which is also the bound for
+    // areas that span too many lattice cells to be worth evaluating
+    if ((c1[0]-c0[0]+1) * (c1[1]-c0[1]+1) * (c1[2]-c0[2]+1) > 16)
+        return;
+
+    double vlo = +2, vhi = -2;
+    double ci[3];
+    for (ci[2] = c0[2]; ci[2] <= c1[2]; ci[2]++)
+    for (ci[1] = c0[1]; ci[1] <= c1[1]; ci[1]++)
+    for (ci[0] = c0[0]; ci[0] <= c1[0]; ci[0]++)
+    {
+        int h[3];
+        double d0[3], d1[3], v[2];
+        for (k = 0; k < 3; k++)
+        {
+            h[k] = (int) ci[k];
+            d0[k] = p0[k] > ci[k] ? p0[k] - ci[k] : 0;
+            d1[k] = p1[k] < ci[k] + 1 ? p1[k] - ci[k] : 1;
+        }
+        samplePerlinCellBounds(noise, h, d0, d1, v);
+        if (v[0] < vlo) vlo = v[0];
+        if (v[1] > vhi) vhi = v[1];
+    }
+    if (vlo > *vmin) *vmin = vlo;
+    if (vhi < *vmax) *vmax = vhi;
+}
+
+void perlinPrepareXZ(PerlinXZ *pxz, const PerlinNoise *noise, double x, double z)
+{
+    x += noise->a;
+    z += noise->c;
+    double i1 = floor(x);
+    double i3 = floor(z);
+    x -= i1;
+    z -= i3;
+    pxz->h1 = (int) i1;
+    pxz->h3 = (int) i3;
+    pxz->d1 = x;
+    pxz->d3 = z;
+    pxz->t1 = x*x*x * (x * (x*6.0-15.0) + 10.0);
+    pxz->t3 = z*z*z * (z * (z*6.0-15.0) + 10.0);
+}
+
+void perlinPrepareY(PerlinY *py, const PerlinNoise *noise, double y,
+        double yamp, double ymin)
+{
+    if (y == 0.0)
+    {
+        py->d2 = noise->d2;
+        py->h2 = noise->h2;
+        py->t2 = noise->t2;
+    }
+    else
+    {
+        y += noise->b;
+        double i2 = floor(y);
+        y -= i2;
+        py->d2 = y;
+        py->h2 = (int) i2;
+        py->t2 = y*y*y * (y * (y*6.0-15.0) + 10.0);
+    }
+
+    if (yamp)
+    {
+        double yclamp = ymin < py->d2 ? ymin : py->d2;
+        py->d2 -= floor(yclamp / yamp) * yamp;
+    }
+}
+
+double samplePerlinXZY(const PerlinNoise *noise, const PerlinXZ *pxz,
+        const PerlinY *py)
+{
+    return perlinMix(noise->d, pxz->h1, py->h2, pxz->h3,
+        pxz->d1, py->d2, pxz->d3, pxz->t1, py->t2, pxz->t3);
+}
+
 static
 void samplePerlinBeta17Terrain(const PerlinNoise *noise, double *v,
         double d1, double d3, double yLacAmp)
@@ -571,3 +736,89 @@ double sampleDoublePerlin(const DoublePerlinNoise *noise,
     return v * noise->amplitude;
 }
 
+void sampleDoublePerlinRow(const DoublePerlinNoise *noise, double *out,
+        double x0, double dx, double z, int n)
+{
+    const double f = 337.0 / 331.0;
+    double vb[64];
+    int i, j, k, k0;
+
+    for (k0 = 0; k0 < n; k0 += 64)
+    {
+        int cnt = n - k0 < 64 ? n - k0 : 64;
+        for (j = 0; j < 2; j++)
+        {
+            const OctaveNoise *oct = j ? &noise->octB : &noise->octA;
+            double s = j ? f : 1.0;
+            double *v = j ? vb : out + k0;
+
+            for (k = 0; k < cnt; k++)
+                v[k] = 0;
+
+            for (i = 0; i < oct->octcnt; i++)
+            {
+                const PerlinNoise *p = oct->octaves + i;
+                double lf = p->lacunarity;
+                // the z terms are shared by the whole row
+                double d3 = maintainPrecision((z*s) * lf) + p->c;
+                double i3 = floor(d3);
+                d3 -= i3;
+                uint8_t h3 = (int) i3;
+                double t3 = d3*d3*d3 * (d3 * (d3*6.0-15.0) + 10.0);
+
+                for (k = 0; k < cnt; k++)
+                {
+                    double x = x0 + (k0 + k) * dx;
+                    double d1 = maintainPrecision((x*s) * lf) + p->a;
+                    double i1 = floor(d1);
+                    d1 -= i1;
+                    uint8_t h1 = (int) i1;
+                    double t1 = d1*d1*d1 * (d1 * (d1*6.0-15.0) + 10.0);
+                    v[k] += p->amplitude * perlinMix(p->d, h1, p->h2, h3,
+                        d1, p->d2, d3, t1, p->t2, t3);
+                }
+            }
+        }
+        for (k = 0; k < cnt; k++)
+            out[k0+k] = (out[k0+k] + vb[k]) * noise->amplitude;
+    }
+}
+
+void sampleDoublePerlinBounds(const DoublePerlinNoise *noise,
+        const double lo[3], const double hi[3], double *vmin, double *vmax)
+{
+    const double f = 337.0 / 331.0;
+    double vlo = 0, vhi = 0;
+    int i, j, k;
+    for (j = 0; j < 2; j++)
+    {
+        const OctaveNoise *oct = j ? &noise->octB : &noise->octA;
+        for (i = 0; i < oct->octcnt; i++)
+        {
+            const PerlinNoise *p = oct->octaves + i;
+            double lf = p->lacunarity * (j ? f : 1.0);
+            double a[3], b[3], pmin, pmax;
+            for (k = 0; k < 3; k++)
+            {
+                a[k] = lo[k] * lf;
+                b[k] = hi[k] * lf;
+            }
+            samplePerlinBounds(p, a, b, &pmin, &pmax);
+            if (p->amplitude >= 0) {
+                vlo += p->amplitude * pmin;
+                vhi += p->amplitude * pmax;
+            } else {
+                vlo += p->amplitude * pmax;
+                vhi += p->amplitude * pmin;
+            }
+        }
+    }
+    if (noise->amplitude >= 0) {
+        *vmin = vlo * noise->amplitude;
+        *vmax = vhi * noise->amplitude;
+    } else {
+        *vmin = vhi * noise->amplitude;
+        *vmax = vlo * noise->amplitude;
+    }
+}
+
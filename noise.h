@@ -28,6 +28,21 @@ STRUCT(DoublePerlinNoise)
     OctaveNoise octB;
 };
 
+// Perlin sample terms that depend only on the horizontal or vertical position.
+STRUCT(PerlinXZ)
+{
+    double d1, d3;
+    double t1, t3;
+    uint8_t h1, h3;
+};
+
+STRUCT(PerlinY)
+{
+    double d2;
+    double t2;
+    uint8_t h2;
+};
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -52,6 +67,26 @@ double samplePerlin(const PerlinNoise *noise, double x, double y, double z,
         double yamp, double ymin);
 double sampleSimplex2D(const PerlinNoise *noise, double x, double y);
 
+/**
+ * Perlin sampling with separately prepared horizontal and vertical terms.
+ * Samples along a column can share the horizontal terms, while columns at the
+ * same height can share the vertical terms. For the same arguments, the result
+ * of samplePerlinXZY() is identical to that of samplePerlin().
+ */
+void perlinPrepareXZ(PerlinXZ *pxz, const PerlinNoise *noise, double x, double z);
+void perlinPrepareY(PerlinY *py, const PerlinNoise *noise, double y,
+        double yamp, double ymin);
+double samplePerlinXZY(const PerlinNoise *noise, const PerlinXZ *pxz,
+        const PerlinY *py);
+
+/**
+ * Determines conservative bounds on the value of samplePerlin() (without the
+ * y-amplitude) for all positions in the box from 'lo' to 'hi', using interval
+ * arithmetic over the lattice cells that the box overlaps.
+ */
+void samplePerlinBounds(const PerlinNoise *noise, const double lo[3],
+        const double hi[3], double *vmin, double *vmax);
+
 /// Perlin Octaves
 void octaveInit(OctaveNoise *noise, uint64_t *seed, PerlinNoise *octaves,
         int omin, int len);
@@ -76,6 +111,15 @@ int xDoublePerlinInit(DoublePerlinNoise *noise, Xoroshiro *xr,
 
 double sampleDoublePerlin(const DoublePerlinNoise *noise,
         double x, double y, double z);
+/**
+ * Samples a row of 'n' positions (x0 + k*dx, 0, z) into 'out'. The terms of
+ * each octave that depend only on z are evaluated once for the whole row. The
+ * results are identical to those of sampleDoublePerlin().
+ */
+void sampleDoublePerlinRow(const DoublePerlinNoise *noise, double *out,
+        double x0, double dx, double z, int n);
+void sampleDoublePerlinBounds(const DoublePerlinNoise *noise,
+        const double lo[3], const double hi[3], double *vmin, double *vmax);
 
 
 #ifdef __cplusplus
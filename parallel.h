@@ -0,0 +1,153 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+/* Minimal portable threading helpers for the multi-threaded generators and
+ * finders. This header is internal to the library and is not installed.
+ */
+
+#include "rng.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+STRUCT(ParallelTask)
+{
+    void (*func)(void *data, int t);
+    void *data;
+    int t;
+};
+
+#if defined(_WIN32)
+static inline DWORD WINAPI parallelEntry(LPVOID arg)
+{
+    ParallelTask *task = (ParallelTask*) arg;
+    task->func(task->data, task->t);
+    return 0;
+}
+#else
+static inline void *parallelEntry(void *arg)
+{
+    ParallelTask *task = (ParallelTask*) arg;
+    task->func(task->data, task->t);
+    return NULL;
+}
+#endif
+
+/* Runs func(data, t) for each thread index t in [0, threads) and waits for all
+ * of them to finish. With a single thread (or if the threads cannot be
+ * created) the function is executed on the calling thread instead.
+ */
+static inline void runParallel(int threads, void (*func)(void*, int), void *data)
+{
+    ParallelTask *tasks;
+    int t;
+
+    if (threads <= 1 ||
+        !(tasks = (ParallelTask*) malloc(threads * sizeof(*tasks))))
+    {
+        for (t = 0; t < (threads > 1 ? threads : 1); t++)
+            func(data, t);
+        return;
+    }
+
+    for (t = 0; t < threads; t++)
+    {
+        tasks[t].func = func;
+        tasks[t].data = data;
+        tasks[t].t = t;
+    }
+
+#if defined(_WIN32)
+    HANDLE *tids = (HANDLE*) calloc(threads, sizeof(*tids));
+    for (t = 0; t < threads; t++)
+    {
+        if (tids)
+            tids[t] = CreateThread(NULL, 0, parallelEntry, (LPVOID)&tasks[t], 0, NULL);
+        if (!tids || tids[t] == NULL)
+            parallelEntry(&tasks[t]);
+    }
+    for (t = 0; tids && t < threads; t++)
+    {
+        if (tids[t] == NULL)
+            continue;
+        WaitForSingleObject(tids[t], INFINITE);
+        CloseHandle(tids[t]);
+    }
+    free(tids);
+#else
+    pthread_t *tids = (pthread_t*) malloc(threads * sizeof(*tids));
+    char *ok = (char*) calloc(threads, 1);
+    for (t = 0; t < threads; t++)
+    {
+        if (tids && ok && !pthread_create(&tids[t], NULL, parallelEntry, &tasks[t]))
+            ok[t] = 1;
+        else
+            parallelEntry(&tasks[t]);
+    }
+    for (t = 0; ok && t < threads; t++)
+    {
+        if (ok[t])
+            pthread_join(tids[t], NULL);
+    }
+    free(ok);
+    free(tids);
+#endif
+
+    free(tasks);
+}
+
+/* Atomically increments a shared work counter and returns its old value.
+ */
+static inline int parallelNext(volatile int *counter)
+{
+#if defined(_WIN32)
+    return InterlockedIncrement((volatile LONG*) counter) - 1;
+#else
+    return __sync_fetch_and_add(counter, 1);
+#endif
+}
+
+/* Spin lock for short critical sections that are shared between workers.
+ * The waiting threads yield, so it also works with more threads than cores.
+ */
+static inline void parallelLock(volatile int *lock)
+{
+#if defined(_WIN32)
+    while (InterlockedCompareExchange((volatile LONG*) lock, 1, 0) != 0)
+        SwitchToThread();
+#else
+    while (__sync_lock_test_and_set(lock, 1))
+        sched_yield();
+#endif
+}
+
+static inline void parallelUnlock(volatile int *lock)
+{
+#if defined(_WIN32)
+    InterlockedExchange((volatile LONG*) lock, 0);
+#else
+    __sync_lock_release(lock);
+#endif
+}
+
+/* Stores p in an empty (NULL) slot and returns whichever pointer the slot
+ * holds afterwards. Used to publish lazily built tables exactly once.
+ */
+static inline void *parallelSetOnce(void *volatile *slot, void *p)
+{
+#if defined(_WIN32)
+    void *old = InterlockedCompareExchangePointer((PVOID volatile*) slot, p, NULL);
+#else
+    void *old = __sync_val_compare_and_swap(slot, NULL, p);
+#endif
+    return old ? old : p;
+}
+
+#endif /* PARALLEL_H_ */
@@ -3,12 +3,212 @@
 #include "generator.h"
 #include "biomes.h"
 #include "util.h"
+#include "finders.h"
+#include "quadbase.h"
+#include "parallel.h"
 
 typedef struct {
     PyObject_HEAD
     Generator g;
+    int busy;   // number of calls running without the GIL, -1 while seeding
 } GeneratorObject;
 
+/* A biome map that owns its storage and exposes it through the buffer
+ * protocol, shaped (sy, sz, sx) in C order, with a leading batch axis for
+ * the batch methods. The values are either native int32 or uint8 (biome IDs
+ * are in [0,256) for successful generation). The finder bindings use the
+ * same type for their packed int32, uint8 and uint64 results.
+ */
+typedef struct {
+    PyObject_HEAD
+    void *data;
+    int ndim;
+    Py_ssize_t shape[4];
+    Py_ssize_t strides[4];
+    Py_ssize_t itemsize;
+    const char *format;
+} BiomeMapObject;
+
+static void
+BiomeMap_dealloc(BiomeMapObject *self)
+{
+    free(self->data);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static int
+BiomeMap_getbuffer(BiomeMapObject *self, Py_buffer *view, int flags)
+{
+    view->obj = (PyObject *) self;
+    view->buf = self->data;
+    int i;
+    view->len = self->itemsize;
+    for (i = 0; i < self->ndim; i++)
+        view->len *= self->shape[i];
+    view->readonly = 0;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char *) self->format : NULL;
+    if (flags & PyBUF_ND) {
+        view->ndim = self->ndim;
+        view->shape = self->shape;
+        view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    } else {
+        view->ndim = 1;
+        view->shape = NULL;
+        view->strides = NULL;
+    }
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    Py_INCREF(self);
+    return 0;
+}
+
+static PyObject *
+BiomeMap_get_shape(BiomeMapObject *self, void *closure)
+{
+    PyObject *shape = PyTuple_New(self->ndim);
+    int i;
+    if (!shape)
+        return NULL;
+    for (i = 0; i < self->ndim; i++) {
+        PyObject *v = PyLong_FromSsize_t(self->shape[i]);
+        if (!v) {
+            Py_DECREF(shape);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(shape, i, v);
+    }
+    return shape;
+}
+
+static PyObject *
+BiomeMap_get_dtype(BiomeMapObject *self, void *closure)
+{
+    return PyUnicode_FromString(self->itemsize == 1 ? "uint8" :
+                                self->itemsize == 8 ? "uint64" : "int32");
+}
+
+static PyGetSetDef BiomeMap_getset[] = {
+    {"shape", (getter) BiomeMap_get_shape, NULL, "The map dimensions, e.g. (sy, sz, sx).", NULL},
+    {"dtype", (getter) BiomeMap_get_dtype, NULL, "The element type, e.g. 'int32' or 'uint8'.", NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyBufferProcs BiomeMap_as_buffer = {
+    .bf_getbuffer = (getbufferproc) BiomeMap_getbuffer,
+    .bf_releasebuffer = NULL,
+};
+
+PyDoc_STRVAR(biome_map_doc,
+"Biome map returned by Generator.gen_biomes().\n\n"
+"Supports the buffer protocol: memoryview(m) or numpy.asarray(m) give a\n"
+"(sy, sz, sx) view of the biome IDs without copying.");
+
+static PyTypeObject BiomeMapType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mc_worldgen.BiomeMap",
+    .tp_doc = biome_map_doc,
+    .tp_basicsize = sizeof(BiomeMapObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) BiomeMap_dealloc,
+    .tp_as_buffer = &BiomeMap_as_buffer,
+    .tp_getset = BiomeMap_getset,
+};
+
+/* Wraps data (allocated with malloc) in a new BiomeMap, which takes over the
+ * ownership. The data is freed if the map cannot be created.
+ */
+static BiomeMapObject *
+new_biome_map(void *data, int ndim, const Py_ssize_t *shape, int itemsize)
+{
+    BiomeMapObject *map = PyObject_New(BiomeMapObject, &BiomeMapType);
+    Py_ssize_t stride = itemsize;
+    int i;
+
+    if (!map) {
+        free(data);
+        return NULL;
+    }
+    map->data = data;
+    map->ndim = ndim;
+    map->itemsize = itemsize;
+    map->format = itemsize == 1 ? "B" : itemsize == 8 ? "Q" : "i";
+    for (i = ndim-1; i >= 0; i--) {
+        map->shape[i] = shape[i];
+        map->strides[i] = stride;
+        stride *= shape[i];
+    }
+    return map;
+}
+
+/* Registers a call that uses the generator without holding the GIL. Seeding
+ * (write=1) needs exclusive access, while generation calls can overlap.
+ */
+static int
+acquire_generator(GeneratorObject *self, int write)
+{
+    if (write ? self->busy != 0 : self->busy < 0) {
+        PyErr_SetString(PyExc_RuntimeError,
+            "Generator is being used by another thread");
+        return -1;
+    }
+    self->busy = write ? -1 : self->busy + 1;
+    return 0;
+}
+
+static void
+release_generator(GeneratorObject *self, int write)
+{
+    self->busy = write ? 0 : self->busy - 1;
+}
+
+/* Returns the element size for a dtype name, or 0 if it is not supported. */
+static int
+get_dtype_size(const char *dtype)
+{
+    if (!strcmp(dtype, "int32") || !strcmp(dtype, "i4") || !strcmp(dtype, "i"))
+        return 4;
+    if (!strcmp(dtype, "uint8") || !strcmp(dtype, "u1") || !strcmp(dtype, "B"))
+        return 1;
+    return 0;
+}
+
+/* Checks that a buffer holds native integers of the dtype's element size:
+ * signed 32-bit for int32 and unsigned bytes for uint8.
+ */
+static int
+buffer_matches_dtype(const Py_buffer *view, int itemsize)
+{
+    const char *fmt = view->format ? view->format : "B";
+    const uint16_t one = 1;
+    char native = *(const char *) &one ? '<' : '>';
+
+    if (*fmt == '@' || *fmt == '=' || *fmt == native)
+        fmt++;
+    if (view->itemsize != itemsize || fmt[0] == 0 || fmt[1] != 0)
+        return 0;
+    if (itemsize == 1)
+        return *fmt == 'B';
+    return *fmt == 'i' || (*fmt == 'l' && sizeof(long) == 4);
+}
+
+/* Writes n biome IDs from the cache into dst with the given element size.
+ * Narrowing works in place, since dst never overtakes the source.
+ */
+static void
+store_biomes(void *dst, const int *cache, size_t n, int itemsize)
+{
+    size_t i;
+    if (itemsize == 1) {
+        unsigned char *p = (unsigned char *) dst;
+        for (i = 0; i < n; i++)
+            p[i] = (unsigned char) cache[i];
+    } else if (dst != (void *) cache) {
+        memcpy(dst, cache, n * sizeof(int));
+    }
+}
+
 static void
 Generator_dealloc(GeneratorObject *self)
 {
@@ -37,7 +237,12 @@ Generator_init(GeneratorObject *self, PyObject *args, PyObject *kwds)
                                      &mc, &flags))
         return -1;
 
+    if (acquire_generator(self, 1) != 0)
+        return -1;
+    Py_BEGIN_ALLOW_THREADS
     setupGenerator(&self->g, mc, flags);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 1);
     return 0;
 }
 
@@ -52,7 +257,12 @@ Generator_apply_seed(GeneratorObject *self, PyObject *args, PyObject *kwds)
                                      &dim, &seed))
         return NULL;
 
+    if (acquire_generator(self, 1) != 0)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
     applySeed(&self->g, dim, seed);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 1);
     Py_RETURN_NONE;
 }
 
@@ -66,7 +276,13 @@ Generator_get_biome_at(GeneratorObject *self, PyObject *args, PyObject *kwds)
                                      &scale, &x, &y, &z))
         return NULL;
 
-    int biome = getBiomeAt(&self->g, scale, x, y, z);
+    int biome;
+    if (acquire_generator(self, 0) != 0)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    biome = getBiomeAt(&self->g, scale, x, y, z);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 0);
     return PyLong_FromLong(biome);
 }
 
@@ -74,12 +290,24 @@ static PyObject *
 Generator_gen_biomes(GeneratorObject *self, PyObject *args, PyObject *kwds)
 {
     int scale, x, z, sx, sz, y = 0, sy = 1;
-    static char *kwlist[] = {"scale", "x", "z", "sx", "sz", "y", "sy", NULL};
+    const char *dtype = "int32";
+    PyObject *out = Py_None;
+    static char *kwlist[] = {"scale", "x", "z", "sx", "sz", "y", "sy", "dtype", "out", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iiiii|ii", kwlist,
-                                     &scale, &x, &z, &sx, &sz, &y, &sy))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iiiii|iisO", kwlist,
+                                     &scale, &x, &z, &sx, &sz, &y, &sy, &dtype, &out))
         return NULL;
 
+    int itemsize = get_dtype_size(dtype);
+    if (itemsize == 0) {
+        PyErr_Format(PyExc_ValueError, "unsupported dtype '%s', use 'int32' or 'uint8'", dtype);
+        return NULL;
+    }
+    if (sx <= 0 || sz <= 0 || sy <= 0) {
+        PyErr_SetString(PyExc_ValueError, "sx, sz and sy must be positive");
+        return NULL;
+    }
+
     Range r;
     r.scale = scale;
     r.x = x;
@@ -89,38 +317,842 @@ Generator_gen_biomes(GeneratorObject *self, PyObject *args, PyObject *kwds)
     r.y = y;
     r.sy = sy;
 
+    size_t n = (size_t) sx * sz * sy;
     size_t cacheSize = getMinCacheSize(&self->g, scale, sx, sy, sz);
+
+    if (out != Py_None) {
+        // Generate into the caller's buffer, which needs to be writable and
+        // C-contiguous with the element type of the dtype.
+        Py_buffer view;
+        if (PyObject_GetBuffer(out, &view, PyBUF_CONTIG | PyBUF_FORMAT) != 0)
+            return NULL;
+        if (!buffer_matches_dtype(&view, itemsize)) {
+            PyBuffer_Release(&view);
+            PyErr_Format(PyExc_TypeError, "out must be a buffer of %s elements",
+                itemsize == 1 ? "uint8" : "int32");
+            return NULL;
+        }
+        if ((size_t) (view.len / view.itemsize) < n) {
+            PyBuffer_Release(&view);
+            PyErr_Format(PyExc_ValueError, "out must hold at least %zu elements", n);
+            return NULL;
+        }
+        // The buffer only doubles as the generation cache if genBiomes()
+        // does not need more room than the requested area, so the caller's
+        // data beyond it is never touched.
+        int *cache = (int *) view.buf;
+        if (itemsize != sizeof(int) || cacheSize > n) {
+            cache = (int *) malloc(cacheSize * sizeof(int));
+            if (cache == NULL) {
+                PyBuffer_Release(&view);
+                return PyErr_NoMemory();
+            }
+        }
+        if (acquire_generator(self, 0) != 0) {
+            if (cache != (int *) view.buf)
+                free(cache);
+            PyBuffer_Release(&view);
+            return NULL;
+        }
+        int err;
+        Py_BEGIN_ALLOW_THREADS
+        err = genBiomes(&self->g, cache, r);
+        if (!err)
+            store_biomes(view.buf, cache, n, itemsize);
+        Py_END_ALLOW_THREADS
+        release_generator(self, 0);
+        if (cache != (int *) view.buf)
+            free(cache);
+        PyBuffer_Release(&view);
+        if (err) {
+            PyErr_SetString(PyExc_RuntimeError, "genBiomes failed");
+            return NULL;
+        }
+        Py_INCREF(out);
+        return out;
+    }
+
     int *cache = (int *)malloc(cacheSize * sizeof(int));
     if (cache == NULL) {
         return PyErr_NoMemory();
     }
 
-    if (genBiomes(&self->g, cache, r) != 0) {
+    if (acquire_generator(self, 0) != 0) {
         free(cache);
-        PyErr_SetString(PyExc_RuntimeError, "genBiomes failed");
         return NULL;
     }
+    int err;
+    Py_BEGIN_ALLOW_THREADS
+    err = genBiomes(&self->g, cache, r);
+    if (!err)
+        store_biomes(cache, cache, n, itemsize);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 0);
 
-    PyObject *list = PyList_New(cacheSize);
-    if (!list) {
+    if (err) {
         free(cache);
+        PyErr_SetString(PyExc_RuntimeError, "genBiomes failed");
         return NULL;
     }
 
-    for (size_t i = 0; i < cacheSize; i++) {
-        PyObject *val = PyLong_FromLong(cache[i]);
-        if (!val) {
-            Py_DECREF(list);
-            free(cache);
-            return NULL;
+    // The map takes over the cache, trimmed to the requested area.
+    void *data = realloc(cache, n * itemsize);
+    Py_ssize_t shape[3] = { sy, sz, sx };
+    return (PyObject *) new_biome_map(data ? data : cache, 3, shape, itemsize);
+}
+
+/* Shared state of the batch methods, which distribute their work items over
+ * a pool of native threads. Generation only reads the Generator, so it is
+ * shared between the threads, except for seed batches, where each thread
+ * seeds its own clone.
+ */
+typedef struct {
+    const Generator *g;
+    const int *points;      // biomes_at: (x, y, z) triples
+    const Range *ranges;    // gen_biomes_batch: one range per item
+    const uint64_t *seeds;  // gen_biomes_seeds: one seed per item
+    void **outs;
+    Range r;
+    int dim;
+    int estimate;           // get_spawns: use estimateSpawn()
+    int itemsize;
+    size_t cacheSize;       // cache entries needed by any item
+    Py_ssize_t n;
+    volatile int next;
+    volatile int err;
+} BatchJobs;
+
+/* Points are handed out in jobs of POINTS_PER_JOB, and a thread is only
+ * started for at least CELLS_PER_THREAD generated cells, so small batches
+ * run on fewer threads (or on the calling thread alone).
+ */
+enum { POINTS_PER_JOB = 256, CELLS_PER_THREAD = 4096 };
+
+/* Error states of a batch. */
+enum { BATCH_ERR_GEN = 1, BATCH_ERR_MEMORY = 2 };
+
+static void
+batch_points_worker(void *data, int t)
+{
+    BatchJobs *jobs = (BatchJobs *) data;
+    int *cache = (int *) malloc(jobs->cacheSize * sizeof(int));
+    Py_ssize_t i, i0, i1;
+    (void) t;
+
+    if (!cache) {
+        jobs->err = BATCH_ERR_MEMORY;
+        return;
+    }
+    while (!jobs->err) {
+        i0 = (Py_ssize_t) parallelNext(&jobs->next) * POINTS_PER_JOB;
+        if (i0 >= jobs->n)
+            break;
+        i1 = i0 + POINTS_PER_JOB < jobs->n ? i0 + POINTS_PER_JOB : jobs->n;
+        for (i = i0; i < i1; i++) {
+            const int *p = jobs->points + 3*i;
+            Range r = {jobs->r.scale, p[0], p[2], 1, 1, p[1], 1};
+            if (genBiomes(jobs->g, cache, r) != 0) {
+                jobs->err = BATCH_ERR_GEN;
+                break;
+            }
+            int id = cache[0];
+            if (jobs->itemsize == 1)
+                ((unsigned char *) jobs->outs[0])[i] = (unsigned char) id;
+            else
+                ((int *) jobs->outs[0])[i] = id;
         }
-        PyList_SET_ITEM(list, i, val);
     }
+    free(cache);
+}
+
+static void
+batch_ranges_worker(void *data, int t)
+{
+    BatchJobs *jobs = (BatchJobs *) data;
+    int *cache = (int *) malloc(jobs->cacheSize * sizeof(int));
+    int i;
+    (void) t;
+
+    if (!cache) {
+        jobs->err = BATCH_ERR_MEMORY;
+        return;
+    }
+    while (!jobs->err && (i = parallelNext(&jobs->next)) < jobs->n) {
+        Range r = jobs->ranges[i];
+        if (genBiomes(jobs->g, cache, r) != 0) {
+            jobs->err = BATCH_ERR_GEN;
+            break;
+        }
+        store_biomes(jobs->outs[i], cache, (size_t) r.sx * r.sy * r.sz, jobs->itemsize);
+    }
+    free(cache);
+}
+
+static void
+batch_seeds_worker(void *data, int t)
+{
+    BatchJobs *jobs = (BatchJobs *) data;
+    Generator *g = (Generator *) malloc(sizeof(Generator));
+    int *cache = (int *) malloc(jobs->cacheSize * sizeof(int));
+    size_t n = (size_t) jobs->r.sx * jobs->r.sy * jobs->r.sz;
+    int i;
+    (void) t;
 
+    if (!g || !cache) {
+        jobs->err = BATCH_ERR_MEMORY;
+        goto L_end;
+    }
+    setupGenerator(g, jobs->g->mc, jobs->g->flags);
+    while (!jobs->err && (i = parallelNext(&jobs->next)) < jobs->n) {
+        applySeed(g, jobs->dim, jobs->seeds[i]);
+        if (genBiomes(g, cache, jobs->r) != 0) {
+            jobs->err = BATCH_ERR_GEN;
+            break;
+        }
+        store_biomes((char *) jobs->outs[0] + i * n * jobs->itemsize,
+            cache, n, jobs->itemsize);
+    }
+L_end:
     free(cache);
+    free(g);
+}
+
+/* Runs the batch without the GIL over the given number of threads, but at
+ * most 'maxthreads', which the caller derives from the amount of work.
+ */
+static int
+run_batch(GeneratorObject *self, BatchJobs *jobs, void (*func)(void *, int),
+          int threads, Py_ssize_t maxthreads)
+{
+    if (acquire_generator(self, 0) != 0)
+        return -1;
+    jobs->g = &self->g;
+    jobs->next = 0;
+    jobs->err = 0;
+    if (threads > maxthreads)
+        threads = (int) maxthreads;
+    if (threads < 1)
+        threads = 1;
+    Py_BEGIN_ALLOW_THREADS
+    runParallel(threads, func, jobs);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 0);
+    if (jobs->err == BATCH_ERR_MEMORY) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (jobs->err) {
+        PyErr_SetString(PyExc_RuntimeError, "genBiomes failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* Thread limit for a batch of n items that generate 'cells' cells in total. */
+static Py_ssize_t
+batch_thread_limit(Py_ssize_t n, size_t cells)
+{
+    if ((size_t) n <= cells / CELLS_PER_THREAD)
+        return n;
+    return (Py_ssize_t) (cells / CELLS_PER_THREAD) + 1;
+}
+
+static PyObject *
+Generator_biomes_at(GeneratorObject *self, PyObject *args, PyObject *kwds)
+{
+    int scale, threads = 1;
+    PyObject *points;
+    const char *dtype = "int32";
+    static char *kwlist[] = {"scale", "points", "dtype", "threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iO|si", kwlist,
+                                     &scale, &points, &dtype, &threads))
+        return NULL;
+
+    int itemsize = get_dtype_size(dtype);
+    if (itemsize == 0) {
+        PyErr_Format(PyExc_ValueError, "unsupported dtype '%s', use 'int32' or 'uint8'", dtype);
+        return NULL;
+    }
+
+    Py_buffer view;
+    if (PyObject_GetBuffer(points, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+        return NULL;
+    if (view.itemsize != sizeof(int) || (view.len / view.itemsize) % 3 != 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "points must be a buffer of int32 (x, y, z) triples");
+        return NULL;
+    }
+
+    BatchJobs jobs;
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.points = (const int *) view.buf;
+    jobs.n = view.len / view.itemsize / 3;
+    jobs.r.scale = scale;
+    jobs.itemsize = itemsize;
+    jobs.cacheSize = getMinCacheSize(&self->g, scale, 1, 1, 1);
+
+    void *out = malloc(jobs.n ? jobs.n * itemsize : 1);
+    if (!out) {
+        PyBuffer_Release(&view);
+        return PyErr_NoMemory();
+    }
+    jobs.outs = &out;
+
+    int err = run_batch(self, &jobs, batch_points_worker, threads,
+        (jobs.n + POINTS_PER_JOB - 1) / POINTS_PER_JOB);
+    PyBuffer_Release(&view);
+    if (err) {
+        free(out);
+        return NULL;
+    }
+    Py_ssize_t shape[1] = { jobs.n };
+    return (PyObject *) new_biome_map(out, 1, shape, itemsize);
+}
+
+static PyObject *
+Generator_gen_biomes_batch(GeneratorObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *seq, *list = NULL;
+    const char *dtype = "int32";
+    int threads = 1;
+    static char *kwlist[] = {"ranges", "dtype", "threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|si", kwlist,
+                                     &seq, &dtype, &threads))
+        return NULL;
+
+    int itemsize = get_dtype_size(dtype);
+    if (itemsize == 0) {
+        PyErr_Format(PyExc_ValueError, "unsupported dtype '%s', use 'int32' or 'uint8'", dtype);
+        return NULL;
+    }
+
+    seq = PySequence_Fast(seq, "ranges must be a sequence");
+    if (!seq)
+        return NULL;
+
+    BatchJobs jobs;
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.n = PySequence_Fast_GET_SIZE(seq);
+    jobs.itemsize = itemsize;
+    size_t cells = 0;
+    Range *ranges = (Range *) malloc((jobs.n ? jobs.n : 1) * sizeof(Range));
+    void **outs = (void **) malloc((jobs.n ? jobs.n : 1) * sizeof(void *));
+    if (!ranges || !outs) {
+        PyErr_NoMemory();
+        goto L_end;
+    }
+    if (!(list = PyList_New(jobs.n)))
+        goto L_end;
+
+    // The maps are allocated up front, so the threads only fill them in.
+    Py_ssize_t i;
+    for (i = 0; i < jobs.n; i++) {
+        Range *r = &ranges[i];
+        PyObject *tup = PySequence_Tuple(PySequence_Fast_GET_ITEM(seq, i));
+        r->y = 0;
+        r->sy = 1;
+        int ok = tup && PyArg_ParseTuple(tup,
+                "iiiii|ii;ranges must hold (scale, x, z, sx, sz[, y, sy]) tuples",
+                &r->scale, &r->x, &r->z, &r->sx, &r->sz, &r->y, &r->sy);
+        Py_XDECREF(tup);
+        if (!ok)
+            goto L_fail;
+        if (r->sx <= 0 || r->sz <= 0 || r->sy <= 0) {
+            PyErr_SetString(PyExc_ValueError, "sx, sz and sy must be positive");
+            goto L_fail;
+        }
+        size_t cacheSize = getMinCacheSize(&self->g, r->scale, r->sx, r->sy, r->sz);
+        if (cacheSize > jobs.cacheSize)
+            jobs.cacheSize = cacheSize;
+        cells += (size_t) r->sx * r->sy * r->sz;
+        Py_ssize_t shape[3] = { r->sy, r->sz, r->sx };
+        void *data = malloc((size_t) r->sx * r->sy * r->sz * itemsize);
+        if (!data) {
+            PyErr_NoMemory();
+            goto L_fail;
+        }
+        BiomeMapObject *map = new_biome_map(data, 3, shape, itemsize);
+        if (!map)
+            goto L_fail;
+        outs[i] = data;
+        PyList_SET_ITEM(list, i, (PyObject *) map);
+    }
+
+    jobs.ranges = ranges;
+    jobs.outs = outs;
+    if (run_batch(self, &jobs, batch_ranges_worker, threads,
+            batch_thread_limit(jobs.n, cells)) != 0)
+        goto L_fail;
+    goto L_end;
+
+L_fail:
+    Py_CLEAR(list);
+L_end:
+    free(outs);
+    free(ranges);
+    Py_DECREF(seq);
     return list;
 }
 
+static PyObject *
+Generator_gen_biomes_seeds(GeneratorObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *seq;
+    int dim, scale, x, z, sx, sz, y = 0, sy = 1, threads = 1;
+    const char *dtype = "int32";
+    static char *kwlist[] = {"seeds", "dim", "scale", "x", "z", "sx", "sz", "y", "sy",
+                             "dtype", "threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Oiiiiii|iisi", kwlist,
+                                     &seq, &dim, &scale, &x, &z, &sx, &sz, &y, &sy,
+                                     &dtype, &threads))
+        return NULL;
+
+    int itemsize = get_dtype_size(dtype);
+    if (itemsize == 0) {
+        PyErr_Format(PyExc_ValueError, "unsupported dtype '%s', use 'int32' or 'uint8'", dtype);
+        return NULL;
+    }
+    if (sx <= 0 || sz <= 0 || sy <= 0) {
+        PyErr_SetString(PyExc_ValueError, "sx, sz and sy must be positive");
+        return NULL;
+    }
+
+    seq = PySequence_Fast(seq, "seeds must be a sequence");
+    if (!seq)
+        return NULL;
+
+    BatchJobs jobs;
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.n = PySequence_Fast_GET_SIZE(seq);
+    jobs.dim = dim;
+    jobs.itemsize = itemsize;
+    jobs.r.scale = scale;
+    jobs.r.x = x;
+    jobs.r.z = z;
+    jobs.r.sx = sx;
+    jobs.r.sz = sz;
+    jobs.r.y = y;
+    jobs.r.sy = sy;
+    // the cache size depends on the dimension the clones are seeded for
+    Generator *tmp = (Generator *) malloc(sizeof(Generator));
+    if (!tmp) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    *tmp = self->g;
+    tmp->dim = dim;
+    jobs.cacheSize = getMinCacheSize(tmp, scale, sx, sy, sz);
+    free(tmp);
+
+    size_t n = (size_t) sx * sy * sz;
+    uint64_t *seeds = (uint64_t *) malloc((jobs.n ? jobs.n : 1) * sizeof(uint64_t));
+    void *out = malloc((jobs.n ? jobs.n : 1) * n * itemsize);
+    if (!seeds || !out) {
+        free(seeds);
+        free(out);
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    Py_ssize_t i;
+    for (i = 0; i < jobs.n; i++) {
+        // same conversion as apply_seed(): negative seeds wrap around
+        seeds[i] = PyLong_AsUnsignedLongLongMask(PySequence_Fast_GET_ITEM(seq, i));
+        if (seeds[i] == (uint64_t) -1 && PyErr_Occurred())
+            break;
+    }
+    Py_DECREF(seq);
+
+    jobs.seeds = seeds;
+    jobs.outs = &out;
+    if (PyErr_Occurred() ||
+        run_batch(self, &jobs, batch_seeds_worker, threads,
+            batch_thread_limit(jobs.n, (size_t) jobs.n * n)) != 0) {
+        free(seeds);
+        free(out);
+        return NULL;
+    }
+    free(seeds);
+
+    Py_ssize_t shape[4] = { jobs.n, sy, sz, sx };
+    return (PyObject *) new_biome_map(out, 4, shape, itemsize);
+}
+
+/* Gets a C-contiguous int32 buffer of (x, z) pairs as positions. */
+static int
+get_pos_buffer(PyObject *obj, Py_buffer *view, const char *name)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+        return -1;
+    if (view->itemsize != sizeof(int) || (view->len / view->itemsize) % 2 != 0) {
+        PyBuffer_Release(view);
+        PyErr_Format(PyExc_ValueError, "%s must be a buffer of int32 (x, z) pairs", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Converts a sequence of seeds into a malloc'd array, wrapping negative
+ * values around as apply_seed() does.
+ */
+static uint64_t *
+get_seed_array(PyObject *obj, Py_ssize_t *n)
+{
+    PyObject *seq = PySequence_Fast(obj, "seeds must be a sequence");
+    uint64_t *seeds;
+    Py_ssize_t i;
+
+    if (!seq)
+        return NULL;
+    *n = PySequence_Fast_GET_SIZE(seq);
+    seeds = (uint64_t *) malloc((*n ? *n : 1) * sizeof(uint64_t));
+    if (!seeds) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (i = 0; i < *n; i++) {
+        seeds[i] = PyLong_AsUnsignedLongLongMask(PySequence_Fast_GET_ITEM(seq, i));
+        if (seeds[i] == (uint64_t) -1 && PyErr_Occurred()) {
+            free(seeds);
+            seeds = NULL;
+            break;
+        }
+    }
+    Py_DECREF(seq);
+    return seeds;
+}
+
+/* Packs positions and validity flags into a (pos, valid) tuple of maps. */
+static PyObject *
+new_pos_result(Pos *pos, char *valid, int ndim, const Py_ssize_t *shape)
+{
+    Py_ssize_t pshape[3];
+    int i;
+    for (i = 0; i < ndim; i++)
+        pshape[i] = shape[i];
+    pshape[ndim] = 2;
+
+    PyObject *p = (PyObject *) new_biome_map(pos, ndim+1, pshape, sizeof(int));
+    if (!p) {
+        free(valid);
+        return NULL;
+    }
+    PyObject *v = (PyObject *) new_biome_map(valid, ndim, shape, 1);
+    if (!v) {
+        Py_DECREF(p);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", p, v);
+}
+
+static PyObject *
+Generator_are_viable_structure_pos(GeneratorObject *self, PyObject *args, PyObject *kwds)
+{
+    int stype;
+    unsigned int flags = 0;
+    PyObject *positions;
+    static char *kwlist[] = {"stype", "positions", "flags", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iO|I", kwlist,
+                                     &stype, &positions, &flags))
+        return NULL;
+
+    Py_buffer view;
+    if (get_pos_buffer(positions, &view, "positions") != 0)
+        return NULL;
+    int n = (int) (view.len / view.itemsize / 2);
+    char *viable = (char *) malloc(n ? n : 1);
+    if (!viable) {
+        PyBuffer_Release(&view);
+        return PyErr_NoMemory();
+    }
+    // the check may temporarily modify the generator, so it needs it alone
+    if (acquire_generator(self, 1) != 0) {
+        PyBuffer_Release(&view);
+        free(viable);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    areViableStructurePos(stype, &self->g, (const Pos *) view.buf, n, flags, viable);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 1);
+    PyBuffer_Release(&view);
+
+    Py_ssize_t shape[1] = { n };
+    return (PyObject *) new_biome_map(viable, 1, shape, 1);
+}
+
+static PyObject *
+Generator_get_strongholds(GeneratorObject *self, PyObject *args, PyObject *kwds)
+{
+    int n = 128, threads = 1;
+    static char *kwlist[] = {"n", "threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ii", kwlist, &n, &threads))
+        return NULL;
+    if (n < 0)
+        n = 0;
+
+    Pos *pos = (Pos *) malloc((n ? n : 1) * sizeof(Pos));
+    if (!pos)
+        return PyErr_NoMemory();
+    if (acquire_generator(self, 0) != 0) {
+        free(pos);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    n = getStrongholds(pos, n, &self->g, threads < 1 ? 1 : threads);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 0);
+    if (n < 0) {
+        free(pos);
+        return PyErr_NoMemory();
+    }
+
+    Py_ssize_t shape[2] = { n, 2 };
+    return (PyObject *) new_biome_map(pos, 2, shape, sizeof(int));
+}
+
+static PyObject *
+Generator_get_spawn(GeneratorObject *self, PyObject *args, PyObject *kwds)
+{
+    int estimate = 0;
+    static char *kwlist[] = {"estimate", NULL};
+    Pos p;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &estimate))
+        return NULL;
+    if (acquire_generator(self, 0) != 0)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    p = estimate ? estimateSpawn(&self->g, NULL) : getSpawn(&self->g);
+    Py_END_ALLOW_THREADS
+    release_generator(self, 0);
+    return Py_BuildValue("(ii)", p.x, p.z);
+}
+
+static void
+batch_spawn_worker(void *data, int t)
+{
+    BatchJobs *jobs = (BatchJobs *) data;
+    Generator *g = (Generator *) malloc(sizeof(Generator));
+    Pos *out = (Pos *) jobs->outs[0];
+    int i;
+    (void) t;
+
+    if (!g) {
+        jobs->err = BATCH_ERR_MEMORY;
+        return;
+    }
+    setupGenerator(g, jobs->g->mc, jobs->g->flags);
+    while (!jobs->err && (i = parallelNext(&jobs->next)) < jobs->n) {
+        applySeed(g, DIM_OVERWORLD, jobs->seeds[i]);
+        out[i] = jobs->estimate ? estimateSpawn(g, NULL) : getSpawn(g);
+    }
+    free(g);
+}
+
+static PyObject *
+Generator_get_spawns(GeneratorObject *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *obj;
+    int estimate = 0, threads = 1;
+    static char *kwlist[] = {"seeds", "estimate", "threads", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|pi", kwlist,
+                                     &obj, &estimate, &threads))
+        return NULL;
+
+    BatchJobs jobs;
+    memset(&jobs, 0, sizeof(jobs));
+    uint64_t *seeds = get_seed_array(obj, &jobs.n);
+    if (!seeds)
+        return NULL;
+    Pos *pos = (Pos *) malloc((jobs.n ? jobs.n : 1) * sizeof(Pos));
+    if (!pos) {
+        free(seeds);
+        return PyErr_NoMemory();
+    }
+    void *out = pos;
+    jobs.seeds = seeds;
+    jobs.outs = &out;
+    jobs.estimate = estimate;
+    int err = run_batch(self, &jobs, batch_spawn_worker, threads, jobs.n);
+    free(seeds);
+    if (err) {
+        free(pos);
+        return NULL;
+    }
+    Py_ssize_t shape[2] = { jobs.n, 2 };
+    return (PyObject *) new_biome_map(pos, 2, shape, sizeof(int));
+}
+
+static PyObject *
+mc_worldgen_get_structure_pos_grid(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    int stype, mc, reg_x, reg_z, reg_w, reg_h;
+    unsigned long long seed;
+    static char *kwlist[] = {"stype", "mc", "seed", "reg_x", "reg_z", "reg_w", "reg_h", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iiKiiii", kwlist,
+                                     &stype, &mc, &seed, &reg_x, &reg_z, &reg_w, &reg_h))
+        return NULL;
+    if (reg_w <= 0 || reg_h <= 0) {
+        PyErr_SetString(PyExc_ValueError, "reg_w and reg_h must be positive");
+        return NULL;
+    }
+
+    size_t n = (size_t) reg_w * reg_h;
+    Pos *pos = (Pos *) malloc(n * sizeof(Pos));
+    char *valid = (char *) malloc(n);
+    if (!pos || !valid) {
+        free(pos);
+        free(valid);
+        return PyErr_NoMemory();
+    }
+    int cnt;
+    Py_BEGIN_ALLOW_THREADS
+    cnt = getStructurePosGrid(stype, mc, seed, reg_x, reg_z, reg_w, reg_h, pos, valid);
+    Py_END_ALLOW_THREADS
+    if (cnt < 0) {
+        free(pos);
+        free(valid);
+        PyErr_Format(PyExc_ValueError, "structure type %d is not supported for this version", stype);
+        return NULL;
+    }
+
+    Py_ssize_t shape[2] = { reg_h, reg_w };
+    return new_pos_result(pos, valid, 2, shape);
+}
+
+static PyObject *
+mc_worldgen_get_structure_pos_seeds(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    int stype, mc, reg_x, reg_z;
+    PyObject *obj;
+    static char *kwlist[] = {"stype", "mc", "seeds", "reg_x", "reg_z", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "iiOii", kwlist,
+                                     &stype, &mc, &obj, &reg_x, &reg_z))
+        return NULL;
+
+    StructureConfig sconf;
+    if (!getStructureConfig(stype, mc, &sconf)) {
+        PyErr_Format(PyExc_ValueError, "structure type %d is not supported for this version", stype);
+        return NULL;
+    }
+    Py_ssize_t i, n;
+    uint64_t *seeds = get_seed_array(obj, &n);
+    if (!seeds)
+        return NULL;
+    Pos *pos = (Pos *) malloc((n ? n : 1) * sizeof(Pos));
+    char *valid = (char *) malloc(n ? n : 1);
+    if (!pos || !valid) {
+        free(seeds);
+        free(pos);
+        free(valid);
+        return PyErr_NoMemory();
+    }
+    Py_BEGIN_ALLOW_THREADS
+    for (i = 0; i < n; i++)
+        valid[i] = getStructurePos(stype, mc, seeds[i], reg_x, reg_z, &pos[i]) != 0;
+    Py_END_ALLOW_THREADS
+    free(seeds);
+
+    Py_ssize_t shape[1] = { n };
+    return new_pos_result(pos, valid, 1, shape);
+}
+
+/* A quad-base search that runs on its own native thread, so that the calling
+ * thread can keep handling signals and stop it on an interrupt.
+ */
+typedef struct {
+    StructureConfig sconf;
+    int radius, threads;
+    const char *path, *cachedir;
+    uint64_t *seeds;
+    uint64_t n;
+    int err;
+    volatile char stop;
+    PyThread_type_lock done;    // held until the search has finished
+} QuadSearch;
+
+static void
+quad_search_thread(void *arg)
+{
+    QuadSearch *qs = (QuadSearch *) arg;
+    qs->err = searchQuadBases(&qs->seeds, &qs->n, qs->path, qs->threads,
+        qs->sconf, qs->radius, qs->cachedir, &qs->stop);
+    PyThread_release_lock(qs->done);
+}
+
+static PyObject *
+mc_worldgen_search_quad_bases(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    int stype, mc, radius = 128, threads = 1;
+    const char *path = NULL, *cachedir = NULL;
+    static char *kwlist[] = {"stype", "mc", "radius", "threads", "path", "cachedir", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "ii|iizz", kwlist,
+                                     &stype, &mc, &radius, &threads, &path, &cachedir))
+        return NULL;
+
+    QuadSearch qs;
+    memset(&qs, 0, sizeof(qs));
+    if (!getStructureConfig(stype, mc, &qs.sconf)) {
+        PyErr_Format(PyExc_ValueError, "structure type %d is not supported for this version", stype);
+        return NULL;
+    }
+    qs.radius = radius;
+    qs.threads = threads < 1 ? 1 : threads;
+    qs.path = path;
+    qs.cachedir = cachedir;
+
+    if (!(qs.done = PyThread_allocate_lock()))
+        return PyErr_NoMemory();
+    PyThread_acquire_lock(qs.done, WAIT_LOCK);
+    if (PyThread_start_new_thread(quad_search_thread, &qs) == PYTHREAD_INVALID_THREAD_ID) {
+        PyThread_release_lock(qs.done);
+        PyThread_free_lock(qs.done);
+        PyErr_SetString(PyExc_RuntimeError, "can't start the search thread");
+        return NULL;
+    }
+
+    // Wait for the search without the GIL, but check for signals (Ctrl-C)
+    // every 100 ms and stop the search on an exception.
+    int interrupted = 0;
+    for (;;) {
+        PyLockStatus st;
+        Py_BEGIN_ALLOW_THREADS
+        st = PyThread_acquire_lock_timed(qs.done, interrupted ? -1 : 100000, 0);
+        Py_END_ALLOW_THREADS
+        if (st == PY_LOCK_ACQUIRED)
+            break;
+        if (!interrupted && PyErr_CheckSignals() != 0) {
+            qs.stop = 1;
+            interrupted = 1;
+        }
+    }
+    PyThread_release_lock(qs.done);
+    PyThread_free_lock(qs.done);
+
+    if (interrupted || qs.err) {
+        free(qs.seeds);
+        if (!interrupted)
+            PyErr_SetString(PyExc_RuntimeError, "searchQuadBases failed");
+        return NULL;
+    }
+
+    if (!qs.seeds && !(qs.seeds = (uint64_t *) malloc(1)))
+        return PyErr_NoMemory();
+    Py_ssize_t shape[1] = { (Py_ssize_t) qs.n };
+    return (PyObject *) new_biome_map(qs.seeds, 1, shape, 8);
+}
+
 PyDoc_STRVAR(apply_seed_doc,
 "apply_seed(dim, seed)\n"
 "--\n\n"
@@ -142,7 +1174,7 @@ PyDoc_STRVAR(get_biome_at_doc,
 "    int: The Biome ID.");
 
 PyDoc_STRVAR(gen_biomes_doc,
-"gen_biomes(scale, x, z, sx, sz, y=0, sy=1)\n"
+"gen_biomes(scale, x, z, sx, sz, y=0, sy=1, dtype='int32', out=None)\n"
 "--\n\n"
 "Generate biomes for a given range.\n\n"
 "Args:\n"
@@ -152,9 +1184,82 @@ PyDoc_STRVAR(gen_biomes_doc,
 "    sx (int): The horizontal size in X direction.\n"
 "    sz (int): The horizontal size in Z direction.\n"
 "    y (int, optional): The starting Y coordinate. Defaults to 0.\n"
-"    sy (int, optional): The vertical size. Defaults to 1.\n\n"
+"    sy (int, optional): The vertical size. Defaults to 1.\n"
+"    dtype (str, optional): 'int32' or 'uint8'. Defaults to 'int32'.\n"
+"    out (buffer, optional): A writable C-contiguous buffer with at least\n"
+"        sy*sz*sx elements of the dtype to generate into.\n\n"
+"Returns:\n"
+"    BiomeMap: The biome IDs, shaped (sy, sz, sx), or out if it was given.");
+
+PyDoc_STRVAR(biomes_at_doc,
+"biomes_at(scale, points, dtype='int32', threads=1)\n"
+"--\n\n"
+"Get the biome IDs at many coordinates, like get_biome_at().\n\n"
+"Args:\n"
+"    scale (int): The horizontal scale factor (1, 4, 16, 64, or 256).\n"
+"    points (buffer): C-contiguous int32 buffer of (x, y, z) triples.\n"
+"    dtype (str, optional): 'int32' or 'uint8'. Defaults to 'int32'.\n"
+"    threads (int, optional): Number of native threads. Defaults to 1.\n\n"
+"Returns:\n"
+"    BiomeMap: The biome IDs, shaped (n,).");
+
+PyDoc_STRVAR(gen_biomes_batch_doc,
+"gen_biomes_batch(ranges, dtype='int32', threads=1)\n"
+"--\n\n"
+"Generate biomes for many ranges, like gen_biomes().\n\n"
+"Args:\n"
+"    ranges (sequence): Tuples of (scale, x, z, sx, sz[, y, sy]).\n"
+"    dtype (str, optional): 'int32' or 'uint8'. Defaults to 'int32'.\n"
+"    threads (int, optional): Number of native threads. Defaults to 1.\n\n"
 "Returns:\n"
-"    list[int]: A flat list of biome IDs.");
+"    list[BiomeMap]: One map per range, shaped (sy, sz, sx).");
+
+PyDoc_STRVAR(gen_biomes_seeds_doc,
+"gen_biomes_seeds(seeds, dim, scale, x, z, sx, sz, y=0, sy=1, dtype='int32', threads=1)\n"
+"--\n\n"
+"Generate the same range for many world seeds. Each thread works on its own\n"
+"copy of the generator, so the seed of this generator is left unchanged.\n\n"
+"Args:\n"
+"    seeds (sequence): The 64-bit integer world seeds.\n"
+"    dim (int): The dimension.\n"
+"    scale, x, z, sx, sz, y, sy: The range, as for gen_biomes().\n"
+"    dtype (str, optional): 'int32' or 'uint8'. Defaults to 'int32'.\n"
+"    threads (int, optional): Number of native threads. Defaults to 1.\n\n"
+"Returns:\n"
+"    BiomeMap: The biome IDs, shaped (len(seeds), sy, sz, sx).");
+
+PyDoc_STRVAR(are_viable_structure_pos_doc,
+"are_viable_structure_pos(stype, positions, flags=0)\n"
+"--\n\n"
+"Check the biome requirements of structure attempts at many block positions.\n\n"
+"Args:\n"
+"    stype (int): The structure type (use Structure constants).\n"
+"    positions (buffer): C-contiguous int32 buffer of (x, z) block positions.\n"
+"    flags (int, optional): Structure specific flags. Defaults to 0.\n\n"
+"Returns:\n"
+"    BiomeMap: uint8 flags, 1 for viable positions, shaped (n,).");
+
+PyDoc_STRVAR(get_strongholds_doc,
+"get_strongholds(n=128, threads=1)\n"
+"--\n\n"
+"Find the accurate positions of the first n strongholds for the applied seed.\n\n"
+"Returns:\n"
+"    BiomeMap: int32 block positions, shaped (count, 2).");
+
+PyDoc_STRVAR(get_spawn_doc,
+"get_spawn(estimate=False)\n"
+"--\n\n"
+"Find the world spawn for the applied seed, or its faster estimate.\n\n"
+"Returns:\n"
+"    tuple[int, int]: The (x, z) block position.");
+
+PyDoc_STRVAR(get_spawns_doc,
+"get_spawns(seeds, estimate=False, threads=1)\n"
+"--\n\n"
+"Find the world spawn for many seeds. Each thread works on its own copy of\n"
+"the generator, so the seed of this generator is left unchanged.\n\n"
+"Returns:\n"
+"    BiomeMap: int32 block positions, shaped (len(seeds), 2).");
 
 static PyMethodDef Generator_methods[] = {
     {"apply_seed", (PyCFunction)(void(*)(void)) Generator_apply_seed, METH_VARARGS | METH_KEYWORDS,
@@ -163,6 +1268,20 @@ static PyMethodDef Generator_methods[] = {
      get_biome_at_doc},
     {"gen_biomes", (PyCFunction)(void(*)(void)) Generator_gen_biomes, METH_VARARGS | METH_KEYWORDS,
      gen_biomes_doc},
+    {"biomes_at", (PyCFunction)(void(*)(void)) Generator_biomes_at, METH_VARARGS | METH_KEYWORDS,
+     biomes_at_doc},
+    {"gen_biomes_batch", (PyCFunction)(void(*)(void)) Generator_gen_biomes_batch, METH_VARARGS | METH_KEYWORDS,
+     gen_biomes_batch_doc},
+    {"gen_biomes_seeds", (PyCFunction)(void(*)(void)) Generator_gen_biomes_seeds, METH_VARARGS | METH_KEYWORDS,
+     gen_biomes_seeds_doc},
+    {"are_viable_structure_pos", (PyCFunction)(void(*)(void)) Generator_are_viable_structure_pos, METH_VARARGS | METH_KEYWORDS,
+     are_viable_structure_pos_doc},
+    {"get_strongholds", (PyCFunction)(void(*)(void)) Generator_get_strongholds, METH_VARARGS | METH_KEYWORDS,
+     get_strongholds_doc},
+    {"get_spawn", (PyCFunction)(void(*)(void)) Generator_get_spawn, METH_VARARGS | METH_KEYWORDS,
+     get_spawn_doc},
+    {"get_spawns", (PyCFunction)(void(*)(void)) Generator_get_spawns, METH_VARARGS | METH_KEYWORDS,
+     get_spawns_doc},
     {NULL}  /* Sentinel */
 };
 
@@ -187,11 +1306,46 @@ static PyTypeObject GeneratorType = {
     .tp_methods = Generator_methods,
 };
 
+PyDoc_STRVAR(get_structure_pos_grid_doc,
+"get_structure_pos_grid(stype, mc, seed, reg_x, reg_z, reg_w, reg_h)\n"
+"--\n\n"
+"Find the structure generation attempts for a rectangle of regions.\n\n"
+"Returns:\n"
+"    tuple[BiomeMap, BiomeMap]: int32 block positions, shaped (reg_h, reg_w, 2),\n"
+"    and uint8 flags for the valid attempts, shaped (reg_h, reg_w).");
+
+PyDoc_STRVAR(get_structure_pos_seeds_doc,
+"get_structure_pos_seeds(stype, mc, seeds, reg_x, reg_z)\n"
+"--\n\n"
+"Find the structure generation attempt in one region for many seeds.\n\n"
+"Returns:\n"
+"    tuple[BiomeMap, BiomeMap]: int32 block positions, shaped (len(seeds), 2),\n"
+"    and uint8 flags for the valid attempts, shaped (len(seeds),).");
+
+PyDoc_STRVAR(search_quad_bases_doc,
+"search_quad_bases(stype, mc, radius=128, threads=1, path=None, cachedir=None)\n"
+"--\n\n"
+"Search all 48-bit seeds for quad-structure bases. This is a lengthy search,\n"
+"so the results can also be written to a file at 'path' as they are found.\n\n"
+"Returns:\n"
+"    BiomeMap: The uint64 48-bit seed bases, shaped (n,).");
+
+static PyMethodDef mc_worldgen_methods[] = {
+    {"get_structure_pos_grid", (PyCFunction)(void(*)(void)) mc_worldgen_get_structure_pos_grid, METH_VARARGS | METH_KEYWORDS,
+     get_structure_pos_grid_doc},
+    {"get_structure_pos_seeds", (PyCFunction)(void(*)(void)) mc_worldgen_get_structure_pos_seeds, METH_VARARGS | METH_KEYWORDS,
+     get_structure_pos_seeds_doc},
+    {"search_quad_bases", (PyCFunction)(void(*)(void)) mc_worldgen_search_quad_bases, METH_VARARGS | METH_KEYWORDS,
+     search_quad_bases_doc},
+    {NULL}  /* Sentinel */
+};
+
 static PyModuleDef mc_worldgenmodule = {
     PyModuleDef_HEAD_INIT,
     .m_name = "mc_worldgen._mc_worldgen",
     .m_doc = "Python wrapper for cubiomes Minecraft world generation library.",
     .m_size = -1,
+    .m_methods = mc_worldgen_methods,
 };
 
 static PyObject* create_enum_class(const char* name, const char* doc) {
@@ -225,6 +1379,8 @@ PyInit__mc_worldgen(void)
     PyObject *m;
     if (PyType_Ready(&GeneratorType) < 0)
         return NULL;
+    if (PyType_Ready(&BiomeMapType) < 0)
+        return NULL;
 
     m = PyModule_Create(&mc_worldgenmodule);
     if (m == NULL)
@@ -237,6 +1393,13 @@ PyInit__mc_worldgen(void)
         return NULL;
     }
 
+    Py_INCREF(&BiomeMapType);
+    if (PyModule_AddObject(m, "BiomeMap", (PyObject *) &BiomeMapType) < 0) {
+        Py_DECREF(&BiomeMapType);
+        Py_DECREF(m);
+        return NULL;
+    }
+
     PyObject *Version = create_enum_class("Version", "Minecraft versions");
     PyModule_AddObject(m, "Version", Version);
     ADD_TO_CLASS(Version, MC_B1_7, MC_B1_7);
@@ -280,6 +1443,34 @@ PyInit__mc_worldgen(void)
     ADD_TO_CLASS(Flag, NO_BETA_OCEAN, NO_BETA_OCEAN);
     ADD_TO_CLASS(Flag, FORCE_OCEAN_VARIANTS, FORCE_OCEAN_VARIANTS);
 
+    PyObject *Structure = create_enum_class("Structure", "Structure types");
+    PyModule_AddObject(m, "Structure", Structure);
+    ADD_TO_CLASS(Structure, Feature, Feature);
+    ADD_TO_CLASS(Structure, Desert_Pyramid, Desert_Pyramid);
+    ADD_TO_CLASS(Structure, Jungle_Temple, Jungle_Temple);
+    ADD_TO_CLASS(Structure, Swamp_Hut, Swamp_Hut);
+    ADD_TO_CLASS(Structure, Igloo, Igloo);
+    ADD_TO_CLASS(Structure, Village, Village);
+    ADD_TO_CLASS(Structure, Ocean_Ruin, Ocean_Ruin);
+    ADD_TO_CLASS(Structure, Shipwreck, Shipwreck);
+    ADD_TO_CLASS(Structure, Monument, Monument);
+    ADD_TO_CLASS(Structure, Mansion, Mansion);
+    ADD_TO_CLASS(Structure, Outpost, Outpost);
+    ADD_TO_CLASS(Structure, Ruined_Portal, Ruined_Portal);
+    ADD_TO_CLASS(Structure, Ruined_Portal_N, Ruined_Portal_N);
+    ADD_TO_CLASS(Structure, Ancient_City, Ancient_City);
+    ADD_TO_CLASS(Structure, Treasure, Treasure);
+    ADD_TO_CLASS(Structure, Mineshaft, Mineshaft);
+    ADD_TO_CLASS(Structure, Desert_Well, Desert_Well);
+    ADD_TO_CLASS(Structure, Geode, Geode);
+    ADD_TO_CLASS(Structure, Fortress, Fortress);
+    ADD_TO_CLASS(Structure, Bastion, Bastion);
+    ADD_TO_CLASS(Structure, End_City, End_City);
+    ADD_TO_CLASS(Structure, End_Gateway, End_Gateway);
+    ADD_TO_CLASS(Structure, End_Island, End_Island);
+    ADD_TO_CLASS(Structure, Trail_Ruins, Trail_Ruins);
+    ADD_TO_CLASS(Structure, Trial_Chambers, Trial_Chambers);
+
     PyObject *Biome = create_enum_class("Biome", "Biome IDs");
     PyModule_AddObject(m, "Biome", Biome);
     ADD_TO_CLASS(Biome, ocean, ocean);
@@ -1,5 +1,6 @@
 #include "quadbase.h"
 #include "util.h"
+#include "parallel.h"
 
 #include <string.h>
 #include <limits.h>
@@ -240,8 +241,9 @@ STRUCT(threadinfo_t)
     int lowBitN;
     char skipStart;
 
-    // testing function
+    // testing function, either per seed or for batches of seeds
     int (*check)(uint64_t, void*);
+    uint32_t (*checkBatch)(const uint64_t*, int, void*);
     void *data;
 
     // abort check
@@ -286,6 +288,44 @@ static int mkdirp(char *path)
 }
 
 
+static void outputSeed(threadinfo_t *info, linked_seeds_t **lp, uint64_t seed)
+{
+    if (seed == info->start && info->skipStart) {} // skip
+    else if (info->fp)
+    {
+        fprintf(info->fp, "%" PRId64"\n", (int64_t)seed);
+        fflush(info->fp);
+    }
+    else
+    {
+        (*lp)->seeds[(*lp)->len] = seed;
+        (*lp)->len++;
+        if ((*lp)->len >= sizeof((*lp)->seeds)/sizeof(uint64_t))
+        {
+            linked_seeds_t *n =
+                (linked_seeds_t*) malloc(sizeof(linked_seeds_t));
+            if (n == NULL)
+                exit(1);
+            (*lp)->next = n;
+            *lp = n;
+            (*lp)->len = 0;
+            (*lp)->next = NULL;
+        }
+    }
+}
+
+static void checkSeedBatch(threadinfo_t *info, linked_seeds_t **lp,
+        const uint64_t *buf, int n)
+{
+    uint32_t mask = info->checkBatch(buf, n, info->data);
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        if unlikely(mask >> i & 1)
+            outputSeed(info, lp, buf[i]);
+    }
+}
+
 #ifdef USE_PTHREAD
 static void *searchAll48Thread(void *data)
 #else
@@ -303,6 +343,9 @@ static DWORD WINAPI searchAll48Thread(LPVOID data)
     lp->len = 0;
     lp->next = NULL;
 
+    uint64_t buf[QUADBASE_BATCH];
+    int nbuf = 0;
+
     if (info->lowBits)
     {
         uint64_t hstep = 1ULL << info->lowBitN;
@@ -313,35 +356,31 @@ static DWORD WINAPI searchAll48Thread(LPVOID data)
         for (cnt = 0; info->lowBits[cnt]; cnt++);
 
         mid = info->start & hmask;
-        for (idx = 0; (seed = mid | info->lowBits[idx]) < info->start; idx++);
+        for (idx = 0; idx < cnt; idx++)
+            if ((seed = mid | info->lowBits[idx]) >= info->start)
+                break;
+        if (idx >= cnt)
+        {
+            idx = 0;
+            mid += hstep;
+            seed = mid | info->lowBits[0];
+        }
 
-        while (seed <= end)
+        while (cnt && seed <= end)
         {
-            if unlikely(info->check(seed, info->data))
+            if (info->checkBatch)
             {
-                if (seed == info->start && info->skipStart) {} // skip
-                else if (info->fp)
-                {
-                    fprintf(info->fp, "%" PRId64"\n", (int64_t)seed);
-                    fflush(info->fp);
-                }
-                else
+                buf[nbuf++] = seed;
+                if (nbuf == QUADBASE_BATCH)
                 {
-                    lp->seeds[lp->len] = seed;
-                    lp->len++;
-                    if (lp->len >= sizeof(lp->seeds)/sizeof(uint64_t))
-                    {
-                        linked_seeds_t *n =
-                            (linked_seeds_t*) malloc(sizeof(linked_seeds_t));
-                        if (n == NULL)
-                            exit(1);
-                        lp->next = n;
-                        lp = n;
-                        lp->len = 0;
-                        lp->next = NULL;
-                    }
+                    checkSeedBatch(info, &lp, buf, nbuf);
+                    nbuf = 0;
                 }
             }
+            else if unlikely(info->check(seed, info->data))
+            {
+                outputSeed(info, &lp, seed);
+            }
 
             idx++;
             if (idx >= cnt)
@@ -359,37 +398,28 @@ static DWORD WINAPI searchAll48Thread(LPVOID data)
     {
         while (seed <= end)
         {
-            if unlikely(info->check(seed, info->data))
+            if (info->checkBatch)
             {
-                if (seed == info->start && info->skipStart) {} // skip
-                else if (info->fp)
+                buf[nbuf++] = seed;
+                if (nbuf == QUADBASE_BATCH)
                 {
-                    fprintf(info->fp, "%" PRId64"\n", (int64_t)seed);
-                    fflush(info->fp);
-                }
-                else
-                {
-                    lp->seeds[lp->len] = seed;
-                    lp->len++;
-                    if (lp->len >= sizeof(lp->seeds)/sizeof(uint64_t))
-                    {
-                        linked_seeds_t *n =
-                            (linked_seeds_t*) malloc(sizeof(linked_seeds_t));
-                        if (n == NULL)
-                            exit(1);
-                        lp->next = n;
-                        lp = n;
-                        lp->len = 0;
-                        lp->next = NULL;
-                    }
+                    checkSeedBatch(info, &lp, buf, nbuf);
+                    nbuf = 0;
                 }
             }
+            else if unlikely(info->check(seed, info->data))
+            {
+                outputSeed(info, &lp, seed);
+            }
             seed++;
             if ((seed & 0xfff) == 0 && info->stop && *info->stop)
                 break;
         }
     }
 
+    if (nbuf)
+        checkSeedBatch(info, &lp, buf, nbuf);
+
 #ifdef USE_PTHREAD
     pthread_exit(NULL);
 #endif
@@ -397,7 +427,7 @@ static DWORD WINAPI searchAll48Thread(LPVOID data)
 }
 
 
-int searchAll48(
+static int searchAll48Impl(
         uint64_t **         seedbuf,
         uint64_t *          buflen,
         const char *        path,
@@ -405,6 +435,7 @@ int searchAll48(
         const uint64_t *    lowBits,
         int                 lowBitN,
         int (*check)(uint64_t s48, void *data),
+        uint32_t (*checkBatch)(const uint64_t *s48, int n, void *data),
         void *              data,
         volatile char *     stop
         )
@@ -450,6 +481,7 @@ int searchAll48(
         info[t].lowBitN = lowBitN;
         info[t].skipStart = 0;
         info[t].check = check;
+        info[t].checkBatch = checkBatch;
         info[t].data = data;
         info[t].stop = stop;
 
@@ -605,6 +637,38 @@ L_err:
     return err;
 }
 
+int searchAll48(
+        uint64_t **         seedbuf,
+        uint64_t *          buflen,
+        const char *        path,
+        int                 threads,
+        const uint64_t *    lowBits,
+        int                 lowBitN,
+        int (*check)(uint64_t s48, void *data),
+        void *              data,
+        volatile char *     stop
+        )
+{
+    return searchAll48Impl(seedbuf, buflen, path, threads, lowBits, lowBitN,
+        check, NULL, data, stop);
+}
+
+int searchAll48Batch(
+        uint64_t **         seedbuf,
+        uint64_t *          buflen,
+        const char *        path,
+        int                 threads,
+        const uint64_t *    lowBits,
+        int                 lowBitN,
+        uint32_t (*check)(const uint64_t *s48, int n, void *data),
+        void *              data,
+        volatile char *     stop
+        )
+{
+    return searchAll48Impl(seedbuf, buflen, path, threads, lowBits, lowBitN,
+        NULL, check, data, stop);
+}
+
 static inline
 int scanForQuadBits(const StructureConfig sconf, int radius, uint64_t s48,
         uint64_t lbit, int lbitn, uint64_t invB, int64_t x, int64_t z,
@@ -671,4 +735,425 @@ int scanForQuads(
     return cnt;
 }
 
+STRUCT(quadscan_job_t)
+{
+    int sidx, bidx;
+    int x, w;
+    Pos *qp;
+    int cnt;
+};
+
+STRUCT(quadscan_t)
+{
+    StructureConfig sconf;
+    int radius;
+    const uint64_t *s48;
+    const uint64_t *lowBits;
+    int lowBitN;
+    uint64_t salt, invB;
+    int z, h, n;
+    quadscan_job_t *jobs;
+    int end;
+    volatile int next;
+    volatile int err;
+};
+
+static void scanForQuadsWorker(void *data, int t)
+{
+    quadscan_t *qs = (quadscan_t*) data;
+    Pos *buf = (Pos*) malloc(qs->n * sizeof(*buf));
+    int i;
+    (void) t;
+
+    while ((i = parallelNext(&qs->next)) < qs->end)
+    {
+        quadscan_job_t *job = &qs->jobs[i];
+        if (!buf)
+        {
+            qs->err = 1;
+            continue;
+        }
+        job->cnt = scanForQuadBits(qs->sconf, qs->radius, qs->s48[job->sidx],
+            qs->lowBits[job->bidx] - qs->salt, qs->lowBitN, qs->invB,
+            job->x, qs->z, job->w, qs->h, buf, qs->n);
+        if (job->cnt == 0)
+            continue;
+        job->qp = (Pos*) malloc(job->cnt * sizeof(*job->qp));
+        if (job->qp)
+            memcpy(job->qp, buf, job->cnt * sizeof(*job->qp));
+        else
+            qs->err = 1;
+    }
+    free(buf);
+}
+
+int scanForQuadsMulti(
+        const StructureConfig sconf, int radius, const uint64_t *s48, int ns,
+        const uint64_t *lowBits, int lowBitN, uint64_t salt,
+        int x, int z, int w, int h, Pos *qplist, int *qpidx, int n,
+        int threads)
+{
+    quadscan_t qs;
+    int i, j, k, nbits, strips, njobs, wave, cnt;
+
+    if (n < 1 || ns < 1)
+        return 0;
+    for (nbits = 0; lowBits[nbits]; nbits++);
+    if (nbits == 0)
+        return 0;
+
+    // split the x-range into strips when there are too few seed and lower
+    // bit combinations to keep all threads busy
+    strips = (4 * threads + ns * nbits - 1) / (ns * nbits);
+    if (strips > w + 1)
+        strips = w + 1;
+    if (strips < 1)
+        strips = 1;
+
+    qs.sconf = sconf;
+    qs.radius = radius;
+    qs.s48 = s48;
+    qs.lowBits = lowBits;
+    qs.lowBitN = lowBitN;
+    qs.salt = salt;
+    if (lowBitN == 20)
+        qs.invB = 132477ULL;
+    else if (lowBitN == 48)
+        qs.invB = 211541297333629ULL;
+    else
+        qs.invB = mulInv(132897987541ULL, (1ULL << lowBitN));
+    qs.z = z;
+    qs.h = h;
+    qs.n = n;
+    njobs = ns * nbits * strips;
+    qs.jobs = (quadscan_job_t*) calloc(njobs, sizeof(*qs.jobs));
+    qs.err = 0;
+    if (!qs.jobs)
+        return -1;
+
+    // jobs are ordered as the results of sequential scanForQuads() calls
+    quadscan_job_t *job = qs.jobs;
+    for (i = 0; i < ns; i++)
+    {
+        for (j = 0; j < nbits; j++)
+        {
+            for (k = 0; k < strips; k++, job++)
+            {
+                int64_t x0 = x + (int64_t)(w + 1) * k / strips;
+                int64_t x1 = x + (int64_t)(w + 1) * (k + 1) / strips;
+                job->sidx = i;
+                job->bidx = j;
+                job->x = (int) x0;
+                job->w = (int) (x1 - x0 - 1);
+            }
+        }
+    }
+
+    // the jobs are run in waves of increasing size, so the scan can stop
+    // once the first 'n' results are known
+    cnt = 0;
+    wave = threads < 1 ? 1 : threads;
+    for (i = 0; i < njobs && cnt < n && !qs.err; wave *= 2)
+    {
+        qs.next = i;
+        qs.end = (njobs - i > wave) ? i + wave : njobs;
+        runParallel(qs.end - i < threads ? qs.end - i : threads,
+            scanForQuadsWorker, &qs);
+
+        for (; i < qs.end; i++)
+        {
+            job = &qs.jobs[i];
+            for (j = 0; j < job->cnt && cnt < n; j++, cnt++)
+            {
+                qplist[cnt] = job->qp[j];
+                if (qpidx)
+                    qpidx[cnt] = job->sidx;
+            }
+        }
+    }
+    for (i = 0; i < njobs; i++)
+        free(qs.jobs[i].qp);
+    free(qs.jobs);
+
+    return qs.err ? -1 : cnt;
+}
+
+int scanForQuadsParallel(
+        const StructureConfig sconf, int radius, uint64_t s48,
+        const uint64_t *lowBits, int lowBitN, uint64_t salt,
+        int x, int z, int w, int h, Pos *qplist, int n, int threads)
+{
+    return scanForQuadsMulti(sconf, radius, &s48, 1, lowBits, lowBitN, salt,
+        x, z, w, h, qplist, NULL, n, threads);
+}
+
+
+//==============================================================================
+// Lower Bit Tables
+//==============================================================================
+
+STRUCT(quadbits_t)
+{
+    uint64_t salt;
+    int R, C, k;
+    int large;
+    int rm, cd;
+};
+
+/// Gets the candidate values of the position offsets along one axis for the
+/// four regions, given the lower bits 'r' of the seed. For large structures
+/// the offsets are sums of two draws.
+static void getQuadBitsCandidates(const quadbits_t *q, uint64_t r,
+        int cand[8][256], int ncand[8])
+{
+    const uint64_t K = 0x5deece66dULL;
+    const uint64_t off[4] = {
+        0, 341873128712ULL + 132897987541ULL, 341873128712ULL, 132897987541ULL
+    };
+    const uint64_t mbits = (1ULL << (17 + q->k)) - 1;
+    const int step = 1 << q->k;
+    int i, j, v, a, b;
+
+    for (i = 0; i < 4; i++)
+    {
+        uint64_t s = ((r + q->salt + off[i]) ^ K) & mbits;
+        int cls[4];
+        for (j = 0; j < (q->large ? 4 : 2); j++)
+        {
+            s = (s * K + 0xb) & mbits;
+            cls[j] = (int)(s >> 17);
+        }
+        for (j = 0; j < 2; j++)
+        {
+            int *c = cand[2*i+j];
+            int *n = &ncand[2*i+j];
+            *n = 0;
+            if (!q->large)
+            {
+                for (v = cls[j]; v < q->C; v += step)
+                    c[(*n)++] = v;
+                continue;
+            }
+            char has[256] = {0};
+            for (a = cls[2*j]; a < q->C; a += step)
+                for (b = cls[2*j+1]; b < q->C; b += step)
+                    has[a+b] = 1;
+            for (v = 0; v < 2 * q->C; v++)
+                if (has[v])
+                    c[(*n)++] = v;
+        }
+    }
+}
+
+/// Tests whether a quad-base can have the lower bits 'r'. This relaxes the
+/// conditions of isQuadBaseFeature() and isQuadBaseLarge() to each axis, so
+/// the test does not reject any true quad-bases.
+static int isQuadBitsViable(const quadbits_t *q, uint64_t r)
+{
+    int cand[8][256], ncand[8];
+    int64_t dmin[2][2];
+    int a, i0, i1, i2;
+
+    getQuadBitsCandidates(q, r, cand, ncand);
+
+    // candidate index of region i and axis a is 2*i+a (x0,z0,x1,z1,...)
+    for (a = 0; a < 2; a++)
+    {
+        const int *p0 = cand[0+a], *p1 = cand[2+a];
+        const int *p2 = cand[4+a], *p3 = cand[6+a];
+        int n0 = ncand[0+a], n1 = ncand[2+a], n2 = ncand[4+a], n3 = ncand[6+a];
+        dmin[0][a] = dmin[1][a] = INT64_MAX;
+
+        if (!q->large)
+        {
+            // the diagonal (0,0)-(1,1)
+            for (i0 = 0; i0 < n0; i0++)
+            {
+                if (p0[i0] <= q->rm)
+                    continue;
+                for (i1 = 0; i1 < n1; i1++)
+                {
+                    if (p1[i1] >= p0[i0] - q->rm)
+                        continue;
+                    int64_t d = p1[i1] + q->R - p0[i0];
+                    if (d*d < dmin[0][a])
+                        dmin[0][a] = d*d;
+                }
+            }
+            // the diagonal (0,1)-(1,0), where the regions swap roles in z
+            const int *pl = a ? p3 : p2, *ph = a ? p2 : p3;
+            int nl = a ? n3 : n2, nh = a ? n2 : n3;
+            for (i0 = 0; i0 < nl; i0++)
+            {
+                if (pl[i0] >= q->C - q->rm)
+                    continue;
+                for (i1 = 0; i1 < nh; i1++)
+                {
+                    if (ph[i1] <= q->rm)
+                        continue;
+                    int64_t d = pl[i0] + q->R - ph[i1];
+                    if (d*d < dmin[1][a])
+                        dmin[1][a] = d*d;
+                }
+            }
+        }
+        else
+        {
+            // the regions (1,1) and one of (0,1) or (1,0) have to be below
+            // the base position, while the other one is above the threshold
+            const int *pl = a ? p3 : p2, *ph = a ? p2 : p3;
+            int nl = a ? n3 : n2, nh = a ? n2 : n3;
+            for (i0 = 0; i0 < nh; i0++)
+                if (ph[i0] > q->rm)
+                    break;
+            if (i0 == nh)
+                return 0;
+            for (i0 = 0; i0 < n0; i0++)
+            {
+                if (p0[i0] <= q->rm)
+                    continue;
+                for (i2 = 0; i2 < nl; i2++)
+                    if (pl[i2] <= p0[i0] - q->rm)
+                        break;
+                if (i2 == nl)
+                    continue;
+                for (i1 = 0; i1 < n1; i1++)
+                {
+                    if (p1[i1] > p0[i0] - q->rm)
+                        continue;
+                    int64_t d = (p1[i1] - p0[i0]) >> 1;
+                    if (d*d < dmin[0][a])
+                        dmin[0][a] = d*d;
+                }
+            }
+            dmin[1][a] = 0;
+        }
+
+        if (dmin[0][a] == INT64_MAX || dmin[1][a] == INT64_MAX)
+            return 0;
+    }
+
+    int64_t cd2 = (int64_t) q->cd * q->cd;
+    return dmin[0][0] + dmin[0][1] <= cd2 && dmin[1][0] + dmin[1][1] <= cd2;
+}
+
+uint64_t *getQuadBaseLowBits(const StructureConfig sconf, int radius,
+        int *lowBitN, const char *cachedir)
+{
+    quadbits_t q;
+    char fnam[MAX_PATHLEN];
+    uint64_t *bits = NULL;
+    uint64_t r, n, cnt, cap;
+    FILE *fp;
+
+    q.salt = (uint64_t) sconf.salt;
+    q.R = sconf.regionSize;
+    q.C = sconf.chunkRange;
+    q.large = (sconf.structType == Monument);
+    for (q.k = 0; q.k < 7 && !(q.C & (1 << q.k)); q.k++);
+    if (q.C <= 0 || q.k == 0 || (q.C & (q.C - 1)) == 0)
+        return NULL; // no even factor, or nextInt() uses the upper bits
+    if (q.k > 6)
+        q.k = 6;
+
+    if (q.large)
+    {   // structure size as used by isQuadBase() for monuments
+        q.rm = (int)(2 * q.R + (58 - 2*radius + 7) / 8);
+        q.cd = 2 * radius;
+    }
+    else
+    {
+        q.cd = radius / 8;
+        if (q.cd*q.cd < (q.R-q.C+1)*(q.R-q.C+1))
+            return NULL;
+        q.rm = q.R - (int)sqrtf(q.cd*q.cd - (q.R-q.C+1)*(q.R-q.C+1));
+    }
+    *lowBitN = 17 + q.k;
+
+    fnam[0] = 0;
+    if (cachedir)
+    {
+        snprintf(fnam, sizeof(fnam), "%s/quadbits_%d_%d_%d_%d_%d.txt",
+            cachedir, sconf.structType, sconf.salt, q.R, q.C, radius);
+        if ((bits = loadSavedSeeds(fnam, &cnt)) != NULL)
+        {
+            uint64_t *tmp = (uint64_t*) realloc(bits, (cnt+1) * sizeof(*bits));
+            if (tmp)
+            {
+                tmp[cnt] = 0;
+                return tmp;
+            }
+            free(bits);
+        }
+    }
+
+    n = 1ULL << *lowBitN;
+    cnt = 0;
+    cap = 1024;
+    if (!(bits = (uint64_t*) malloc(cap * sizeof(*bits))))
+        return NULL;
+    for (r = 0; r < n; r++)
+    {
+        if (!isQuadBitsViable(&q, r))
+            continue;
+        if (r == 0)
+        {   // zero is the terminator and cannot be represented
+            free(bits);
+            return NULL;
+        }
+        if (cnt + 1 >= cap)
+        {
+            uint64_t *tmp = (uint64_t*) realloc(bits, 2*cap * sizeof(*bits));
+            if (!tmp)
+            {
+                free(bits);
+                return NULL;
+            }
+            bits = tmp;
+            cap *= 2;
+        }
+        bits[cnt++] = r;
+    }
+    bits[cnt] = 0;
+
+    if (fnam[0] && (fp = fopen(fnam, "w")))
+    {
+        for (r = 0; r < cnt; r++)
+            fprintf(fp, "%" PRId64 "\n", (int64_t) bits[r]);
+        fclose(fp);
+    }
+    return bits;
+}
+
+STRUCT(quadcheck_t)
+{
+    StructureConfig sconf;
+    int radius;
+};
+
+static uint32_t checkQuadBatch(const uint64_t *s48, int n, void *data)
+{
+    const quadcheck_t *d = (const quadcheck_t*) data;
+    return areQuadBases(d->sconf, s48, n, d->radius);
+}
+
+int searchQuadBases(
+        uint64_t **         seedbuf,
+        uint64_t *          buflen,
+        const char *        path,
+        int                 threads,
+        const StructureConfig sconf,
+        int                 radius,
+        const char *        cachedir,
+        volatile char *     stop
+        )
+{
+    quadcheck_t d = { sconf, radius };
+    int lowBitN = 0;
+    uint64_t *lowBits = getQuadBaseLowBits(sconf, radius, &lowBitN, cachedir);
+    int err = searchAll48Batch(seedbuf, buflen, path, threads,
+        lowBits, lowBitN, checkQuadBatch, &d, stop);
+    free(lowBits);
+    return err;
+}
 
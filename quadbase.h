@@ -135,6 +135,33 @@ static inline ATTR(always_inline, const)
 float isQuadBaseLarge (const StructureConfig sconf, uint64_t seed,
         int ax, int ay, int az, int radius);
 
+/* Multi-seed variants of the quad-base checks above, which test the 'n'
+ * seeds of the array 'seeds' together (n <= QUADBASE_BATCH). The first
+ * region of every seed is evaluated in a branchless loop over the seeds,
+ * which the compiler can map onto vector lanes, and only the few seeds that
+ * pass it are given to the scalar function.
+ *
+ * The return value is a bit mask in which bit i is set when seeds[i] is a
+ * quad-base.
+ */
+enum { QUADBASE_BATCH = 32 };
+
+static inline
+uint32_t areQuadBases (const StructureConfig sconf,
+        const uint64_t *seeds, int n, int radius);
+
+static inline ATTR(always_inline)
+uint32_t areQuadBasesFeature24 (const StructureConfig sconf,
+        const uint64_t *seeds, int n, int ax, int ay, int az);
+
+static inline ATTR(always_inline)
+uint32_t areQuadBasesFeature (const StructureConfig sconf,
+        const uint64_t *seeds, int n, int ax, int ay, int az, int radius);
+
+static inline ATTR(always_inline)
+uint32_t areQuadBasesLarge (const StructureConfig sconf,
+        const uint64_t *seeds, int n, int ax, int ay, int az, int radius);
+
 
 /* Starts a multi-threaded search through all 48-bit seeds. Since this can
  * potentially be a lengthy calculation, results can be written to temporary
@@ -168,6 +195,61 @@ int searchAll48(
         volatile char *     stop // should be atomic, but is fine as stop flag
         );
 
+/* Variant of searchAll48() which tests the seeds in batches. The function
+ * 'check' is given up to QUADBASE_BATCH seeds at once and should return a bit
+ * mask of the desired seeds, where bit i corresponds to s48[i]. This avoids
+ * the per-seed call overhead and allows the batched quad-base checks above
+ * to be used. The remaining arguments are the same as for searchAll48().
+ */
+int searchAll48Batch(
+        uint64_t **         seedbuf,
+        uint64_t *          buflen,
+        const char *        path,
+        int                 threads,
+        const uint64_t *    lowBits,
+        int                 lowBitN,
+        uint32_t (*check)(const uint64_t *s48, int n, void *data),
+        void *              data,
+        volatile char *     stop
+        );
+
+/* Derives the lower bits of the 48-bit seeds which can be quad-bases for the
+ * given structure configuration and radius, as tested by isQuadBase(). When
+ * the chunk range has a factor 2^k (without being a power of two), the lowest
+ * k bits of each position offset depend only on the lowest 17+k bits of the
+ * seed, so the region offsets can be narrowed down from these bits alone. The
+ * result is a superset of the lower bits of all quad-bases and can be used as
+ * the lower bit subset for searchAll48().
+ * Generating a table takes a moment, so it is cached as a file in 'cachedir'
+ * if that is provided.
+ *
+ * @sconf       : structure configuration
+ * @radius      : radius for isQuadBase
+ * @lowBitN     : output number of bits in the table values
+ * @cachedir    : directory for cached tables (nullable)
+ *
+ * Returns a dynamically allocated, zero terminated table, or NULL if the
+ * configuration does not restrict the lower bits (or if a zero residue would
+ * have to be included, which the table format cannot represent).
+ */
+uint64_t *getQuadBaseLowBits(const StructureConfig sconf, int radius,
+        int *lowBitN, const char *cachedir);
+
+/* Searches all 48-bit seeds for quad-bases using isQuadBase(). The search is
+ * restricted to the lower bits from getQuadBaseLowBits() when available, and
+ * uses the batched checks. The arguments are the same as for searchAll48().
+ */
+int searchQuadBases(
+        uint64_t **         seedbuf,
+        uint64_t *          buflen,
+        const char *        path,
+        int                 threads,
+        const StructureConfig sconf,
+        int                 radius,
+        const char *        cachedir,
+        volatile char *     stop
+        );
+
 /* Finds the optimal AFK location for four structures of size (ax,ay,az),
  * located at the positions of 'p'. The AFK position is determined by looking
  * for whole block coordinates which offer the maximum number of spawning
@@ -207,6 +289,32 @@ int scanForQuads(
         const uint64_t *lowBits, int lowBitN, uint64_t salt,
         int x, int z, int w, int h, Pos *qplist, int n);
 
+/* Multi-threaded version of scanForQuads(). The area is divided into strips
+ * of region columns which are scanned for each of the lower bits in parallel,
+ * and the results are merged in the same order as scanForQuads() would find
+ * them.
+ *
+ * Returns the number of quad-structures found (up to 'n'), or -1 on failure.
+ */
+int scanForQuadsParallel(
+        const StructureConfig sconf, int radius, uint64_t s48,
+        const uint64_t *lowBits, int lowBitN, uint64_t salt,
+        int x, int z, int w, int h, Pos *qplist, int n, int threads);
+
+/* Scans the area for quad-structures of 'ns' different seeds, 's48', with
+ * multiple threads. The results are ordered by seed, and as for
+ * scanForQuads() within each seed. The index of the seed of each
+ * quad-structure is written to 'qpidx' (nullable).
+ *
+ * Returns the total number of quad-structures found (up to 'n'), or -1 on
+ * failure.
+ */
+int scanForQuadsMulti(
+        const StructureConfig sconf, int radius, const uint64_t *s48, int ns,
+        const uint64_t *lowBits, int lowBitN, uint64_t salt,
+        int x, int z, int w, int h, Pos *qplist, int *qpidx, int n,
+        int threads);
+
 
 //==============================================================================
 // Implementaions for Functions that Ideally Should be Inlined
@@ -514,6 +622,136 @@ float isQuadBaseLarge(const StructureConfig sconf, uint64_t seed,
     return sqrad < radius ? sqrad : 0;
 }
 
+static inline
+uint32_t areQuadBases(const StructureConfig sconf,
+        const uint64_t *seeds, int n, int radius)
+{
+    switch(sconf.structType)
+    {
+    case Swamp_Hut:
+        if (radius == 128)
+            return areQuadBasesFeature24(sconf, seeds, n, 7+1, 7+1, 9+1);
+        else
+            return areQuadBasesFeature(sconf, seeds, n, 7+1, 7+1, 9+1, radius);
+    case Desert_Pyramid:
+    case Jungle_Pyramid:
+    case Igloo:
+    case Village:
+        if (radius == 128)
+            return areQuadBasesFeature24(sconf, seeds, n, 0, 0, 0);
+        else
+            return areQuadBasesFeature(sconf, seeds, n, 0, 0, 0, radius);
+    case Outpost:
+        return areQuadBasesFeature(sconf, seeds, n, 72, 54, 72, radius);
+    case Monument:
+        return areQuadBasesLarge(sconf, seeds, n, 58, 23, 58, radius);
+    case Ocean_Ruin:
+    case Shipwreck:
+    case Ruined_Portal:
+        return areQuadBasesFeature(sconf, seeds, n, 0, 0, 0, radius);
+    default:
+        fprintf(stderr, "areQuadBases: not implemented for structure type %d\n",
+                sconf.structType);
+        exit(-1);
+    }
+
+    return 0;
+}
+
+static inline ATTR(always_inline)
+uint32_t areQuadBasesFeature24(const StructureConfig sconf,
+        const uint64_t *seeds, int n, int ax, int ay, int az)
+{
+    const uint64_t K = 0x5deece66dULL;
+    uint8_t pass[QUADBASE_BATCH];
+    uint32_t mask = 0;
+    int i;
+
+    // the first region rejects all but 1 in 36 seeds
+    for (i = 0; i < n; i++)
+    {
+        uint64_t s = (seeds[i] + sconf.salt) ^ K;
+        int x, z;
+        JAVA_NEXT_INT24(s, x);
+        JAVA_NEXT_INT24(s, z);
+        pass[i] = (x >= 20) & (z >= 20);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (pass[i] && isQuadBaseFeature24(sconf, seeds[i], ax, ay, az))
+            mask |= 1U << i;
+    }
+    return mask;
+}
+
+static inline ATTR(always_inline)
+uint32_t areQuadBasesFeature(const StructureConfig sconf,
+        const uint64_t *seeds, int n, int ax, int ay, int az, int radius)
+{
+    const uint64_t M = (1ULL << 48) - 1;
+    const uint64_t K = 0x5deece66dULL;
+    const uint64_t b = 0xb;
+    const int R = sconf.regionSize;
+    const int C = sconf.chunkRange;
+    int cd = radius/8;
+    int rm = R - (int)sqrtf(cd*cd - (R-C+1)*(R-C+1));
+    uint8_t pass[QUADBASE_BATCH];
+    uint32_t mask = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        uint64_t s = (seeds[i] + sconf.salt) ^ K;
+        int x, z;
+        s = (s * K + b) & M; x = (int)(s >> 17) % C;
+        s = (s * K + b) & M; z = (int)(s >> 17) % C;
+        pass[i] = (x > rm) & (z > rm);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (pass[i] &&
+            isQuadBaseFeature(sconf, seeds[i], ax, ay, az, radius))
+            mask |= 1U << i;
+    }
+    return mask;
+}
+
+static inline ATTR(always_inline)
+uint32_t areQuadBasesLarge(const StructureConfig sconf,
+        const uint64_t *seeds, int n, int ax, int ay, int az, int radius)
+{
+    const uint64_t M = (1ULL << 48) - 1;
+    const uint64_t K = 0x5deece66dULL;
+    const uint64_t b = 0xb;
+    const int R = sconf.regionSize;
+    const int C = sconf.chunkRange;
+    int rm = (int)(2 * R + ((ax<az?ax:az) - 2*radius + 7) / 8);
+    uint8_t pass[QUADBASE_BATCH];
+    uint32_t mask = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        uint64_t s = (seeds[i] + sconf.salt) ^ K;
+        int x, z;
+        s = (s * K + b) & M; x =  (int)(s >> 17) % C;
+        s = (s * K + b) & M; x += (int)(s >> 17) % C;
+        s = (s * K + b) & M; z =  (int)(s >> 17) % C;
+        s = (s * K + b) & M; z += (int)(s >> 17) % C;
+        pass[i] = (x > rm) & (z > rm);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (pass[i] &&
+            isQuadBaseLarge(sconf, seeds[i], ax, ay, az, radius))
+            mask |= 1U << i;
+    }
+    return mask;
+}
+
 #ifdef __cplusplus
 }
 #endif
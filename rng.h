@@ -266,6 +266,269 @@ static inline int xNextIntJ(Xoroshiro *xr, uint32_t n)
 }
 
 
+///=============================================================================
+///                         Lane-Parallel Random Streams
+///=============================================================================
+
+/* The lane types hold RNG_LANES independent random states that are advanced
+ * together. Each function performs the scalar operation of the same name on
+ * every lane in a branchless loop, which the compiler can map onto vector
+ * registers, and returns the lane results through an output array. The lanes
+ * behave exactly like separate scalar states: rejection sampling is repeated
+ * only for the lanes that need it.
+ */
+enum { RNG_LANES = 8 };
+
+STRUCT(RandomLanes)
+{
+    uint64_t s[RNG_LANES];
+};
+
+STRUCT(XoroshiroLanes)
+{
+    uint64_t lo[RNG_LANES], hi[RNG_LANES];
+};
+
+static inline void setSeedLanes(RandomLanes *r, const uint64_t *values)
+{
+    int i;
+    for (i = 0; i < RNG_LANES; i++)
+        r->s[i] = (values[i] ^ 0x5deece66d) & ((1ULL << 48) - 1);
+}
+
+static inline void nextLanes(RandomLanes *r, const int bits, int *out)
+{
+    int i;
+    for (i = 0; i < RNG_LANES; i++)
+    {
+        r->s[i] = (r->s[i] * 0x5deece66d + 0xb) & ((1ULL << 48) - 1);
+        out[i] = (int) ((int64_t)r->s[i] >> (48 - bits));
+    }
+}
+
+static inline void nextIntLanes(RandomLanes *r, const int n, int *out)
+{
+    int bits[RNG_LANES];
+    int i, retry = 0;
+    const int m = n - 1;
+
+    nextLanes(r, 31, bits);
+    if ((m & n) == 0)
+    {
+        for (i = 0; i < RNG_LANES; i++)
+            out[i] = (int) ((int64_t) (n * (uint64_t)bits[i]) >> 31);
+        return;
+    }
+
+    for (i = 0; i < RNG_LANES; i++)
+    {
+        out[i] = bits[i] % n;
+        retry |= (int32_t)((uint32_t)bits[i] - out[i] + m) < 0;
+    }
+    if unlikely(retry)
+    {
+        for (i = 0; i < RNG_LANES; i++)
+        {
+            while ((int32_t)((uint32_t)bits[i] - out[i] + m) < 0)
+            {
+                bits[i] = next(&r->s[i], 31);
+                out[i] = bits[i] % n;
+            }
+        }
+    }
+}
+
+static inline void nextLongLanes(RandomLanes *r, uint64_t *out)
+{
+    int a[RNG_LANES], b[RNG_LANES];
+    int i;
+    nextLanes(r, 32, a);
+    nextLanes(r, 32, b);
+    for (i = 0; i < RNG_LANES; i++)
+        out[i] = ((uint64_t) a[i] << 32) + b[i];
+}
+
+static inline void nextFloatLanes(RandomLanes *r, float *out)
+{
+    int a[RNG_LANES];
+    int i;
+    nextLanes(r, 24, a);
+    for (i = 0; i < RNG_LANES; i++)
+        out[i] = a[i] / (float) (1 << 24);
+}
+
+static inline void nextDoubleLanes(RandomLanes *r, double *out)
+{
+    int a[RNG_LANES], b[RNG_LANES];
+    int i;
+    nextLanes(r, 26, a);
+    nextLanes(r, 27, b);
+    for (i = 0; i < RNG_LANES; i++)
+    {
+        uint64_t x = ((uint64_t)a[i] << 27) + b[i];
+        out[i] = (int64_t) x / (double) (1ULL << 53);
+    }
+}
+
+/* Jumps forwards in all streams by simulating 'n' calls to next. The jump
+ * coefficients are shared, so this costs little more than a single skip.
+ */
+static inline void skipNextNLanes(RandomLanes *r, uint64_t n)
+{
+    uint64_t m = 1;
+    uint64_t a = 0;
+    uint64_t im = 0x5deece66dULL;
+    uint64_t ia = 0xb;
+    uint64_t k;
+    int i;
+
+    for (k = n; k; k >>= 1)
+    {
+        if (k & 1)
+        {
+            m *= im;
+            a = im * a + ia;
+        }
+        ia = (im + 1) * ia;
+        im *= im;
+    }
+
+    for (i = 0; i < RNG_LANES; i++)
+        r->s[i] = (r->s[i] * m + a) & 0xffffffffffffULL;
+}
+
+static inline void xSetSeedLanes(XoroshiroLanes *xr, const uint64_t *values)
+{
+    int i;
+    for (i = 0; i < RNG_LANES; i++)
+    {
+        Xoroshiro x;
+        xSetSeed(&x, values[i]);
+        xr->lo[i] = x.lo;
+        xr->hi[i] = x.hi;
+    }
+}
+
+static inline void xNextLongLanes(XoroshiroLanes *xr, uint64_t *out)
+{
+    int i;
+    for (i = 0; i < RNG_LANES; i++)
+    {
+        uint64_t l = xr->lo[i];
+        uint64_t h = xr->hi[i];
+        out[i] = rotl64(l + h, 17) + l;
+        h ^= l;
+        xr->lo[i] = rotl64(l, 49) ^ h ^ (h << 21);
+        xr->hi[i] = rotl64(h, 28);
+    }
+}
+
+static inline void xNextIntLanes(XoroshiroLanes *xr, uint32_t n, int *out)
+{
+    uint64_t r[RNG_LANES];
+    int i, retry = 0;
+
+    xNextLongLanes(xr, r);
+    for (i = 0; i < RNG_LANES; i++)
+    {
+        r[i] = (r[i] & 0xFFFFFFFF) * n;
+        retry |= (uint32_t)r[i] < n;
+    }
+    if unlikely(retry)
+    {
+        // as for xNextInt(), the threshold is only needed in this branch
+        const uint32_t lim = (~n + 1) % n;
+        for (i = 0; i < RNG_LANES; i++)
+        {
+            while ((uint32_t)r[i] < lim)
+            {
+                Xoroshiro x = { xr->lo[i], xr->hi[i] };
+                r[i] = (xNextLong(&x) & 0xFFFFFFFF) * n;
+                xr->lo[i] = x.lo;
+                xr->hi[i] = x.hi;
+            }
+        }
+    }
+    for (i = 0; i < RNG_LANES; i++)
+        out[i] = r[i] >> 32;
+}
+
+static inline void xNextDoubleLanes(XoroshiroLanes *xr, double *out)
+{
+    uint64_t r[RNG_LANES];
+    int i;
+    xNextLongLanes(xr, r);
+    for (i = 0; i < RNG_LANES; i++)
+        out[i] = (r[i] >> (64-53)) * 1.1102230246251565E-16;
+}
+
+static inline void xNextFloatLanes(XoroshiroLanes *xr, float *out)
+{
+    uint64_t r[RNG_LANES];
+    int i;
+    xNextLongLanes(xr, r);
+    for (i = 0; i < RNG_LANES; i++)
+        out[i] = (r[i] >> (64-24)) * 5.9604645E-8F;
+}
+
+static inline void xSkipNLanes(XoroshiroLanes *xr, int count)
+{
+    uint64_t r[RNG_LANES];
+    while (count --> 0)
+        xNextLongLanes(xr, r);
+}
+
+static inline void xNextLongJLanes(XoroshiroLanes *xr, uint64_t *out)
+{
+    uint64_t a[RNG_LANES], b[RNG_LANES];
+    int i;
+    xNextLongLanes(xr, a);
+    xNextLongLanes(xr, b);
+    for (i = 0; i < RNG_LANES; i++)
+        out[i] = ((uint64_t)(int32_t)(a[i] >> 32) << 32) + (int32_t)(b[i] >> 32);
+}
+
+static inline void xNextIntJLanes(XoroshiroLanes *xr, uint32_t n, int *out)
+{
+    uint64_t r[RNG_LANES];
+    int bits[RNG_LANES];
+    int i, retry = 0;
+    const int m = n - 1;
+
+    xNextLongLanes(xr, r);
+    if ((m & n) == 0)
+    {
+        for (i = 0; i < RNG_LANES; i++)
+        {
+            uint64_t x = n * (r[i] >> 33);
+            out[i] = (int) ((int64_t) x >> 31);
+        }
+        return;
+    }
+
+    for (i = 0; i < RNG_LANES; i++)
+    {
+        bits[i] = r[i] >> 33;
+        out[i] = bits[i] % n;
+        retry |= (int32_t)((uint32_t)bits[i] - out[i] + m) < 0;
+    }
+    if unlikely(retry)
+    {
+        for (i = 0; i < RNG_LANES; i++)
+        {
+            while ((int32_t)((uint32_t)bits[i] - out[i] + m) < 0)
+            {
+                Xoroshiro x = { xr->lo[i], xr->hi[i] };
+                bits[i] = xNextLong(&x) >> 33;
+                out[i] = bits[i] % n;
+                xr->lo[i] = x.lo;
+                xr->hi[i] = x.hi;
+            }
+        }
+    }
+}
+
+
 //==============================================================================
 //                              MC Seed Helpers
 //==============================================================================
@@ -484,6 +484,356 @@ void findStructures(int structureType, int mc, int dim, uint64_t seed,
     }
 }
 
+
+static int report(const char *name, int ok)
+{
+    printf("  %-44s %s\e[0m\n", name, ok ? "\e[1;92mOK" : "\e[1;91mFAILED");
+    return ok;
+}
+
+static int testStrongholdBatch(int mc, int threads)
+{
+    enum { N = 24 };
+    Generator g;
+    setupGenerator(&g, mc, 0);
+    applySeed(&g, DIM_OVERWORLD, 1234567);
+
+    Pos out[N];
+    int n = getStrongholds(out, N, &g, threads);
+
+    StrongholdIter sh;
+    initFirstStronghold(&sh, mc, g.seed);
+    int i, ok = n > 0;
+    for (i = 0; i < n && ok; i++)
+    {
+        nextStronghold(&sh, &g);
+        ok = sh.pos.x == out[i].x && sh.pos.z == out[i].z;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "getStrongholds() MC %s, %d threads",
+        mc2str(mc), threads);
+    return report(name, ok);
+}
+
+static int testViableBatch(int mc, int stype)
+{
+    enum { R = 8 };
+    Generator g;
+    setupGenerator(&g, mc, 0);
+    applySeed(&g, DIM_OVERWORLD, 42);
+
+    Pos pos[R*R];
+    char viable[R*R];
+    int i, j, n = 0;
+    for (j = -R/2; j < R/2; j++)
+    {
+        for (i = -R/2; i < R/2; i++)
+        {
+            if (getStructurePos(stype, mc, g.seed, i, j, &pos[n]))
+                n++;
+        }
+    }
+    int cnt = areViableStructurePos(stype, &g, pos, n, 0, viable);
+    int ok = 1, exp = 0;
+    for (i = 0; i < n; i++)
+    {
+        int v = isViableStructurePos(stype, &g, pos[i].x, pos[i].z, 0) != 0;
+        ok &= v == viable[i];
+        exp += v;
+    }
+    ok &= cnt == exp;
+    char name[64];
+    snprintf(name, sizeof(name), "areViableStructurePos() MC %s, %s",
+        mc2str(mc), struct2str(stype));
+    return report(name, ok);
+}
+
+static int testVoronoiSHAs()
+{
+    enum { N = 13 }; // not a multiple of the lane width
+    uint64_t seeds[N], out[N];
+    int i, ok = 1;
+    for (i = 0; i < N; i++)
+        seeds[i] = ((uint64_t)hash32(i) << 32) ^ hash32(~i);
+    getVoronoiSHAs(seeds, out, N);
+    for (i = 0; i < N; i++)
+        ok &= out[i] == getVoronoiSHA(seeds[i]);
+    return report("getVoronoiSHAs()", ok);
+}
+
+static int testFilterPlan(int mc, uint32_t flags)
+{
+    Generator g;
+    setupGenerator(&g, mc, 0);
+    Layer *entry = (Layer*) getLayerForScale(&g, 4);
+
+    int req[] = { forest, river };
+    int exc[] = { mushroom_fields };
+    BiomeFilter bf;
+    setupBiomeFilter(&bf, mc, flags, req, 2, exc, 1, 0, 0);
+    BiomeFilterPlan plan;
+    compileBiomeFilter(&plan, &bf, 16);
+
+    int ok = 1;
+    uint64_t seed;
+    for (seed = 0; seed < 200; seed++)
+    {
+        int x = (int)(hash32(seed) % 2000) - 1000;
+        int z = (int)(hash32(seed << 1) % 2000) - 1000;
+        int a = checkForBiomesPlan(&plan, &g.ls, entry, NULL, seed, x, z, 64, 64);
+        int b = checkForBiomesAtLayer(&g.ls, entry, NULL, seed, x, z, 64, 64, &bf);
+        ok &= a == b;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "checkForBiomesPlan() MC %s%s",
+        mc2str(mc), flags & BF_APPROX ? ", approx" : "");
+    return report(name, ok);
+}
+
+static int testClimateQuad(int mc)
+{
+    Generator g;
+    setupGenerator(&g, mc, 0);
+
+    int req[] = { forest, river };
+    int exc[] = { mushroom_fields, jungle };
+    BiomeFilter bf;
+    setupBiomeFilter(&bf, mc, 0, req, 2, exc, 2, 0, 0);
+
+    int ok = 1;
+    uint64_t seed;
+    for (seed = 0; seed < 20; seed++)
+    {
+        Range r = {4, -40 + (int)(seed*7), 30 - (int)(seed*5), 48, 40, 15, 1};
+        int ret = checkForBiomes(&g, NULL, r, DIM_OVERWORLD, seed, &bf, NULL);
+
+        applySeed(&g, DIM_OVERWORLD, seed);
+        int *ids = allocCache(&g, r);
+        genBiomes(&g, ids, r);
+        char present[256] = {0};
+        int i;
+        for (i = 0; i < r.sx*r.sz; i++)
+            if (ids[i] >= 0 && ids[i] < 256)
+                present[ids[i]] = 1;
+        free(ids);
+
+        int exp = 1;
+        for (i = 0; i < 2; i++)
+            exp &= present[req[i]] && !present[exc[i]];
+        ok &= (ret > 0) == exp;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "checkForBiomes() MC %s quadtree", mc2str(mc));
+    return report(name, ok);
+}
+
+static int testParaRangeParallel()
+{
+    Generator g;
+    setupGenerator(&g, MC_1_20, 0);
+    applySeed(&g, DIM_OVERWORLD, 99);
+    const DoublePerlinNoise *para = &g.bn.climate[NP_TEMPERATURE];
+
+    int ok = 1, i;
+    for (i = 0; i < 4; i++)
+    {
+        int x = -300 + 250*i, z = 700 - 400*i, w = 100 + 150*i, h = 80 + 60*i;
+        double min0, max0, min1, max1;
+        int e0 = getParaRange(para, &min0, &max0, x, z, w, h, NULL, NULL);
+        int e1 = getParaRangeParallel(para, &min1, &max1, x, z, w, h,
+            NULL, NULL, 1);
+        ok &= e0 == e1 && min0 == min1 && max0 == max1;
+    }
+    return report("getParaRangeParallel() 1 thread", ok);
+}
+
+static int testStructureGrid(int mc, int stype)
+{
+    enum { W = 7, H = 5 };
+    Pos pos[W*H];
+    char valid[W*H];
+    int regX = -9, regZ = -3, i, j, cnt = 0;
+    int n = getStructurePosGrid(stype, mc, 1337, regX, regZ, W, H, pos, valid);
+    int ok = 1;
+    for (j = 0; j < H; j++)
+    {
+        for (i = 0; i < W; i++)
+        {
+            Pos p;
+            int v = getStructurePos(stype, mc, 1337, regX+i, regZ+j, &p) != 0;
+            int k = j*W + i;
+            ok &= v == valid[k];
+            if (v)
+                ok &= p.x == pos[k].x && p.z == pos[k].z;
+            cnt += v;
+        }
+    }
+    ok &= n == cnt;
+    char name[64];
+    snprintf(name, sizeof(name), "getStructurePosGrid() MC %s, %s",
+        mc2str(mc), struct2str(stype));
+    return report(name, ok);
+}
+
+static int testBiomeStore(int mc)
+{
+    const char *path = "tests_biomestore.bin";
+    Generator g;
+    setupGenerator(&g, mc, 0);
+    applySeed(&g, DIM_OVERWORLD, 31415);
+    Range r = {4, -70, -45, 100, 90, 16, 1};
+    int tilesize = 32;
+    int ntiles = ((r.sx + tilesize-1) / tilesize) * ((r.sz + tilesize-1) / tilesize);
+
+    remove(path);
+    int ok = genBiomeStore(&g, path, r, tilesize, 3) == ntiles;
+
+    // mark a few tiles as incomplete, which a resume has to regenerate
+    FILE *fp = fopen(path, "r+b");
+    ok &= fp != NULL;
+    if (fp)
+    {
+        uint8_t zero[2] = {0, 0};
+        ok &= fseek(fp, sizeof(BiomeStoreHeader) + 1, SEEK_SET) == 0;
+        ok &= fwrite(zero, 1, 2, fp) == 2;
+        fclose(fp);
+    }
+    ok &= genBiomeStore(&g, path, r, tilesize, 2) == 2;
+    ok &= genBiomeStore(&g, path, r, tilesize, 1) == 0;
+
+    int *ids = allocCache(&g, r);
+    genBiomes(&g, ids, r);
+    BiomeStore bs;
+    if (ok && openBiomeStore(&bs, path) == 0)
+    {
+        int i, j;
+        for (j = 0; j < r.sz; j++)
+            for (i = 0; i < r.sx; i++)
+                ok &= getBiomeStoreAt(&bs, r.x+i, r.z+j) == ids[j*r.sx+i];
+        ok &= getBiomeStoreAt(&bs, r.x-1, r.z) == -1;
+        ok &= getBiomeStoreAt(&bs, r.x, r.z+r.sz) == -1;
+        closeBiomeStore(&bs);
+    }
+    else
+    {
+        ok = 0;
+    }
+    free(ids);
+    remove(path);
+
+    char name[64];
+    snprintf(name, sizeof(name), "genBiomeStore() MC %s round-trip", mc2str(mc));
+    return report(name, ok);
+}
+
+static int testNearestStructures()
+{
+    const int types[] = { Village, Swamp_Hut, Outpost, Desert_Pyramid };
+    const int ntypes = sizeof(types) / sizeof(int);
+    enum { K = 12, NMAX = 4096 };
+    int mc = MC_1_20, x = 1234, z = -5678, maxdist = 6000;
+    uint64_t seed = 4242;
+    Generator g;
+    setupGenerator(&g, mc, 0);
+    applySeed(&g, DIM_OVERWORLD, seed);
+
+    // brute force: distances of all viable structures within maxdist
+    int64_t *dist = (int64_t*) malloc(NMAX * sizeof(int64_t));
+    int i, t, na = 0, rsmin = INT_MAX;
+    for (t = 0; t < ntypes; t++)
+    {
+        StructureConfig sc;
+        getStructureConfig(types[t], mc, &sc);
+        int rs = sc.regionSize * 16;
+        if (rs < rsmin)
+            rsmin = rs;
+        int rx0 = floordiv(x - maxdist, rs) - 1, rx1 = floordiv(x + maxdist, rs);
+        int rz0 = floordiv(z - maxdist, rs) - 1, rz1 = floordiv(z + maxdist, rs);
+        int rx, rz;
+        for (rz = rz0; rz <= rz1; rz++)
+        {
+            for (rx = rx0; rx <= rx1; rx++)
+            {
+                Pos p;
+                if (!getStructurePos(types[t], mc, seed, rx, rz, &p))
+                    continue;
+                int64_t dx = p.x - x, dz = p.z - z, d = dx*dx + dz*dz;
+                if (d > (int64_t)maxdist * maxdist)
+                    continue;
+                if (!isViableStructurePos(types[t], &g, p.x, p.z, 0))
+                    continue;
+                if (na < NMAX)
+                {   // insertion sort
+                    for (i = na++; i > 0 && dist[i-1] > d; i--)
+                        dist[i] = dist[i-1];
+                    dist[i] = d;
+                }
+            }
+        }
+    }
+
+    StructureIndex si;
+    StructureLoc out[K];
+    int truncated = 0;
+    initStructureIndex(&si, mc, seed, 0);
+    int n = getNearestStructures(&si, &g, types, ntypes, x, z, maxdist,
+        out, K, &truncated);
+    freeStructureIndex(&si);
+
+    int ok = na < NMAX && n == (na < K ? na : K) && !truncated;
+    for (i = 0; i < n && ok; i++)
+    {
+        int64_t dx = out[i].pos.x - x, dz = out[i].pos.z - z;
+        ok = dx*dx + dz*dz == dist[i];
+    }
+
+    // with a budget for just the three nearest rings of each type, the result
+    // has to be exact up to the distance of the fourth ring
+    truncated = 0;
+    initStructureIndex(&si, mc, seed, 2 * ntypes * 25);
+    n = getNearestStructures(&si, &g, types, ntypes, x, z, maxdist,
+        out, K, &truncated);
+    freeStructureIndex(&si);
+    ok &= truncated && n > 0 && dist[0] < (int64_t)4 * rsmin * rsmin;
+    for (i = 0; i < n && ok; i++)
+    {
+        int64_t dx = out[i].pos.x - x, dz = out[i].pos.z - z, d = dx*dx + dz*dz;
+        if (d < (int64_t)4 * rsmin * rsmin)
+            ok = d == dist[i];
+    }
+    free(dist);
+    return report("getNearestStructures()", ok);
+}
+
+int testBatchedApis()
+{
+    int ok = 1;
+    printf("Testing batched and parallel APIs:\n");
+    ok &= testStrongholdBatch(MC_1_16, 1);
+    ok &= testStrongholdBatch(MC_1_20, 1);
+    ok &= testStrongholdBatch(MC_1_20, 4);
+    ok &= testViableBatch(MC_1_16, Village);
+    ok &= testViableBatch(MC_1_20, Village);
+    ok &= testViableBatch(MC_1_20, Outpost);
+    ok &= testViableBatch(MC_1_20, Desert_Pyramid);
+    ok &= testVoronoiSHAs();
+    ok &= testFilterPlan(MC_1_16, 0);
+    ok &= testFilterPlan(MC_1_16, BF_APPROX);
+    ok &= testFilterPlan(MC_1_12, 0);
+    ok &= testClimateQuad(MC_1_18);
+    ok &= testClimateQuad(MC_1_20);
+    ok &= testParaRangeParallel();
+    ok &= testStructureGrid(MC_1_12, Village);
+    ok &= testStructureGrid(MC_1_16, Monument);
+    ok &= testStructureGrid(MC_1_20, Ancient_City);
+    ok &= testStructureGrid(MC_1_20, Outpost);
+    ok &= testBiomeStore(MC_1_16);
+    ok &= testBiomeStore(MC_1_20);
+    ok &= testNearestStructures();
+    return ok ? 0 : -1;
+}
+
+
 int getStructureConfig_override(int stype, int mc, StructureConfig *sconf)
 {
     return getStructureConfig(stype, mc, sconf);
@@ -536,6 +886,8 @@ int main()
     //testGeneration();
     //findBiomeParaBounds();
 
+    if (testBatchedApis() != 0)
+        return 1;
     return 0;
 }
 
@@ -1,9 +1,20 @@
 #include "util.h"
 #include "finders.h"
+#include "parallel.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 
 
@@ -523,11 +534,17 @@ int biomesToImage(unsigned char *pixels,
         const unsigned int sx, const unsigned int sy,
         const unsigned int pixscale, const int flip)
 {
-    unsigned int i, j;
+    unsigned int i, j, m, n;
     int containsInvalidBiomes = 0;
+    size_t line = 3 * (size_t)sx * pixscale;
 
     for (j = 0; j < sy; j++)
     {
+        size_t y0 = pixscale * (size_t)(flip ? j : sy-1-j);
+        unsigned char *row = pixels + line * y0;
+        unsigned char *pix = row;
+
+        // colorize the first line of the row, the others are copies
         for (i = 0; i < sx; i++)
         {
             int id = biomes[j*sx+i];
@@ -548,22 +565,16 @@ int biomesToImage(unsigned char *pixels,
                 b = biomeColors[id][2];
             }
 
-            unsigned int m, n;
-            for (m = 0; m < pixscale; m++) {
-                for (n = 0; n < pixscale; n++) {
-                    int idx = pixscale * i + n;
-                    if (flip)
-                        idx += (sx * pixscale) * ((pixscale * j) + m);
-                    else
-                        idx += (sx * pixscale) * ((pixscale * (sy-1-j)) + m);
-
-                    unsigned char *pix = pixels + 3*idx;
-                    pix[0] = (unsigned char)r;
-                    pix[1] = (unsigned char)g;
-                    pix[2] = (unsigned char)b;
-                }
+            for (n = 0; n < pixscale; n++, pix += 3)
+            {
+                pix[0] = (unsigned char)r;
+                pix[1] = (unsigned char)g;
+                pix[2] = (unsigned char)b;
             }
         }
+
+        for (m = 1; m < pixscale; m++)
+            memcpy(row + line * m, row, line);
     }
 
     return containsInvalidBiomes;
@@ -582,3 +593,850 @@ int savePPM(const char *path, const unsigned char *pixels, const unsigned int sx
 }
 
 
+
+
+//==============================================================================
+// PNG Output
+//==============================================================================
+
+/* The PNG encoder is self-contained: the images are palette based with one
+ * byte per pixel, every row uses the Up filter, and the deflate stream is a
+ * single block with the fixed Huffman codes that only encodes runs (matches
+ * at distance 1). Biome maps consist mostly of long runs and of rows that
+ * repeat the previous one, which this compresses well at a small fraction of
+ * the cost of a general purpose deflate implementation.
+ */
+
+#define PNG_CHUNK   0x10000
+
+struct PngStream
+{
+    FILE *fp;
+    unsigned int sx, sy, row;
+    int err;
+    uint32_t adler;
+    uint64_t bits;      // pending output bits
+    int nbits;
+    int last;           // last byte of the deflate input, -1 at the start
+    int run;            // pending repetitions of 'last'
+    unsigned char *prev, *cur;
+    unsigned char *out; // pending IDAT payload
+    size_t len;
+};
+
+static uint32_t g_png_crc[256];
+
+static void initPngCrc(void)
+{
+    uint32_t c;
+    int i, k;
+    if (g_png_crc[1])
+        return;
+    for (i = 0; i < 256; i++)
+    {
+        c = i;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        g_png_crc[i] = c;
+    }
+}
+
+static uint32_t pngCrc(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    size_t i;
+    for (i = 0; i < len; i++)
+        crc = g_png_crc[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static void putBE32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)(v);
+}
+
+static void pngChunk(PngStream *png, const char *type,
+        const unsigned char *data, size_t len)
+{
+    unsigned char hdr[8];
+    uint32_t crc;
+
+    putBE32(hdr, (uint32_t)len);
+    memcpy(hdr+4, type, 4);
+    crc = pngCrc(0xffffffff, hdr+4, 4);
+    crc = pngCrc(crc, data, len) ^ 0xffffffff;
+    if (fwrite(hdr, 1, 8, png->fp) != 8 ||
+        (len && fwrite(data, 1, len, png->fp) != len))
+        png->err = 1;
+    putBE32(hdr, crc);
+    if (fwrite(hdr, 1, 4, png->fp) != 4)
+        png->err = 1;
+}
+
+/// Appends up to 32 bits (LSB first) to the deflate stream.
+static void pngBits(PngStream *png, uint32_t v, int n)
+{
+    png->bits |= (uint64_t)v << png->nbits;
+    png->nbits += n;
+    while (png->nbits >= 8)
+    {
+        png->out[png->len++] = (unsigned char)png->bits;
+        png->bits >>= 8;
+        png->nbits -= 8;
+    }
+    if (png->len >= PNG_CHUNK)
+    {
+        pngChunk(png, "IDAT", png->out, png->len);
+        png->len = 0;
+    }
+}
+
+/// Writes a Huffman code, which is stored with its most significant bit first.
+static void pngCode(PngStream *png, uint32_t code, int n)
+{
+    uint32_t rev = 0;
+    int i;
+    for (i = 0; i < n; i++)
+        rev |= ((code >> i) & 1) << (n-1-i);
+    pngBits(png, rev, n);
+}
+
+/// Fixed Huffman code of a literal/length symbol.
+static void pngSymbol(PngStream *png, int sym)
+{
+    if (sym < 144)
+        pngCode(png, 0x30 + sym, 8);
+    else if (sym < 256)
+        pngCode(png, 0x190 + sym - 144, 9);
+    else if (sym < 280)
+        pngCode(png, sym - 256, 7);
+    else
+        pngCode(png, 0xc0 + sym - 280, 8);
+}
+
+/// Emits a match of length [3, 258] at distance 1.
+static void pngMatch(PngStream *png, int len)
+{
+    static const short base[] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+    };
+    static const char extra[] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+    };
+    int i = 28;
+    while (base[i] > len)
+        i--;
+    pngSymbol(png, 257 + i);
+    if (extra[i])
+        pngBits(png, len - base[i], extra[i]);
+    pngCode(png, 0, 5); // distance code 0: distance 1
+}
+
+static void pngFlushRun(PngStream *png)
+{
+    if (png->run >= 3)
+        pngMatch(png, png->run);
+    else
+        for (; png->run > 0; png->run--)
+            pngSymbol(png, png->last);
+    png->run = 0;
+}
+
+static void pngDeflate(PngStream *png, const unsigned char *buf, size_t len)
+{
+    uint32_t a = png->adler & 0xffff, b = png->adler >> 16;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        int c = buf[i];
+        a += c;
+        b += a;
+        if (i % 5552 == 5551) // keeps the sums from overflowing
+        {
+            a %= 65521;
+            b %= 65521;
+        }
+
+        if (c == png->last)
+        {
+            if (++png->run == 258)
+                pngFlushRun(png);
+        }
+        else
+        {
+            pngFlushRun(png);
+            pngSymbol(png, c);
+            png->last = c;
+        }
+    }
+    png->adler = ((b % 65521) << 16) | (a % 65521);
+}
+
+PngStream *pngOpen(const char *path, unsigned int sx, unsigned int sy,
+        unsigned char biomeColors[256][3])
+{
+    static const unsigned char sig[8] = {137, 'P', 'N', 'G', 13, 10, 26, 10};
+    unsigned char ihdr[13];
+    PngStream *png;
+
+    if (!sx || !sy)
+        return NULL;
+    png = (PngStream*) calloc(1, sizeof(PngStream));
+    if (!png)
+        return NULL;
+    png->prev = (unsigned char*) calloc(2 * (size_t)sx + 1, 1);
+    png->out = (unsigned char*) malloc(PNG_CHUNK + 64);
+    png->fp = fopen(path, "wb");
+    if (!png->prev || !png->out || !png->fp)
+    {
+        if (png->fp)
+            fclose(png->fp);
+        free(png->out);
+        free(png->prev);
+        free(png);
+        return NULL;
+    }
+    initPngCrc();
+    png->cur = png->prev + sx;
+    png->sx = sx;
+    png->sy = sy;
+    png->adler = 1;
+    png->last = -1;
+
+    if (fwrite(sig, 1, 8, png->fp) != 8)
+        png->err = 1;
+    putBE32(ihdr, sx);
+    putBE32(ihdr+4, sy);
+    ihdr[8] = 8;    // bit depth
+    ihdr[9] = 3;    // indexed color
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    pngChunk(png, "IHDR", ihdr, 13);
+    pngChunk(png, "PLTE", &biomeColors[0][0], 3*256);
+
+    png->out[png->len++] = 0x78; // zlib header: deflate, 32K window
+    png->out[png->len++] = 0x01;
+    pngBits(png, 1, 1); // final block
+    pngBits(png, 1, 2); // fixed Huffman codes
+    return png;
+}
+
+int pngWriteBiomeRows(PngStream *png, const int *biomes, unsigned int rows)
+{
+    unsigned char *f = png->cur;
+    unsigned int i, j;
+
+    if (png->row + rows > png->sy)
+        return png->err = -1;
+
+    for (j = 0; j < rows; j++, biomes += png->sx)
+    {
+        // Up filter: the prediction is the pixel above
+        f[0] = 2;
+        for (i = 0; i < png->sx; i++)
+        {
+            unsigned char id = (unsigned char) biomes[i];
+            f[i+1] = id - png->prev[i];
+            png->prev[i] = id;
+        }
+        pngDeflate(png, f, png->sx + 1);
+    }
+    png->row += rows;
+    return png->err;
+}
+
+int pngClose(PngStream *png)
+{
+    unsigned char adler[4];
+    int err;
+
+    pngFlushRun(png);
+    pngSymbol(png, 256); // end of block
+    if (png->nbits)
+        pngBits(png, 0, 8 - png->nbits);
+    putBE32(adler, png->adler);
+    memcpy(png->out + png->len, adler, 4);
+    png->len += 4;
+    pngChunk(png, "IDAT", png->out, png->len);
+    pngChunk(png, "IEND", NULL, 0);
+
+    err = png->err || png->row != png->sy;
+    if (fclose(png->fp))
+        err = 1;
+    free(png->out);
+    free(png->prev);
+    free(png);
+    return err ? -1 : 0;
+}
+
+
+//==============================================================================
+// Tile Pyramid
+//==============================================================================
+
+STRUCT(TileJobs)
+{
+    const Generator *g;
+    const char *dir;
+    unsigned char (*colors)[3];
+    int x, z, w, h, y;
+    int levels, tilesize;
+    int ntiles;
+    int *offs;          // index of the first tile of each zoom level
+    size_t cachesize;
+    volatile int next;
+    volatile int done;
+    volatile int err;
+};
+
+/// Blocks per pixel at a zoom level.
+static int tileBpp(const TileJobs *jobs, int zoom)
+{
+    return 4 << (jobs->levels - 1 - zoom);
+}
+
+/// Range of tile coordinates that overlap the area at a zoom level.
+static void tileBounds(const TileJobs *jobs, int zoom, int *t0, int *tn)
+{
+    int span = tileBpp(jobs, zoom) * jobs->tilesize;
+    int x0 = floordiv(jobs->x, span), x1 = floordiv(jobs->x + jobs->w - 1, span);
+    int z0 = floordiv(jobs->z, span), z1 = floordiv(jobs->z + jobs->h - 1, span);
+    t0[0] = x0; tn[0] = x1 - x0 + 1;
+    t0[1] = z0; tn[1] = z1 - z0 + 1;
+}
+
+/// Generation scale for a zoom level: the coarsest scale that resolves it.
+static int tileScale(int bpp)
+{
+    int scale = 256;
+    while (scale > bpp)
+        scale >>= 2;
+    return scale;
+}
+
+/// Fills the 'tilesize'^2 biome IDs of a tile at the given block origin.
+static int genTile(const TileJobs *jobs, Generator *g, int *cache,
+        int *ids, int bx, int bz, int bpp)
+{
+    int n = jobs->tilesize;
+    int scale = tileScale(bpp);
+    int f = bpp / scale;
+    int ys = jobs->y;
+    Range r;
+    int i, j;
+
+    for (i = 4; i < scale; i <<= 2)
+        ys >>= 2;
+    r.scale = scale;
+    r.x = bx / scale;
+    r.z = bz / scale;
+    r.y = ys;
+    r.sy = 1;
+
+    if (f <= 2)
+    {
+        r.sx = r.sz = n * f;
+        if (genBiomes(g, cache, r))
+            return -1;
+        if (f == 1)
+        {
+            memcpy(ids, cache, n * (size_t)n * sizeof(int));
+        }
+        else
+        {
+            // keep every other cell of the 2x grid
+            for (j = 0; j < n; j++)
+                for (i = 0; i < n; i++)
+                    ids[j*n+i] = cache[(2*j)*r.sx + 2*i];
+        }
+    }
+    else
+    {
+        // sample one cell per pixel
+        r.sx = r.sz = 1;
+        for (j = 0; j < n; j++)
+        {
+            for (i = 0; i < n; i++)
+            {
+                r.x = (bx + i * bpp) / scale;
+                r.z = (bz + j * bpp) / scale;
+                if (genBiomes(g, cache, r))
+                    return -1;
+                ids[j*n+i] = cache[0];
+            }
+        }
+    }
+    return 0;
+}
+
+static void tileWorker(void *data, int t)
+{
+    TileJobs *jobs = (TileJobs*) data;
+    int n = jobs->tilesize;
+    Generator g;
+    int *cache, *ids;
+    char path[4096];
+    (void) t;
+
+    cache = (int*) malloc(jobs->cachesize * sizeof(int));
+    ids = (int*) malloc(n * (size_t)n * sizeof(int));
+    if (!cache || !ids)
+    {
+        jobs->err = 1;
+        goto L_end;
+    }
+    setupGenerator(&g, jobs->g->mc, jobs->g->flags);
+    applySeed(&g, jobs->g->dim, jobs->g->seed);
+
+    while (!jobs->err)
+    {
+        int k = parallelNext(&jobs->next);
+        int zoom, t0[2], tn[2], tx, tz, bpp, span;
+        if (k >= jobs->ntiles)
+            break;
+        for (zoom = 0; jobs->offs[zoom+1] <= k; zoom++);
+        tileBounds(jobs, zoom, t0, tn);
+        k -= jobs->offs[zoom];
+        tx = t0[0] + k / tn[1];
+        tz = t0[1] + k % tn[1];
+        bpp = tileBpp(jobs, zoom);
+        span = bpp * n;
+
+        if (genTile(jobs, &g, cache, ids, tx * span, tz * span, bpp))
+        {
+            jobs->err = 1;
+            break;
+        }
+        snprintf(path, sizeof(path), "%s/%d/%d/%d.png", jobs->dir, zoom, tx, tz);
+        PngStream *png = pngOpen(path, n, n, jobs->colors);
+        int err = !png || pngWriteBiomeRows(png, ids, n);
+        if (png)
+            err |= pngClose(png) != 0;
+        if (err)
+        {
+            jobs->err = 1;
+            break;
+        }
+        parallelNext(&jobs->done);
+    }
+
+L_end:
+    free(ids);
+    free(cache);
+}
+
+static int makeDir(const char *path)
+{
+#if defined(_WIN32)
+    if (_mkdir(path) == 0 || errno == EEXIST)
+        return 0;
+#else
+    if (mkdir(path, 0755) == 0 || errno == EEXIST)
+        return 0;
+#endif
+    return -1;
+}
+
+int renderTilePyramid(const Generator *g, const char *dir,
+        unsigned char biomeColors[256][3], int x, int z, int w, int h, int y,
+        int levels, int tilesize, int threads)
+{
+    TileJobs jobs;
+    char path[4096];
+    int zoom, i, t0[2], tn[2];
+
+    if (w <= 0 || h <= 0 || levels <= 0 || levels > 24 || tilesize <= 0)
+        return -1;
+    // the block span of the coarsest tiles and the block coordinates of all
+    // the tiles that overlap the area have to fit into int
+    int64_t span = ((int64_t)4 << (levels - 1)) * tilesize;
+    if (span > INT_MAX ||
+        (int64_t)x - span < INT_MIN || (int64_t)x + w + span > INT_MAX ||
+        (int64_t)z - span < INT_MIN || (int64_t)z + h + span > INT_MAX)
+        return -1;
+
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.g = g;
+    jobs.dir = dir;
+    jobs.colors = biomeColors;
+    jobs.x = x;
+    jobs.z = z;
+    jobs.w = w;
+    jobs.h = h;
+    jobs.y = y;
+    jobs.levels = levels;
+    jobs.tilesize = tilesize;
+    jobs.offs = (int*) malloc((levels + 1) * sizeof(int));
+    if (!jobs.offs)
+        return -1;
+
+    // create the directories up front, so the workers only write files
+    for (zoom = 0; zoom < levels; zoom++)
+    {
+        Range r = {tileScale(tileBpp(&jobs, zoom)), 0, 0, 2*tilesize, 2*tilesize, 0, 1};
+        size_t cs;
+
+        tileBounds(&jobs, zoom, t0, tn);
+        if ((int64_t)tn[0] * tn[1] > INT_MAX - jobs.ntiles)
+            goto L_err;
+        jobs.offs[zoom] = jobs.ntiles;
+        jobs.ntiles += tn[0] * tn[1];
+
+        cs = getMinCacheSize(g, r.scale, r.sx, r.sy, r.sz);
+        if (cs > jobs.cachesize)
+            jobs.cachesize = cs;
+
+        snprintf(path, sizeof(path), "%s/%d", dir, zoom);
+        if (makeDir(path))
+            goto L_err;
+        for (i = 0; i < tn[0]; i++)
+        {
+            snprintf(path, sizeof(path), "%s/%d/%d", dir, zoom, t0[0] + i);
+            if (makeDir(path))
+                goto L_err;
+        }
+    }
+    jobs.offs[levels] = jobs.ntiles;
+
+    runParallel(threads, tileWorker, &jobs);
+    free(jobs.offs);
+    return jobs.err ? -1 : jobs.done;
+
+L_err:
+    free(jobs.offs);
+    return -1;
+}
+
+
+//==============================================================================
+// Biome Stores
+//==============================================================================
+
+/// Maps a store file. For writing ('size' > 0) an empty file is grown to
+/// 'size' bytes, and '*created' tells if that happened.
+static int mapStoreFile(BiomeStore *bs, const char *path, size_t size,
+        int *created)
+{
+    int writable = size > 0;
+    void *p;
+
+    memset(bs, 0, sizeof(*bs));
+#if defined(_WIN32)
+    HANDLE fh, mh;
+    LARGE_INTEGER fs;
+
+    fh = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+            FILE_SHARE_READ, NULL, writable ? OPEN_ALWAYS : OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE)
+        return -1;
+    if (!GetFileSizeEx(fh, &fs))
+        goto L_err;
+    if (writable)
+    {
+        *created = fs.QuadPart == 0;
+        if (*created)
+        {
+            fs.QuadPart = size;
+            if (!SetFilePointerEx(fh, fs, NULL, FILE_BEGIN) || !SetEndOfFile(fh))
+                goto L_err;
+        }
+        else if ((uint64_t)fs.QuadPart != size)
+            goto L_err;
+    }
+    else
+    {
+        size = (size_t) fs.QuadPart;
+    }
+    if (size < sizeof(BiomeStoreHeader))
+        goto L_err;
+    mh = CreateFileMappingA(fh, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+            0, 0, NULL);
+    if (!mh)
+        goto L_err;
+    p = MapViewOfFile(mh, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    if (!p)
+    {
+        CloseHandle(mh);
+        goto L_err;
+    }
+    bs->fd = (intptr_t) fh;
+    bs->fmap = mh;
+#else
+    struct stat st;
+    int fd;
+
+    fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st))
+        goto L_err;
+    if (writable)
+    {
+        *created = st.st_size == 0;
+        if (*created && ftruncate(fd, (off_t) size))
+            goto L_err;
+        if (!*created && (uint64_t)st.st_size != size)
+            goto L_err;
+    }
+    else
+    {
+        size = (size_t) st.st_size;
+    }
+    if (size < sizeof(BiomeStoreHeader))
+        goto L_err;
+    p = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+            MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        goto L_err;
+    bs->fd = fd;
+#endif
+    bs->head = (BiomeStoreHeader*) p;
+    bs->done = (uint8_t*) p + sizeof(BiomeStoreHeader);
+    bs->size = size;
+    return 0;
+
+L_err:
+#if defined(_WIN32)
+    CloseHandle(fh);
+#else
+    close(fd);
+#endif
+    return -1;
+}
+
+/// Writes a range of the mapping back to the file and waits for it.
+static int syncStoreRange(const BiomeStore *bs, const void *p, size_t len)
+{
+#if defined(_WIN32)
+    return !FlushViewOfFile(p, len) || !FlushFileBuffers((HANDLE) bs->fd);
+#else
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t a = (uintptr_t) p & ~(page - 1);
+    (void) bs;
+    return msync((void*) a, (uintptr_t) p + len - a, MS_SYNC) != 0;
+#endif
+}
+
+static void unmapStoreFile(BiomeStore *bs, int sync)
+{
+    if (!bs->head)
+        return;
+#if defined(_WIN32)
+    if (sync)
+        FlushViewOfFile(bs->head, 0);
+    UnmapViewOfFile(bs->head);
+    CloseHandle((HANDLE) bs->fmap);
+    CloseHandle((HANDLE) bs->fd);
+#else
+    if (sync)
+        msync(bs->head, bs->size, MS_SYNC);
+    munmap(bs->head, bs->size);
+    close((int) bs->fd);
+#endif
+    memset(bs, 0, sizeof(*bs));
+}
+
+/// Total file size of a store, or 0 if it does not fit into memory.
+static size_t getStoreSize(const BiomeStoreHeader *h)
+{
+    size_t ntiles = (size_t)h->ntx * h->ntz;
+    size_t tile = (size_t)h->tilesize * h->tilesize;
+    if (ntiles > (SIZE_MAX - h->dataoff) / tile)
+        return 0;
+    return h->dataoff + ntiles * tile;
+}
+
+STRUCT(StoreJobs)
+{
+    const Generator *g;
+    BiomeStore *bs;
+    size_t cachesize;
+    volatile int next;
+    volatile int gen;
+    volatile int err;
+};
+
+static void storeWorker(void *data, int t)
+{
+    StoreJobs *jobs = (StoreJobs*) data;
+    const BiomeStoreHeader *h = jobs->bs->head;
+    int n = h->tilesize;
+    int ntiles = h->ntx * h->ntz;
+    Generator g;
+    int *cache;
+    (void) t;
+
+    cache = (int*) malloc(jobs->cachesize * sizeof(int));
+    if (!cache)
+    {
+        jobs->err = 1;
+        return;
+    }
+    setupGenerator(&g, jobs->g->mc, jobs->g->flags);
+    applySeed(&g, jobs->g->dim, jobs->g->seed);
+
+    while (!jobs->err)
+    {
+        int k = parallelNext(&jobs->next);
+        if (k >= ntiles)
+            break;
+        if (jobs->bs->done[k])
+            continue;
+
+        int tx = k % h->ntx, tz = k / h->ntx;
+        Range r = {h->scale, h->x + tx*n, h->z + tz*n, n, n, h->y, 1};
+        uint8_t *tile = jobs->bs->data + k * (size_t)n * n;
+        int i, j;
+
+        if (r.sx > h->x + h->sx - r.x)
+            r.sx = h->x + h->sx - r.x;
+        if (r.sz > h->z + h->sz - r.z)
+            r.sz = h->z + h->sz - r.z;
+        if (genBiomes(&g, cache, r))
+        {
+            jobs->err = 1;
+            break;
+        }
+        for (j = 0; j < r.sz; j++)
+            for (i = 0; i < r.sx; i++)
+                tile[j*n+i] = (uint8_t) cache[j*r.sx+i];
+        // mark the tile only once its data is on disk, so that a crash
+        // cannot leave a completed tile without data
+        if (syncStoreRange(jobs->bs, tile, n * (size_t)n))
+        {
+            jobs->err = 1;
+            break;
+        }
+        jobs->bs->done[k] = 1;
+        parallelNext(&jobs->gen);
+    }
+
+    free(cache);
+}
+
+int genBiomeStore(const Generator *g, const char *path, Range r, int tilesize,
+        int threads)
+{
+    BiomeStoreHeader head;
+    BiomeStore bs;
+    StoreJobs jobs;
+    size_t size, ntiles;
+    int created;
+
+    if (r.scale != 1 && r.scale != 4 && r.scale != 16 && r.scale != 64 &&
+        r.scale != 256)
+        return -1;
+    if (r.sx <= 0 || r.sz <= 0 || r.sy > 1 || tilesize <= 0)
+        return -1;
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, BIOME_STORE_MAGIC, sizeof(head.magic));
+    head.format = BIOME_STORE_FORMAT;
+    head.seed = g->seed;
+    head.mc = g->mc;
+    head.dim = g->dim;
+    head.flags = g->flags;
+    head.scale = r.scale;
+    head.x = r.x;
+    head.z = r.z;
+    head.sx = r.sx;
+    head.sz = r.sz;
+    head.y = r.y;
+    head.tilesize = tilesize;
+    head.ntx = (r.sx - 1) / tilesize + 1;
+    head.ntz = (r.sz - 1) / tilesize + 1;
+    ntiles = (size_t)head.ntx * head.ntz;
+    if (ntiles > INT32_MAX / 2)
+        return -1;
+    // the tile data starts on a page boundary
+    head.dataoff = (uint32_t)((sizeof(head) + ntiles + 4095) & ~(size_t)4095);
+    size = getStoreSize(&head);
+    if (size == 0)
+        return -1;
+
+    if (mapStoreFile(&bs, path, size, &created))
+        return -1;
+    if (!created)
+    {
+        // a zeroed header is left by an interruption before it was written
+        BiomeStoreHeader zero;
+        memset(&zero, 0, sizeof(zero));
+        created = memcmp(bs.head, &zero, sizeof(zero)) == 0;
+    }
+    if (created)
+    {
+        // the header is on disk before any tile is marked complete
+        *bs.head = head;
+        memset(bs.done, 0, ntiles);
+        if (syncStoreRange(&bs, bs.head, head.dataoff))
+        {
+            unmapStoreFile(&bs, 0);
+            return -1;
+        }
+    }
+    else if (memcmp(bs.head, &head, sizeof(head)) != 0)
+    {
+        unmapStoreFile(&bs, 0);
+        return -1;
+    }
+    bs.data = (uint8_t*) bs.head + head.dataoff;
+
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.g = g;
+    jobs.bs = &bs;
+    jobs.cachesize = getMinCacheSize(g, r.scale, tilesize, 1, tilesize);
+    runParallel(threads, storeWorker, &jobs);
+
+    unmapStoreFile(&bs, 1);
+    return jobs.err ? -1 : jobs.gen;
+}
+
+int openBiomeStore(BiomeStore *bs, const char *path)
+{
+    const BiomeStoreHeader *h;
+
+    if (mapStoreFile(bs, path, 0, NULL))
+        return -1;
+    h = bs->head;
+    if (memcmp(h->magic, BIOME_STORE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->format != BIOME_STORE_FORMAT || h->tilesize <= 0 ||
+        h->sx <= 0 || h->sz <= 0 ||
+        h->ntx != (h->sx - 1) / h->tilesize + 1 ||
+        h->ntz != (h->sz - 1) / h->tilesize + 1 ||
+        h->dataoff < sizeof(*h) + (size_t)h->ntx * h->ntz ||
+        getStoreSize(h) != bs->size)
+    {
+        unmapStoreFile(bs, 0);
+        return -1;
+    }
+    bs->data = (uint8_t*) bs->head + h->dataoff;
+    return 0;
+}
+
+void closeBiomeStore(BiomeStore *bs)
+{
+    unmapStoreFile(bs, 0);
+}
+
+int getBiomeStoreAt(const BiomeStore *bs, int x, int z)
+{
+    const BiomeStoreHeader *h = bs->head;
+    int n = h->tilesize;
+    size_t k;
+    uint8_t id;
+
+    x -= h->x;
+    z -= h->z;
+    if (x < 0 || z < 0 || x >= h->sx || z >= h->sz)
+        return none;
+    k = (size_t)(z / n) * h->ntx + x / n;
+    if (!bs->done[k])
+        return none;
+    id = bs->data[k * n * n + (size_t)(z % n) * n + x % n];
+    return id == 255 ? none : id;
+}
@@ -2,6 +2,8 @@
 #define UTIL_H_
 
 
+#include "generator.h"
+
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -54,6 +56,117 @@ int biomesToImage(unsigned char *pixels,
 int savePPM(const char* path, const unsigned char *pixels,
         const unsigned int sx, const unsigned int sy);
 
+/* Streaming writer for indexed PNG images of biome maps. The biome IDs are
+ * the palette indices, so the colors come from the image palette and only
+ * one byte per pixel is encoded. Rows are compressed and written out as they
+ * arrive, so the image never has to be held in memory as a whole.
+ * Use pngOpen() to create the file, pngWriteBiomeRows() to append rows of
+ * 'sx' biome IDs (top to bottom) and pngClose() to finish the image.
+ * pngClose() returns 0 if all 'sy' rows were written successfully.
+ */
+typedef struct PngStream PngStream;
+
+PngStream *pngOpen(const char *path, unsigned int sx, unsigned int sy,
+        unsigned char biomeColors[256][3]);
+int pngWriteBiomeRows(PngStream *png, const int *biomes, unsigned int rows);
+int pngClose(PngStream *png);
+
+/* Renders the biomes in a block area into a pyramid of square PNG tiles for
+ * slippy-map viewers (e.g. Leaflet with CRS.Simple). The tiles are written to
+ * <dir>/<zoom>/<tx>/<tz>.png with the +z direction pointing down. The most
+ * detailed zoom, (levels-1), has one pixel per 4 blocks, and each lower zoom
+ * halves the resolution. Each zoom is generated with genBiomes() at the
+ * coarsest of the scales 4, 16, 64 and 256 that still resolves its pixels.
+ * The tiles are generated and encoded on the given number of threads and
+ * written out as they finish.
+ *
+ * @g           : generator, initialized with a seed and dimension
+ * @dir         : output directory, which has to exist
+ * @biomeColors : colormap for the tile palettes
+ * @x,z,w,h     : block area to render
+ * @y           : vertical biome coordinate (scale 1:4)
+ * @levels      : number of zoom levels
+ * @tilesize    : tile width and height in pixels (e.g. 256)
+ * @threads     : number of threads to use
+ *
+ * Returns the number of tiles written, or -1 on failure. This includes areas
+ * for which the block span of the coarsest tiles, 4 * 2^(levels-1) *
+ * tilesize, or the block coordinates of the tiles do not fit into an int.
+ */
+int renderTilePyramid(const Generator *g, const char *dir,
+        unsigned char biomeColors[256][3], int x, int z, int w, int h, int y,
+        int levels, int tilesize, int threads);
+
+
+/* Biome stores are precomputed biome maps on disk that can be memory-mapped
+ * without regenerating them. A store covers a 2D Range (at its scale and
+ * vertical coordinate) that is split into square tiles of 'tilesize' cells.
+ * The file consists of:
+ *  - the BiomeStoreHeader, describing the generator and the tiling,
+ *  - one completion flag byte per tile,
+ *  - the tile data starting at offset 'dataoff' (page aligned), with one byte
+ *    per cell. The tiles are stored in row-major order, each as a contiguous
+ *    tilesize x tilesize block of rows. Cells outside the range are padding,
+ *    and the byte value 255 stands for 'none' (-1).
+ * All fields are in the byte order of the machine that created the file.
+ */
+#define BIOME_STORE_MAGIC   "CUBIOMAP"
+#define BIOME_STORE_FORMAT  1
+
+STRUCT(BiomeStoreHeader)
+{
+    char magic[8];
+    uint32_t format;
+    uint32_t dataoff;   // file offset of the tile data
+    uint64_t seed;
+    int32_t mc, dim;
+    uint32_t flags;     // generator flags
+    int32_t scale, x, z, sx, sz, y;
+    int32_t tilesize;
+    int32_t ntx, ntz;   // number of tiles along x and z
+};
+
+STRUCT(BiomeStore)
+{
+    BiomeStoreHeader *head;
+    uint8_t *done;      // completion flag for each tile
+    uint8_t *data;      // tile data
+    size_t size;        // size of the mapping
+    intptr_t fd;        // platform file handle
+    void *fmap;         // platform mapping handle
+};
+
+/* Generates the biomes of a Range into a biome store at 'path', tile by
+ * tile. The generation works out-of-core: the tiles are written straight
+ * into the memory-mapped file and each thread only holds the cache for one
+ * tile. If the file already exists it has to describe the same generator,
+ * range and tiling, and the generation resumes with the tiles that have
+ * not been completed yet. The header and each tile are synced to disk
+ * before the tile is marked complete, so the store also resumes correctly
+ * after a system crash.
+ *
+ * @g        : generator, initialized with a seed and dimension
+ * @path     : file of the biome store
+ * @r        : area to generate (r.sy has to be 0 or 1)
+ * @tilesize : tile width and height in cells (e.g. 512)
+ * @threads  : number of threads to use
+ *
+ * Returns the number of tiles generated by this call, or -1 on failure
+ * (including a mismatching existing file).
+ */
+int genBiomeStore(const Generator *g, const char *path, Range r, int tilesize,
+        int threads);
+
+/* Maps an existing biome store for reading. Returns 0 on success.
+ */
+int openBiomeStore(BiomeStore *bs, const char *path);
+void closeBiomeStore(BiomeStore *bs);
+
+/* Looks up the biome ID at a position in the scaled coordinates of the
+ * store. Returns -1 (none) outside the range or in incomplete tiles.
+ */
+int getBiomeStoreAt(const BiomeStore *bs, int x, int z);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,3 +1,4 @@
+import array
 import mc_worldgen
 from enum import IntEnum
 
@@ -18,11 +19,22 @@ def test_enum_returns():
     assert isinstance(biome, mc_worldgen.Biome)
     assert biome.name == 'ocean'  # 0 is ocean
 
-    # Test gen_biomes
+    # Test gen_biomes, which returns a (sy, sz, sx) array of biome IDs
     biomes = g.gen_biomes(4, 0, 0, 2, 2)
     print(f"gen_biomes returned: {biomes!r}")
-    assert isinstance(biomes, list)
-    assert all(isinstance(b, mc_worldgen.Biome) for b in biomes)
+    assert tuple(biomes.shape) == (1, 2, 2)
+    ids = memoryview(biomes).cast('B').cast('i').tolist()
+    assert all(isinstance(mc_worldgen.Biome(b), mc_worldgen.Biome) for b in ids)
+
+    # The out buffer has to match the dtype
+    out = array.array('i', [0] * 4)
+    assert g.gen_biomes(4, 0, 0, 2, 2, out=out) is out
+    assert out.tolist() == ids
+    try:
+        g.gen_biomes(4, 0, 0, 2, 2, out=array.array('f', [0] * 4))
+        assert False, "float buffer accepted"
+    except TypeError:
+        pass
 
     print("Enum returns PASSED")
 